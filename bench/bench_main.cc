@@ -0,0 +1,46 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+// Reports in JSON unless another format is asked for, so the results of
+// releases can be diffed, e.g., with benchmark's tools/compare.py:
+//
+//   bazel run -c opt //bench:bench -- --benchmark_out=bench.json
+int main(int argc, char** argv) {
+  std::vector<char*> args(argv, argv + argc);
+  char format[] = "--benchmark_format=json";
+  bool formatted = false;
+  for (int i = 1; i < argc; ++i) {
+    formatted = formatted || strncmp(argv[i], format, 19) == 0;
+  }
+
+  if (!formatted) {
+    args.push_back(format);
+  }
+
+  int count = args.size();
+  args.push_back(nullptr);
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+    return 1;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bench/bench_util.h"
+
+#include <ftw.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "record/async_file_writer.h"
+#include "record/file_writer.h"
+#include "record/io_uring_file_writer.h"
+#include "record/mmap_file_writer.h"
+#include "record/sharded_writer.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+static int RemoveEntry(const char* path, const struct stat* st, int flag,
+                       struct FTW* ftw) {
+  return ftw->level > 0 ? remove(path) : 0;
+}
+
+std::string BenchDir(const std::string& name) {
+  std::string root = IsDirectory("/dev/shm") ? "/dev/shm" : "/tmp";
+  auto dir = StringUtil::Format("%s/tensorboard_bench/%s", root.c_str(),
+                                name.c_str());
+  // tmpfs is memory, the event files of a run must not pile up
+  if (IsDirectory(dir)) {
+    nftw(dir.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+  }
+
+  MakeDirs(dir);
+  return dir;
+}
+
+std::function<Writer*(const std::string&)> WriterByName(
+    const std::string& name, size_t shards) {
+  if (name == "file") {
+    return [](const std::string& p) -> Writer* { return new FileWriter(p); };
+  } else if (name == "async") {
+    return [](const std::string& p) -> Writer* {
+      return new AsyncFileWriter(p);
+    };
+  } else if (name == "mmap") {
+    return [](const std::string& p) -> Writer* {
+      return new MmapFileWriter(p);
+    };
+  } else if (name == "io_uring") {
+    return [](const std::string& p) -> Writer* {
+      return new IoUringFileWriter(p);
+    };
+  } else if (name == "sharded") {
+    return ShardedWriter::Maker(shards);
+  }
+
+  return nullptr;
+}
+
+}  // namespace nlptk
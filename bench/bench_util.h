@@ -0,0 +1,37 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BENCH_BENCH_UTIL_H_
+#define BENCH_BENCH_UTIL_H_
+
+#include <functional>
+#include <string>
+
+#include "record/writer.h"
+
+namespace nlptk {
+
+// An empty directory "<root>/tensorboard_bench/<name>" on tmpfs if there
+// is one, so the writers are measured against memory instead of the disk.
+// The files of the previous benchmark of the name are removed.
+std::string BenchDir(const std::string& name);
+
+// A maker of the writers "file", "async", "mmap", "io_uring" or "sharded"
+// with their default options, nullptr for other names.
+std::function<Writer*(const std::string&)> WriterByName(
+    const std::string& name, size_t shards = 4);
+
+}  // namespace nlptk
+
+#endif  // BENCH_BENCH_UTIL_H_
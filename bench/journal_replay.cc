@@ -0,0 +1,324 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays a journal captured by nlptk::Journal, either the writes into the
+// writers of the captured recorder, or the Add* calls into a new Recorder
+// with one thread per captured thread, and reports the throughput and the
+// latency of the calls. `--speed` scales the captured pace, 0 replays as
+// fast as possible. E.g., to replay a production job 10 times faster:
+//
+//   bazel run -c opt //bench:journal_replay -- --journal=job --speed=10
+
+#include <algorithm>
+#include <chrono>                 // NOLINT(build/c++11)
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>                 // NOLINT(build/c++11)
+#include <vector>
+
+#include "bench/bench_util.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "record/event_file.h"
+#include "record/journal.h"
+#include "record/recorder.h"
+#include "record/utils.h"
+
+DEFINE_string(journal, "", "journal to replay");
+DEFINE_string(logdir, "", "directory of the event files, tmpfs by default");
+DEFINE_string(mode, "writers", "replay the 'writers' or the 'recorder' calls");
+DEFINE_string(writer, "file", "file, async, mmap, io_uring or sharded");
+DEFINE_int32(shards, 4, "shards of the sharded writer");
+DEFINE_double(speed, 1.0, "pace relative to the capture, 0 for no pauses");
+
+using nlptk::JournalEntry;
+using nlptk::Recorder;
+using nlptk::StatsCounters;
+using nlptk::Writer;
+using nlptk::WriterStats;
+
+using std::string;
+using std::vector;
+
+using Clock = std::chrono::steady_clock;
+
+// waits until `time` nanoseconds of the journal scaled by the speed
+static void Pace(Clock::time_point start, uint64_t time) {
+  if (FLAGS_speed > 0.0) {
+    std::this_thread::sleep_until(
+        start + std::chrono::nanoseconds(
+                    static_cast<uint64_t>(time / FLAGS_speed)));
+  }
+}
+
+static double Quantile(vector<double>* samples, double q) {
+  if (samples->empty()) {
+    return 0.0;
+  }
+
+  std::sort(samples->begin(), samples->end());
+  return (*samples)[q * (samples->size() - 1)];
+}
+
+// the writes in journal order into the writers, returns the latencies of
+// the calls in seconds
+static vector<double> ReplayWriters(vector<JournalEntry>* entries,
+                                    const Recorder::WriterMaker& maker,
+                                    const string& dir, WriterStats* stats) {
+  std::map<uint32_t, std::unique_ptr<Writer>> writers;
+  vector<double> latency;
+  auto start = Clock::now();
+  for (auto& entry : *entries) {
+    if (entry.kind == JournalEntry::kWriter) {
+      auto sub = nlptk::JoinPath(dir, std::to_string(entry.writer));
+      nlptk::MakeDirs(sub);
+      writers[entry.writer].reset(maker(nlptk::JoinPath(sub, "events")));
+      continue;
+    }
+
+    auto& writer = writers[entry.writer];
+    if (entry.kind == JournalEntry::kCall || nullptr == writer) {
+      continue;
+    }
+
+    // the calls are prepared before they are timed
+    tensorboard::Event event;
+    string records;
+    if (entry.kind == JournalEntry::kWrite) {
+      event.ParseFromString(entry.events[0]);
+    } else if (entry.kind == JournalEntry::kWriteRecords) {
+      for (const auto& data : entry.events) {
+        nlptk::AppendRecord(data.data(), data.size(), &records);
+      }
+    }
+
+    Pace(start, entry.time);
+    auto begin = StatsCounters::Now();
+    switch (entry.kind) {
+      case JournalEntry::kWrite:
+        writer->Write(std::move(event));
+        break;
+      case JournalEntry::kWriteRecords:
+        writer->WriteRecords(records.data(), records.size(),
+                             entry.events.size());
+        break;
+      case JournalEntry::kWriteBlob:
+        writer->WriteBlob(entry.head, nlptk::Blob(std::move(entry.blob)),
+                          entry.tail);
+        break;
+      case JournalEntry::kFlush:
+        writer->Flush();
+        break;
+      default:
+        break;
+    }
+
+    latency.push_back(1e-9 * (StatsCounters::Now() - begin));
+  }
+
+  for (auto& item : writers) {
+    item.second->Flush();
+    *stats += item.second->Stats();
+    item.second->Close();
+  }
+
+  return latency;
+}
+
+// one Add* call of a journal, returns its latency in seconds
+static double Call(Recorder* recorder, const JournalEntry& entry) {
+  const auto& tag = entry.tag;
+  auto count = std::max<uint64_t>(entry.count, 1);
+  auto size = entry.bytes / count;
+  std::mt19937_64 rng(entry.time);
+  std::normal_distribution<double> normal;
+  vector<double> values(entry.call == JournalEntry::kAddHistogram ||
+                        entry.call == JournalEntry::kAddHistogramRaw ?
+                        count : 0);
+  for (auto& value : values) {
+    value = normal(rng);
+  }
+
+  if (entry.call == JournalEntry::kAddHistogramRaw) {
+    // the bucket limits
+    std::sort(values.begin(), values.end());
+  }
+
+  std::map<string, float> scalars;
+  vector<string> payloads;
+  vector<float> mat;
+  vector<string> labels;
+  if (entry.call == JournalEntry::kAddScalars) {
+    for (uint64_t i = 0; i < count; ++i) {
+      scalars[std::to_string(i)] = 0.5f;
+    }
+  } else if (entry.call == JournalEntry::kAddImages) {
+    payloads.assign(count, string(size, 'i'));
+  } else if (entry.call == JournalEntry::kAddEmbedding) {
+    mat.assign(entry.bytes / sizeof(float) / count * count, 0.5f);
+    for (uint64_t i = 0; i < count; ++i) {
+      labels.push_back(std::to_string(i));
+    }
+  }
+
+  string payload(entry.bytes, 'p');
+  auto begin = StatsCounters::Now();
+  switch (entry.call) {
+    case JournalEntry::kAddScalar:
+      recorder->AddScalar(tag, 0.5f, entry.step);
+      break;
+    case JournalEntry::kAddScalars:
+      recorder->AddScalars(tag, scalars, entry.step);
+      break;
+    case JournalEntry::kAddHistogram:
+      recorder->AddHistogram(tag, values, entry.step);
+      break;
+    case JournalEntry::kAddHistogramRaw:
+      recorder->AddHistogramRaw(tag, -1.0, 1.0, count, 0.0, count, values,
+                                vector<double>(count, 1.0), entry.step);
+      break;
+    case JournalEntry::kAddImage:
+      recorder->AddImage(tag, std::move(payload),
+                         {entry.width, entry.height, entry.channels},
+                         entry.step);
+      break;
+    case JournalEntry::kAddImages:
+      recorder->AddImages(tag, payloads,
+                          {entry.width, entry.height, entry.channels},
+                          entry.step);
+      break;
+    case JournalEntry::kAddAudio:
+      recorder->AddAudio(tag, std::move(payload), {1, 1}, entry.step);
+      break;
+    case JournalEntry::kAddText:
+      recorder->AddText(tag, payload, entry.step);
+      break;
+    case JournalEntry::kAddEmbedding:
+      recorder->AddEmbedding(mat, count, mat.size() / count, labels,
+                             std::max<int64_t>(entry.step, 0), tag);
+      break;
+  }
+
+  return 1e-9 * (StatsCounters::Now() - begin);
+}
+
+// the Add* calls of every captured thread from a thread of its own
+static vector<double> ReplayRecorder(const vector<JournalEntry>& entries,
+                                     const Recorder::WriterMaker& maker,
+                                     const string& dir, WriterStats* stats) {
+  std::map<uint32_t, vector<const JournalEntry*>> calls;
+  for (const auto& entry : entries) {
+    if (entry.kind == JournalEntry::kCall) {
+      calls[entry.thread].push_back(&entry);
+    }
+  }
+
+  Recorder recorder(dir, maker);
+  vector<vector<double>> latencies(calls.size());
+  vector<std::thread> threads;
+  auto start = Clock::now();
+  for (auto& item : calls) {
+    auto latency = &latencies[threads.size()];
+    auto thread_calls = &item.second;
+    threads.emplace_back([&recorder, latency, thread_calls, start] {
+      for (auto entry : *thread_calls) {
+        Pace(start, entry->time);
+        latency->push_back(Call(&recorder, *entry));
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  recorder.Flush();
+  *stats = recorder.Stats();
+
+  vector<double> latency;
+  for (const auto& samples : latencies) {
+    latency.insert(latency.end(), samples.begin(), samples.end());
+  }
+
+  return latency;
+}
+
+int main(int argc, char* argv[]) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  auto maker = nlptk::WriterByName(FLAGS_writer, FLAGS_shards);
+  if (nullptr == maker) {
+    LOG(ERROR) << "Unknown writer '" << FLAGS_writer << "'";
+    return -1;
+  }
+
+  nlptk::JournalReader reader(FLAGS_journal);
+  if (!reader.Ready()) {
+    LOG(ERROR) << "Failed to open journal '" << FLAGS_journal << "'";
+    return -1;
+  }
+
+  // the journal is read up front, so reading it is not measured
+  vector<JournalEntry> entries;
+  vector<double> captured;
+  JournalEntry entry;
+  int ret = 0;
+  while ((ret = reader.Next(&entry)) > 0) {
+    if (entry.kind != JournalEntry::kWriter &&
+        entry.kind != JournalEntry::kCall) {
+      captured.push_back(1e-9 * entry.duration);
+    }
+
+    entries.push_back(std::move(entry));
+  }
+
+  if (ret < 0) {
+    return -1;
+  }
+
+  auto dir = FLAGS_logdir.empty() ? nlptk::BenchDir("replay") : FLAGS_logdir;
+  WriterStats stats;
+  vector<double> latency;
+  auto start = nlptk::Timestamp();
+  if (FLAGS_mode == "recorder") {
+    latency = ReplayRecorder(entries, maker, dir, &stats);
+  } else {
+    latency = ReplayWriters(&entries, maker, dir, &stats);
+  }
+
+  auto secs = nlptk::Timestamp() - start;
+  auto captured_secs = entries.empty() ? 0.0 : 1e-9 * entries.back().time;
+  printf("replayed          %zu %s calls in %.2f s, captured in %.2f s\n",
+         latency.size(), FLAGS_mode.c_str(), secs, captured_secs);
+  printf("throughput        %.0f events/s, %.2f MB/s\n",
+         stats.events / secs, stats.bytes / secs / (1 << 20));
+  printf("call latency      p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+         Quantile(&latency, 0.5) * 1e3, Quantile(&latency, 0.99) * 1e3,
+         Quantile(&latency, 1.0) * 1e3);
+  if (FLAGS_mode != "recorder") {
+    printf("captured latency  p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           Quantile(&captured, 0.5) * 1e3, Quantile(&captured, 0.99) * 1e3,
+           Quantile(&captured, 1.0) * 1e3);
+  }
+
+  printf("write latency     p50 %.3f ms, p99 %.3f ms\n",
+         stats.Latency(0.5) * 1e3, stats.Latency(0.99) * 1e3);
+
+  google::protobuf::ShutdownProtobufLibrary();
+  return 0;
+}
@@ -0,0 +1,183 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the encoding paths of record/ and utils/, from the
+// checksum of a record up to a Recorder call writing into tmpfs.
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench/bench_util.h"
+#include "benchmark/benchmark.h"
+#include "proto/summary.pb.h"
+#include "record/crc.h"
+#include "record/recorder.h"
+#include "record/summary.h"
+#include "utils/image.h"
+
+using nlptk::ImageMetadata;
+using nlptk::Recorder;
+
+using std::string;
+using std::vector;
+
+static void BM_CRC32c(benchmark::State& state) {
+  string data(state.range(0), 'x');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(nlptk::MaskedCRC32c(data.data(), data.size()));
+  }
+
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+// building and serializing a scalar event by the proto
+static void BM_Scalar(benchmark::State& state) {
+  string buf;
+  for (auto _ : state) {
+    tensorboard::Event event;
+    event.set_wall_time(1.0);
+    event.set_step(state.iterations());
+    event.set_allocated_summary(nlptk::Scalar("train/loss", 0.5f));
+    event.SerializeToString(&buf);
+    benchmark::DoNotOptimize(buf.data());
+  }
+}
+
+// the same event encoded by hand, as written for an interned tag
+static void BM_EncodeScalarEvent(benchmark::State& state) {
+  auto prefix = nlptk::ScalarEventPrefix("train/loss");
+  vector<char> buf(prefix.size() + nlptk::kScalarEventOverhead);
+  int64_t step = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(nlptk::EncodeScalarEvent(
+        prefix, 1.0, ++step, 0.5f, buf.data()));
+  }
+}
+
+static void BM_AddScalar(benchmark::State& state) {
+  Recorder recorder(nlptk::BenchDir("add_scalar"));
+  int64_t step = 0;
+  for (auto _ : state) {
+    recorder.AddScalar("train/loss", 0.5f, ++step);
+  }
+
+  recorder.Flush();
+  state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_AddScalarInterned(benchmark::State& state) {
+  Recorder recorder(nlptk::BenchDir("add_scalar_interned"));
+  auto tag = recorder.Intern("train/loss");
+  int64_t step = 0;
+  for (auto _ : state) {
+    recorder.AddScalar(tag, 0.5f, ++step);
+  }
+
+  recorder.Flush();
+  state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_Histogram(benchmark::State& state) {
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal;
+  vector<double> values(state.range(0));
+  for (auto& value : values) {
+    value = normal(rng);
+  }
+
+  for (auto _ : state) {
+    std::unique_ptr<tensorboard::Summary> summary(
+        nlptk::Histogram("weights", values));
+    benchmark::DoNotOptimize(summary.get());
+  }
+
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+// a grid of `range(0)` RGB images of 64x64, PNG encoded
+static void BM_Images(benchmark::State& state) {
+  const int kSize = 64;
+  vector<string> images(state.range(0));
+  for (size_t i = 0; i < images.size(); ++i) {
+    images[i].resize(kSize * kSize * 3);
+    for (size_t j = 0; j < images[i].size(); ++j) {
+      images[i][j] = static_cast<char>(i * 31 + j * 7);
+    }
+  }
+
+  for (auto _ : state) {
+    std::unique_ptr<tensorboard::Summary> summary(
+        nlptk::Images("samples", images, kSize, kSize, 3));
+    benchmark::DoNotOptimize(summary.get());
+  }
+
+  state.SetItemsProcessed(state.iterations() * images.size());
+}
+
+// PNG encoding alone of a square RGB image of side `range(0)`
+static void BM_PngEncode(benchmark::State& state) {
+  auto side = state.range(0);
+  string pixels(side * side * 3, '\0');
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    pixels[i] = static_cast<char>(i * 7);
+  }
+
+  string buf;
+  for (auto _ : state) {
+    buf.clear();
+    nlptk::Image::Write(pixels.data(), side, side, 3, &buf);
+    benchmark::DoNotOptimize(buf.data());
+  }
+
+  state.SetBytesProcessed(state.iterations() * pixels.size());
+}
+
+// writing the tensor and metadata TSV files of `range(0)` points of 128
+// dimensions, and syncing the projector config
+static void BM_AddEmbedding(benchmark::State& state) {
+  const size_t kDims = 128;
+  size_t points = state.range(0);
+  vector<float> mat(points * kDims);
+  for (size_t i = 0; i < mat.size(); ++i) {
+    mat[i] = 0.001f * i;
+  }
+
+  vector<string> metadata;
+  for (size_t i = 0; i < points; ++i) {
+    metadata.push_back(std::to_string(i));
+  }
+
+  Recorder recorder(nlptk::BenchDir("add_embedding"));
+  for (auto _ : state) {
+    recorder.AddEmbedding(mat, points, kDims, metadata, 0, "embedding");
+  }
+
+  state.SetBytesProcessed(state.iterations() * mat.size() * sizeof(float));
+}
+
+BENCHMARK(BM_CRC32c)->RangeMultiplier(8)->Range(64, 4 << 20);
+BENCHMARK(BM_Scalar);
+BENCHMARK(BM_EncodeScalarEvent);
+BENCHMARK(BM_AddScalar);
+BENCHMARK(BM_AddScalarInterned);
+BENCHMARK(BM_Histogram)->RangeMultiplier(10)->Range(1000, 100000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Images)->RangeMultiplier(4)->Range(1, 64)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PngEncode)->RangeMultiplier(4)->Range(64, 1024)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AddEmbedding)->RangeMultiplier(10)->Range(100, 100000)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,111 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Events per second of a ShardedWriter with one producer thread and one I/O
+// thread per shard, the throughput scales with the shards up to the number
+// of cores. The files are written to tmpfs so that the disk does not bound
+// it.
+//
+//   bazel run -c opt //bench:sharded_writer_bench
+
+#include <memory>
+#include <string>
+#include <thread>                 // NOLINT(build/c++11)
+#include <vector>
+
+#include "bench/bench_util.h"
+#include "benchmark/benchmark.h"
+#include "record/async_file_writer.h"
+#include "record/io_executor.h"
+#include "record/sharded_writer.h"
+#include "record/utils.h"
+
+using nlptk::AsyncFileWriter;
+using nlptk::BenchDir;
+using nlptk::IoExecutor;
+using nlptk::ShardedWriter;
+using nlptk::StringUtil;
+using nlptk::Writer;
+using nlptk::WriterOptions;
+
+using std::string;
+
+static const int kEventsPerThread = 20000;
+static const int kTagsPerThread = 16;
+
+// `threads` producers log scalars of their own tags into `writer`, then
+// wait for them to be written
+static void Produce(Writer* writer, int threads) {
+  std::vector<std::thread> producers;
+  for (int t = 0; t < threads; ++t) {
+    producers.emplace_back([writer, t] {
+      std::vector<string> tags;
+      for (int i = 0; i < kTagsPerThread; ++i) {
+        tags.push_back(StringUtil::Format("thread%d/tag%d", t, i));
+      }
+
+      for (int64_t step = 0; step < kEventsPerThread; ++step) {
+        tensorboard::Event event;
+        event.set_wall_time(1.0);
+        event.set_step(step);
+        auto value = event.mutable_summary()->add_value();
+        value->set_tag(tags[step % kTagsPerThread]);
+        value->set_simple_value(0.5f * step);
+        writer->Write(std::move(event));
+      }
+    });
+  }
+
+  for (auto& producer : producers) {
+    producer.join();
+  }
+
+  writer->Flush();
+}
+
+static void BM_ShardedWriter(benchmark::State& state) {
+  auto shards = state.range(0);
+  WriterOptions options;
+  options.durability.mode = nlptk::DurabilityPolicy::Mode::kNone;
+  // a thread of I/O per shard, the default executor has only two
+  IoExecutor executor(shards);
+  std::unique_ptr<Writer> writer(new ShardedWriter(
+      BenchDir("sharded") + "/events", shards, options, &executor));
+
+  for (auto _ : state) {
+    Produce(writer.get(), shards);
+  }
+
+  state.SetItemsProcessed(state.iterations() * shards * kEventsPerThread);
+}
+
+// the baseline of a single file and a single I/O thread
+static void BM_AsyncFileWriter(benchmark::State& state) {
+  auto threads = state.range(0);
+  WriterOptions options;
+  options.durability.mode = nlptk::DurabilityPolicy::Mode::kNone;
+  std::unique_ptr<Writer> writer(
+      new AsyncFileWriter(BenchDir("async") + "/events", options));
+
+  for (auto _ : state) {
+    Produce(writer.get(), threads);
+  }
+
+  state.SetItemsProcessed(state.iterations() * threads * kEventsPerThread);
+}
+
+BENCHMARK(BM_ShardedWriter)->RangeMultiplier(2)->Range(1, 16)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AsyncFileWriter)->RangeMultiplier(2)->Range(1, 16)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,99 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Events per second of every Writer into tmpfs, a batch of events and a
+// Flush() per iteration, for scalar events and for text events of
+// `range(0)` bytes. Every benchmark starts from an empty directory.
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "bench/bench_util.h"
+#include "benchmark/benchmark.h"
+#include "record/async_file_writer.h"
+#include "record/file_writer.h"
+#include "record/io_uring_file_writer.h"
+#include "record/mmap_file_writer.h"
+#include "record/sharded_writer.h"
+
+using nlptk::BenchDir;
+using nlptk::Writer;
+using nlptk::WriterOptions;
+
+using std::string;
+
+using Maker = std::function<Writer*(const string&)>;
+
+static const int kBatch = 1000;
+
+static WriterOptions Options() {
+  WriterOptions options;
+  options.durability.mode = nlptk::DurabilityPolicy::Mode::kNone;
+  return options;
+}
+
+static void BM_Writer(benchmark::State& state, const string& name,
+                      Maker maker) {
+  std::unique_ptr<Writer> writer(maker(BenchDir(name) + "/events"));
+  if (!writer->Ready()) {
+    state.SkipWithError("writer not ready");
+    return;
+  }
+
+  string text(state.range(0), 't');
+  int64_t step = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < kBatch; ++i) {
+      tensorboard::Event event;
+      event.set_wall_time(1.0);
+      event.set_step(++step);
+      auto value = event.mutable_summary()->add_value();
+      value->set_tag("train/loss");
+      if (text.empty()) {
+        value->set_simple_value(0.5f);
+      } else {
+        value->mutable_tensor()->add_string_val(text);
+      }
+
+      writer->Write(std::move(event));
+    }
+
+    writer->Flush();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatch);
+  state.SetBytesProcessed(state.iterations() * kBatch * text.size());
+}
+
+BENCHMARK_CAPTURE(BM_Writer, FileWriter, "file", [](const string& p) {
+  return new nlptk::FileWriter(p, Options());
+})->Arg(0)->Arg(1 << 10)->Arg(16 << 10);
+
+BENCHMARK_CAPTURE(BM_Writer, AsyncFileWriter, "async", [](const string& p) {
+  return new nlptk::AsyncFileWriter(p, Options());
+})->Arg(0)->Arg(1 << 10)->Arg(16 << 10)->UseRealTime();
+
+BENCHMARK_CAPTURE(BM_Writer, MmapFileWriter, "mmap", [](const string& p) {
+  return new nlptk::MmapFileWriter(p);
+})->Arg(0)->Arg(1 << 10)->Arg(16 << 10);
+
+BENCHMARK_CAPTURE(BM_Writer, IoUringFileWriter, "io_uring",
+                  [](const string& p) {
+  return new nlptk::IoUringFileWriter(p);
+})->Arg(0)->Arg(1 << 10)->Arg(16 << 10);
+
+BENCHMARK_CAPTURE(BM_Writer, ShardedWriter, "sharded", [](const string& p) {
+  return new nlptk::ShardedWriter(p, 4, Options());
+})->Arg(0)->Arg(1 << 10)->Arg(16 << 10)->UseRealTime();
@@ -0,0 +1,209 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Simulates a training loop logging through a Recorder and reports what the
+// logging adds to a step: the p50/p99 latency of the logging calls of a
+// step, the cpu time of the process, and the bytes of the event files.
+// The compute of a step is a sleep, so the cpu time is that of logging,
+// including the threads of the writers. E.g., to check a new release:
+//
+//   bazel run -c opt //examples:load_test -- --writer=async --threads=4
+
+#include <ftw.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>                 // NOLINT(build/c++11)
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>                 // NOLINT(build/c++11)
+#include <vector>
+
+#include "bench/bench_util.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "record/recorder.h"
+#include "record/utils.h"
+#include "utils/image.h"
+
+DEFINE_string(logdir, "runs/load_test", "directory of the event files");
+DEFINE_string(writer, "file", "file, async, mmap, io_uring or sharded");
+DEFINE_int32(shards, 4, "shards of the sharded writer");
+DEFINE_int32(threads, 1, "training threads, each logging its own tags");
+DEFINE_int32(steps, 1000, "steps of every thread");
+DEFINE_double(step_ms, 10.0, "simulated compute time of a step");
+DEFINE_int32(scalars, 10, "scalars logged every step");
+DEFINE_int32(histogram_values, 10000, "values of a histogram, 0 for none");
+DEFINE_int32(histogram_every, 10, "steps between two histograms, 0 for none");
+DEFINE_int32(image_size, 64, "side of the RGB images");
+DEFINE_int32(image_every, 100, "steps between two images, 0 for none");
+DEFINE_int32(staging, 0, "bytes staged per thread, see SetStaging()");
+
+using nlptk::Recorder;
+using nlptk::StringUtil;
+
+using std::string;
+using std::vector;
+
+static double CpuTime() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         1e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+static uint64_t disk_bytes = 0;
+
+// adds the bytes of the files under `path` to disk_bytes
+static int CountBytes(const char* path, const struct stat* st, int flag,
+                      struct FTW* ftw) {
+  if (flag == FTW_F) {
+    disk_bytes += st->st_blocks * 512;
+  }
+
+  return 0;
+}
+
+// the logging of `steps` steps of a thread, returns the latency of every
+// step in seconds
+static vector<double> Train(const Recorder& recorder, int thread,
+                            const string& image) {
+  vector<string> tags;
+  for (int i = 0; i < FLAGS_scalars; ++i) {
+    tags.push_back(StringUtil::Format("thread%d/scalar%d", thread, i));
+  }
+
+  auto histogram = StringUtil::Format("thread%d/weights", thread);
+  auto images = StringUtil::Format("thread%d/samples", thread);
+  std::mt19937_64 rng(thread);
+  std::normal_distribution<double> normal;
+  vector<double> values(FLAGS_histogram_values);
+  for (auto& value : values) {
+    value = normal(rng);
+  }
+
+  nlptk::ImageMetadata meta(FLAGS_image_size, FLAGS_image_size, 3);
+  auto compute = std::chrono::duration<double, std::milli>(FLAGS_step_ms);
+  vector<double> latency;
+  latency.reserve(FLAGS_steps);
+  for (int64_t step = 0; step < FLAGS_steps; ++step) {
+    std::this_thread::sleep_for(compute);
+
+    auto start = nlptk::Timestamp();
+    for (const auto& tag : tags) {
+      recorder.AddScalar(tag, normal(rng), step);
+    }
+
+    if (!values.empty() && FLAGS_histogram_every > 0 &&
+        step % FLAGS_histogram_every == 0) {
+      recorder.AddHistogram(histogram, values, step);
+    }
+
+    if (FLAGS_image_every > 0 && step % FLAGS_image_every == 0) {
+      recorder.AddImage(images, image, meta, step);
+    }
+
+    latency.push_back(nlptk::Timestamp() - start);
+  }
+
+  return latency;
+}
+
+int main(int argc, char* argv[]) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  auto maker = nlptk::WriterByName(FLAGS_writer, FLAGS_shards);
+  if (nullptr == maker) {
+    LOG(ERROR) << "Unknown writer '" << FLAGS_writer << "'";
+    return -1;
+  }
+
+  // the images are encoded once, the cost measured is that of writing them
+  string pixels(FLAGS_image_size * FLAGS_image_size * 3, '\0');
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    pixels[i] = static_cast<char>(i * 7);
+  }
+
+  string image;
+  nlptk::Image::Write(pixels.data(), FLAGS_image_size, FLAGS_image_size, 3,
+                      &image);
+
+  // the event files of former runs in the directory are not counted
+  nftw(FLAGS_logdir.c_str(), CountBytes, 16, FTW_PHYS);
+  auto former_bytes = disk_bytes;
+  disk_bytes = 0;
+
+  vector<vector<double>> latencies(FLAGS_threads);
+  double secs = 0.0;
+  double cpu = 0.0;
+  nlptk::WriterStats stats;
+  {
+    Recorder recorder(FLAGS_logdir, maker);
+    if (!recorder.Ready()) {
+      LOG(ERROR) << "Failed to initialize tensorboard recorder. Exit!";
+      return -1;
+    }
+
+    recorder.SetStaging(FLAGS_staging);
+    auto start = nlptk::Timestamp();
+    auto cpu_start = CpuTime();
+    vector<std::thread> threads;
+    for (int t = 0; t < FLAGS_threads; ++t) {
+      threads.emplace_back([&, t] {
+        latencies[t] = Train(recorder, t, image);
+      });
+    }
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    recorder.Flush();
+    secs = nlptk::Timestamp() - start;
+    cpu = CpuTime() - cpu_start;
+    stats = recorder.Stats();
+  }
+
+  vector<double> latency;
+  for (const auto& samples : latencies) {
+    latency.insert(latency.end(), samples.begin(), samples.end());
+  }
+
+  std::sort(latency.begin(), latency.end());
+  auto quantile = [&](double q) {
+    return latency.empty() ? 0.0 : latency[q * (latency.size() - 1)] * 1e3;
+  };
+
+  nftw(FLAGS_logdir.c_str(), CountBytes, 16, FTW_PHYS);
+
+  printf("writer            %s\n", FLAGS_writer.c_str());
+  printf("steps             %zu in %.2f s\n", latency.size(), secs);
+  printf("step latency      p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+         quantile(0.5), quantile(0.99), quantile(1.0));
+  printf("logging cpu       %.3f s, %.1f us per step\n", cpu,
+         latency.empty() ? 0.0 : cpu * 1e6 / latency.size());
+  printf("events            %llu, %llu dropped\n",
+         static_cast<unsigned long long>(stats.events),       // NOLINT
+         static_cast<unsigned long long>(stats.dropped));     // NOLINT
+  printf("write latency     p50 %.3f ms, p99 %.3f ms\n",
+         stats.Latency(0.5) * 1e3, stats.Latency(0.99) * 1e3);
+  printf("bytes on disk     %lld\n",
+         static_cast<long long>(disk_bytes - former_bytes));  // NOLINT
+
+  google::protobuf::ShutdownProtobufLibrary();
+  return 0;
+}
@@ -0,0 +1,187 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/aggregator.h"
+
+#include <functional>
+#include <utility>
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+static const size_t kInitialSlots = 16;
+
+void ScalarAggregator::Window::Add(float value, int64_t global_step,
+                                   double now) {
+  if (count == 0) {
+    min = max = value;
+    opened = now;
+  } else if (value < min) {
+    min = value;
+  } else if (value > max) {
+    max = value;
+  }
+
+  sum += value;
+  last = value;
+  ++count;
+  if (global_step >= 0) {
+    step = global_step;
+  }
+}
+
+bool ScalarAggregator::Window::Full(double now) const {
+  return (policy.window_steps > 0 && count >= policy.window_steps) ||
+         (policy.window_secs > 0.0 && now - opened >= policy.window_secs);
+}
+
+void ScalarAggregator::Window::Reset() {
+  count = 0;
+  sum = 0.0;
+  step = -1;
+}
+
+ScalarAggregator::Table::Table(size_t size)
+    : size(size), slots(new std::atomic<Window*>[size]) {
+  for (size_t i = 0; i < size; ++i) {
+    slots[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+ScalarAggregator::ScalarAggregator() {
+  tables_.emplace_back(new Table(kInitialSlots));
+  table_ = tables_.back().get();
+}
+
+void ScalarAggregator::SetPolicy(const string& tag,
+                                 const AggregationPolicy& policy) {
+  std::lock_guard<std::mutex> lock{lock_};
+  if (tag.empty()) {
+    default_ = policy;
+  } else {
+    policies_[tag] = policy;
+    // the tags with their own policy get their window right away, so the
+    // lookups of the other tags never need the lock without a default
+    Insert(tag, std::hash<string>()(tag));
+  }
+
+  auto enabled = default_.Enabled();
+  for (const auto& item : policies_) {
+    enabled = enabled || item.second.Enabled();
+  }
+
+  enabled_ = enabled;
+  inherit_ = default_.Enabled();
+
+  // open windows keep their scalars and close by the new policy
+  for (auto& window : windows_) {
+    std::lock_guard<std::mutex> window_lock{window.lock};
+    if (window.tag == tag) {
+      window.policy = policy;
+      window.inherited = false;
+    } else if (tag.empty() && window.inherited) {
+      window.policy = policy;
+    }
+  }
+}
+
+bool ScalarAggregator::Enabled() const {
+  return enabled_;
+}
+
+ScalarAggregator::Window* ScalarAggregator::Get(const string& tag) {
+  auto hash = std::hash<string>()(tag);
+  auto table = table_.load(std::memory_order_acquire);
+  auto window = Probe(table, tag, hash)->load(std::memory_order_acquire);
+  if (nullptr != window || !inherit_) {
+    return window;
+  }
+
+  std::lock_guard<std::mutex> lock{lock_};
+  return default_.Enabled() ? Insert(tag, hash) : nullptr;
+}
+
+ScalarAggregator::Window* ScalarAggregator::Find(const string& tag) {
+  auto window = Get(tag);
+  if (nullptr == window) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock{window->lock};
+  return window->policy.Enabled() ? window : nullptr;
+}
+
+vector<ScalarAggregator::Window*> ScalarAggregator::Pending() {
+  std::lock_guard<std::mutex> lock{lock_};
+  vector<Window*> windows;
+  for (auto& window : windows_) {
+    std::lock_guard<std::mutex> window_lock{window.lock};
+    if (window.count > 0) {
+      windows.push_back(&window);
+    }
+  }
+
+  return windows;
+}
+
+std::atomic<ScalarAggregator::Window*>* ScalarAggregator::Probe(
+    const Table* table, const string& tag, size_t hash) {
+  // linear probing, the number of slots is a power of 2
+  auto mask = table->size - 1;
+  for (auto i = hash & mask;; i = (i + 1) & mask) {
+    auto& slot = table->slots[i];
+    auto window = slot.load(std::memory_order_acquire);
+    if (nullptr == window || (window->hash == hash && window->tag == tag)) {
+      return &slot;
+    }
+  }
+}
+
+ScalarAggregator::Window* ScalarAggregator::Insert(const string& tag,
+                                                   size_t hash) {
+  auto table = table_.load(std::memory_order_relaxed);
+  auto slot = Probe(table, tag, hash);
+  auto window = slot->load(std::memory_order_relaxed);
+  if (nullptr != window) {
+    return window;
+  }
+
+  windows_.emplace_back();
+  window = &windows_.back();
+  window->tag = tag;
+  window->hash = hash;
+  auto iter = policies_.find(tag);
+  window->inherited = iter == policies_.end();
+  window->policy = window->inherited ? default_ : iter->second;
+
+  if (windows_.size() * 2 <= table->size) {
+    slot->store(window, std::memory_order_release);
+    return window;
+  }
+
+  // a grown table is filled before it is published
+  tables_.emplace_back(new Table(table->size * 2));
+  auto grown = tables_.back().get();
+  for (auto& item : windows_) {
+    Probe(grown, item.tag, item.hash)->store(&item,
+                                             std::memory_order_relaxed);
+  }
+
+  table_.store(grown, std::memory_order_release);
+  return window;
+}
+
+}  // namespace nlptk
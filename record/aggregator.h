@@ -0,0 +1,124 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_AGGREGATOR_H_
+#define RECORD_AGGREGATOR_H_
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nlptk {
+
+// Window of the scalars of a tag, one point is written per window instead
+// of one per call. A window closes after `window_steps` calls or
+// `window_secs` seconds, whichever comes first; with both 0 the scalars of
+// the tag are not aggregated.
+struct AggregationPolicy {
+  uint64_t      window_steps{0};
+  double        window_secs{0.0};
+  // besides the mean as `tag`, also write `tag/min`, `tag/max`, `tag/last`
+  // and `tag/count` of the window
+  bool          min{false};
+  bool          max{false};
+  bool          last{false};
+  bool          count{false};
+
+  bool Enabled() const {
+    return window_steps > 0 || window_secs > 0.0;
+  }
+};
+
+// Running statistics of the scalars of many tags, found through a flat
+// open-addressing table so a call costs a hash and a probe or two. Lookups
+// take no lock: the table is only inserted into under a lock, and a grown
+// table replaces the old one, which stays alive for the readers still
+// probing it. A tag gets a window once a policy applies to it, and the
+// windows never move, so callers may keep them. The statistics and the
+// policy of a window are guarded by its own lock.
+class ScalarAggregator {
+ public:
+  struct Window {
+    std::mutex          lock;
+    std::string         tag;
+    size_t              hash{0};
+    bool                inherited{true};   // follows the default policy
+    AggregationPolicy   policy;
+    uint64_t            count{0};
+    double              sum{0.0};
+    float               min{0.0f};
+    float               max{0.0f};
+    float               last{0.0f};
+    int64_t             step{-1};
+    double              opened{0.0};
+
+    void Add(float value, int64_t global_step, double now);
+
+    bool Full(double now) const;
+
+    void Reset();
+  };
+
+  ScalarAggregator();
+
+  // an empty tag sets the default policy of the tags without their own
+  void SetPolicy(const std::string& tag, const AggregationPolicy& policy);
+
+  // whether the scalars of any tag may be aggregated
+  bool Enabled() const;
+
+  // window of `tag`, nullptr if no policy ever applied to the tag, its
+  // policy may have been disabled since
+  Window* Get(const std::string& tag);
+
+  // window of `tag`, nullptr if its scalars are not aggregated
+  Window* Find(const std::string& tag);
+
+  // windows with scalars not written yet
+  std::vector<Window*> Pending();
+
+ private:
+  struct Table {
+    explicit Table(size_t size);
+
+    size_t                                    size;
+    std::unique_ptr<std::atomic<Window*>[]>   slots;
+  };
+
+  // the slot of `tag` in `table`, or the empty slot it would take
+  static std::atomic<Window*>* Probe(const Table* table,
+                                     const std::string& tag, size_t hash);
+
+  // adds a window for `tag` unless it has one, under lock_
+  Window* Insert(const std::string& tag, size_t hash);
+
+ private:
+  std::mutex                                            lock_;
+  std::deque<Window>                                    windows_;
+  std::vector<std::unique_ptr<Table>>                   tables_;
+  std::atomic<Table*>                                   table_{nullptr};
+  std::atomic<bool>                                     enabled_{false};
+  // whether the tags without their own policy are aggregated
+  std::atomic<bool>                                     inherit_{false};
+  AggregationPolicy                                     default_;
+  std::unordered_map<std::string, AggregationPolicy>    policies_;
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_AGGREGATOR_H_
@@ -0,0 +1,127 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/aggregator.h"
+
+#include <mutex>                  // NOLINT(build/c++11)
+#include <string>
+#include <thread>                 // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace nlptk {
+
+using std::string;
+
+TEST(ScalarAggregator, Window) {
+  ScalarAggregator aggregator;
+  EXPECT_FALSE(aggregator.Enabled());
+
+  AggregationPolicy policy;
+  policy.window_steps = 4;
+  aggregator.SetPolicy("loss", policy);
+  EXPECT_TRUE(aggregator.Enabled());
+  EXPECT_EQ(nullptr, aggregator.Find("accuracy"));
+  // the tags without a policy get no window
+  EXPECT_EQ(nullptr, aggregator.Get("accuracy"));
+
+  auto window = aggregator.Find("loss");
+  ASSERT_NE(nullptr, window);
+  const float values[] = {3.0f, 1.0f, 4.0f, 2.0f};
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_FALSE(window->Full(0.0));
+    window->Add(values[i], i, 0.0);
+  }
+
+  EXPECT_TRUE(window->Full(0.0));
+  EXPECT_EQ(4, window->count);
+  EXPECT_DOUBLE_EQ(10.0, window->sum);
+  EXPECT_EQ(1.0f, window->min);
+  EXPECT_EQ(4.0f, window->max);
+  EXPECT_EQ(2.0f, window->last);
+  EXPECT_EQ(3, window->step);
+  EXPECT_EQ(1, aggregator.Pending().size());
+
+  window->Reset();
+  EXPECT_TRUE(aggregator.Pending().empty());
+}
+
+TEST(ScalarAggregator, Grow) {
+  ScalarAggregator aggregator;
+  AggregationPolicy policy;
+  policy.window_secs = 60.0;
+  aggregator.SetPolicy("", policy);
+
+  auto first = aggregator.Find("tag0");
+  for (int i = 0; i < 1000; ++i) {
+    auto window = aggregator.Find("tag" + std::to_string(i));
+    ASSERT_NE(nullptr, window);
+    window->Add(i, i, 0.0);
+  }
+
+  // the windows do not move when the table grows
+  EXPECT_EQ(first, aggregator.Find("tag0"));
+
+  ASSERT_EQ(1000, aggregator.Pending().size());
+  for (int i = 0; i < 1000; ++i) {
+    auto window = aggregator.Find("tag" + std::to_string(i));
+    ASSERT_NE(nullptr, window);
+    EXPECT_EQ(1, window->count);
+    EXPECT_EQ(i, window->last);
+    EXPECT_FALSE(window->Full(59.0));
+    EXPECT_TRUE(window->Full(60.0));
+  }
+}
+
+TEST(ScalarAggregator, Threads) {
+  ScalarAggregator aggregator;
+  AggregationPolicy policy;
+  policy.window_steps = 1000000;
+  aggregator.SetPolicy("", policy);
+
+  // the threads insert their own tags while looking up the shared ones
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&aggregator, t] {
+      for (int i = 0; i < 500; ++i) {
+        for (auto tag : {"shared" + std::to_string(i % 10),
+                         "thread" + std::to_string(t) + "/" +
+                             std::to_string(i)}) {
+          auto window = aggregator.Find(tag);
+          ASSERT_NE(nullptr, window);
+          ASSERT_EQ(tag, window->tag);
+          std::lock_guard<std::mutex> lock{window->lock};
+          window->Add(1.0f, i, 0.0);
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto windows = aggregator.Pending();
+  ASSERT_EQ(10 + 4 * 500, windows.size());
+  uint64_t count = 0;
+  for (auto window : windows) {
+    count += window->count;
+  }
+
+  EXPECT_EQ(2 * 4 * 500, count);
+  EXPECT_EQ(200, aggregator.Find("shared0")->count);
+}
+
+}  // namespace nlptk
@@ -14,112 +14,333 @@
 
 #include "record/async_file_writer.h"
 
-#include <ctime>
-
-#include "glog/logging.h"
-#include "record/crc.h"
-#include "record/utils.h"
+#include <algorithm>
+#include <chrono>                 // NOLINT(build/c++11)
+#include <cstring>
+#include <utility>
 
 namespace nlptk {
 
 using std::string;
 
-AsyncFileWriter::AsyncFileWriter(const string& prefix, size_t flush, bool app)
-    : flush_secs_(flush) {
-  auto path = StringUtil::Format("%s.out.tfevents.%f.%s", prefix.c_str(),
-                                 Timestamp(), Env::HostName.c_str());
-  fout_.open(path, std::ios::out | std::ios::binary |
-                       (app ? std::ios::app : std::ios::trunc));
-  if (!fout_.is_open() || fout_.fail()) {
-    LOG(ERROR) << "Failed create record file '" << path << "'";
-    fout_.close();
-    stop_.store(true);
-  } else {
-    worker_ = std::thread(&AsyncFileWriter::AsyncFlush, this);
-  }
+static WriterOptions MakeOptions(size_t flush_secs, bool resume) {
+  WriterOptions options;
+  options.durability.max_latency_ms = flush_secs * 1000;
+  options.resume = resume;
+  return options;
 }
 
-AsyncFileWriter::~AsyncFileWriter() {
-  if (!(stop_)) {
-    stop_.store(true);
+// records from this size on go to the bulk lane whatever they hold
+static const size_t kBulkRecordSize = 64 * 1024;
+
+static bool IsBulk(const tensorboard::Event& event, size_t size) {
+  if (size >= kBulkRecordSize) {
+    return true;
+  }
 
-    if (fout_.is_open() && fout_.good()) {
-      fout_.close();
+  for (const auto& value : event.summary().value()) {
+    if (value.has_image() || value.has_audio()) {
+      return true;
     }
   }
 
-  if (worker_.joinable()) {
-    worker_.join();
+  return false;
+}
+
+// a batch goes to the bulk lane if any of its framed records would
+static bool IsBulk(const char* data, size_t size) {
+  size_t pos = 0;
+  while (pos + kRecordHeaderSize + kRecordFooterSize <= size) {
+    uint64_t len = 0;
+    memcpy(&len, data + pos, sizeof(len));
+    if (len >= kBulkRecordSize) {
+      return true;
+    }
+
+    pos += kRecordHeaderSize + len + kRecordFooterSize;
+  }
+
+  return false;
+}
+
+AsyncFileWriter::AsyncFileWriter(const string& prefix, size_t flush, bool app)
+    : AsyncFileWriter(prefix, MakeOptions(flush, app)) {
+}
+
+AsyncFileWriter::AsyncFileWriter(const string& prefix,
+                                 const WriterOptions& options,
+                                 IoExecutor* executor)
+    : file_(prefix, options),
+      executor_(executor != nullptr ? executor : IoExecutor::Default()) {
+  file_.SetStats(&stats_);
+  if (file_.Open(options.resume) < 0) {
+    stop_.store(true);
+  } else {
+    task_ = executor_->Register([this] { return AsyncFlush(); });
   }
 }
 
+AsyncFileWriter::~AsyncFileWriter() {
+  Close();
+}
+
 int AsyncFileWriter::Write(tensorboard::Event&& event) {
   if (!(stop_)) {
+    auto start = StatsCounters::Now();
     string buf;
     event.SerializeToString(&buf);
+    auto serialized = StatsCounters::Now();
+    stats_.Add(StatsCounters::kSerializeNanos, serialized - start);
 
-    uint64_t header = buf.size();
-    fout_.write(reinterpret_cast<const char*>(&header), sizeof(header));
-    auto crc =
-        MaskedCRC32c(reinterpret_cast<const char*>(&header), sizeof(header));
-    fout_.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    Pending pending;
+    AppendRecord(buf.data(), buf.size(), &pending.records);
+    pending.count = 1;
+    stats_.Add(StatsCounters::kChecksumNanos,
+               StatsCounters::Now() - serialized);
+    if (Enqueue(std::move(pending), IsBulk(event, buf.size())) < 0) {
+      return -1;
+    }
 
-    fout_.write(buf.data(), buf.size());
-    crc = MaskedCRC32c(buf.data(), buf.size());
-    fout_.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
     return buf.size();
   }
 
   return -1;
 }
 
+int AsyncFileWriter::WriteRecords(const char* data, size_t size,
+                                  size_t records) {
+  if (stop_ || size == 0) {
+    return -1;
+  }
+
+  Pending pending;
+  pending.records.assign(data, size);
+  pending.count = records;
+  if (Enqueue(std::move(pending), IsBulk(data, size)) < 0) {
+    return -1;
+  }
+
+  return size;
+}
+
+int AsyncFileWriter::WriteBlob(const string& head, Blob&& blob,
+                               const string& tail) {
+  if (stop_) {
+    return -1;
+  }
+
+  size_t size = head.size() + blob.size() + tail.size();
+  Pending pending;
+  pending.head = head;
+  pending.blob = std::move(blob);
+  pending.tail = tail;
+  if (Enqueue(std::move(pending), true) < 0) {
+    return -1;
+  }
+
+  return size;
+}
+
+void AsyncFileWriter::SetMemoryBudget(MemoryBudget* budget) {
+  std::lock_guard<std::mutex> lock{locker_};
+  memory_ = budget;
+}
+
 int AsyncFileWriter::Flush() {
-  if (!(stop_)) {
+  return Flush(false);
+}
+
+int AsyncFileWriter::Suspend() {
+  return Flush(true);
+}
+
+int AsyncFileWriter::Flush(bool suspend) {
+  if (stop_) {
+    return -1;
+  }
+
+  uint64_t target = 0;
+  {
+    std::lock_guard<std::mutex> lock{locker_};
+    target = enqueued_;
+    flush_requested_ = true;
+    suspend_requested_ = suspend_requested_ || suspend;
+  }
+
+  executor_->Notify(task_);
+  std::unique_lock<std::mutex> lock{locker_};
+  done_.wait(lock, [&] { return flushed_ >= target || finished_; });
+
+  // the round which wrote our records, or a later one, failed
+  return failed_ >= static_cast<int64_t>(target) ? -1 : 0;
+}
+
+int AsyncFileWriter::Enqueue(Pending&& pending, bool bulk) {
+  {
     std::lock_guard<std::mutex> lock{locker_};
-    if (fout_.is_open() && fout_.good()) {
-      fout_.flush();
+    if (finished_) {
+      stats_.Add(StatsCounters::kDropped, std::max<size_t>(pending.count, 1));
+      return -1;
+    }
+
+    pending.enqueued = StatsCounters::Now();
+    if (nullptr != memory_) {
+      pending.charged = pending.records.size() + pending.head.size() +
+                        pending.blob.size() + pending.tail.size();
+      memory_->Add(pending.charged);
+    }
+
+    if (bulk) {
+      bulk_.push_back(std::move(pending));
+    } else {
+      pending_.push_back(std::move(pending));
     }
+
+    ++enqueued_;
   }
 
+  executor_->Notify(task_);
   return 0;
 }
 
-int AsyncFileWriter::AsyncFlush() {
-  auto period = std::chrono::seconds(flush_secs_);
-  auto next_flush_time = std::chrono::high_resolution_clock::now() + period;
+EventFile::Clock::time_point AsyncFileWriter::AsyncFlush() {
+  std::unique_lock<std::mutex> lock{locker_};
+  if (finished_) {
+    return EventFile::Clock::time_point::max();
+  }
+
+  while (true) {
+    auto memory = memory_;
+    auto target = enqueued_;
+    bool stopping = stop_;
+    bool flush = stopping || flush_requested_;
+    bool suspend = suspend_requested_ && !stopping;
+    flush_requested_ = false;
+    suspend_requested_ = false;
 
-  while (!(stop_)) {
-    if (std::chrono::high_resolution_clock::now() < next_flush_time) {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      continue;
+    // the priority records arriving meanwhile are written between two bulk
+    // records, the bulk records of this round bound the loop
+    size_t bulk = bulk_.size();
+    do {
+      std::vector<Pending> records;
+      records.swap(pending_);
+      if (bulk > 0) {
+        records.push_back(std::move(bulk_.front()));
+        bulk_.pop_front();
+        --bulk;
+      }
+
+      lock.unlock();
+      bool failed = Append(&records, memory) < 0;
+      lock.lock();
+      write_failed_ = write_failed_ || failed;
+    } while (bulk > 0);
+
+    lock.unlock();
+    bool failed = file_.Commit(flush) < 0;
+    if (suspend) {
+      // records enqueued meanwhile reopen the file
+      failed = file_.Suspend() < 0 || failed;
     }
 
-    std::lock_guard<std::mutex> lock{locker_};
-    if (fout_.is_open() && fout_.good()) {
-      fout_.flush();
+    lock.lock();
+    write_failed_ = write_failed_ || failed;
+    if (flush) {
+      if (write_failed_) {
+        failed_ = target;
+      }
+
+      write_failed_ = false;
+      flushed_ = target;
+      done_.notify_all();
+    }
+
+    if (!stopping) {
+      // the file is only touched by this task, so its deadline is stable
+      return file_.Deadline();
     }
 
-    next_flush_time = std::chrono::high_resolution_clock::now() + period;
+    if (pending_.empty() && bulk_.empty()) {
+      break;
+    }
   }
 
-  return 0;
+  finished_ = true;
+  done_.notify_all();
+  lock.unlock();
+
+  file_.Close();
+  return EventFile::Clock::time_point::max();
+}
+
+int AsyncFileWriter::Append(std::vector<Pending>* records,
+                            MemoryBudget* memory) {
+  int ret = 0;
+  size_t charged = 0;
+  for (const auto& record : *records) {
+    if (file_.NeedRotate() && file_.Rotate() < 0) {
+      ret = -1;
+    }
+
+    if (record.count > 0) {
+      if (file_.Append(record.records.data(), record.records.size(),
+                       record.count, record.enqueued) < 0) {
+        ret = -1;
+      }
+    } else if (file_.AppendBlob(record.head, record.blob.data(),
+                                record.blob.size(), record.tail,
+                                record.enqueued) < 0) {
+      ret = -1;
+    }
+
+    charged += record.charged;
+  }
+
+  // the blobs are given back once written
+  records->clear();
+  if (charged > 0 && nullptr != memory) {
+    memory->Release(charged);
+  }
+
+  return ret;
 }
 
 int AsyncFileWriter::Close() {
   if (!(stop_)) {
-    stop_.store(true);
-    std::lock_guard<std::mutex> lock{locker_};
-    if (fout_.is_open() && fout_.good()) {
-      fout_.flush();
-      fout_.close();
+    {
+      std::lock_guard<std::mutex> lock{locker_};
+      stop_.store(true);
+    }
+
+    executor_->Notify(task_);
+    {
+      std::unique_lock<std::mutex> lock{locker_};
+      done_.wait(lock, [&] { return finished_; });
     }
+
+    executor_->Unregister(task_);
   }
 
   return 0;
 }
 
+uint64_t AsyncFileWriter::QueueDepth() const {
+  std::lock_guard<std::mutex> lock{locker_};
+  uint64_t depth = 0;
+  for (const auto& pending : pending_) {
+    depth += std::max<size_t>(pending.count, 1);
+  }
+
+  return depth + bulk_.size();
+}
+
 int AsyncFileWriter::Ready() const {
   return !(stop_);
 }
 
+int64_t AsyncFileWriter::LastStep(const string& tag) const {
+  // the resumed steps are fixed before the worker starts
+  return file_.LastStep(tag);
+}
+
 }  // namespace nlptk
@@ -16,39 +16,107 @@
 #define RECORD_ASYNC_FILE_WRITER_H_
 
 #include <atomic>
-#include <fstream>
+#include <condition_variable>     // NOLINT(build/c++11)
+#include <deque>
 #include <mutex>                  // NOLINT(build/c++11)
 #include <string>
-#include <thread>                 // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
 
+#include "record/budget.h"
+#include "record/event_file.h"
+#include "record/io_executor.h"
 #include "record/writer.h"
 
 namespace nlptk {
 
+// Frames records on the calling thread and leaves writing, flushing and
+// rotating the event file to an IoExecutor shared with other writers. The
+// writer's task runs when records arrive, Flush() is called or the
+// durability policy's next deadline expires.
+//
+// Records queue in two lanes: scalars, text and other small records in a
+// priority lane, images, audio and records of 64KB or more in a bulk lane.
+// A round writes the queued priority records between any two bulk records,
+// so a large blob delays a scalar by at most one record, and every record
+// is still written whole. Records keep their order within a lane.
 class AsyncFileWriter : public Writer {
  public:
   explicit AsyncFileWriter(const std::string& path_prefix,
                            size_t flush_secs = 120, bool resume = false);
 
+  // `executor` defaults to IoExecutor::Default() and must outlive the writer
+  AsyncFileWriter(const std::string& path_prefix,
+                  const WriterOptions& options,
+                  IoExecutor* executor = nullptr);
+
   ~AsyncFileWriter();
 
   int Write(tensorboard::Event&& event) override;
 
+  int WriteRecords(const char* data, size_t size, size_t records) override;
+
+  // the blob is held until the executor has written it
+  int WriteBlob(const std::string& head, Blob&& blob,
+                const std::string& tail) override;
+
+  void SetMemoryBudget(MemoryBudget* budget) override;
+
   int Flush() override;
 
   int Close() override;
 
   int Ready() const override;
 
+  int Suspend() override;
+
+  int64_t LastStep(const std::string& tag) const override;
+
  protected:
-  int AsyncFlush();
+  int Flush(bool suspend);
+
+  // framed records and their number, or the parts of a blob record
+  struct Pending {
+    std::string   records;
+    size_t        count{0};
+    std::string   head;
+    Blob          blob;
+    std::string   tail;
+    // bytes charged to the memory budget
+    size_t        charged{0};
+    // StatsCounters::Now() when queued
+    uint64_t      enqueued{0};
+  };
+
+  int Enqueue(Pending&& pending, bool bulk);
+
+  // writes the records, then gives back their blobs and memory, returns
+  // -1 if any of them failed
+  int Append(std::vector<Pending>* records, MemoryBudget* memory);
+
+  // a round of writing run by the executor, returns the next deadline
+  EventFile::Clock::time_point AsyncFlush();
+
+  uint64_t QueueDepth() const override;
 
  private:
-  std::atomic<bool>   stop_{false};
-  size_t              flush_secs_;
-  std::ofstream       fout_;
-  std::thread         worker_;
-  std::mutex          locker_{};
+  std::atomic<bool>         stop_{false};
+  EventFile                 file_;
+  std::vector<Pending>      pending_;
+  std::deque<Pending>       bulk_;
+  uint64_t                  enqueued_{0};
+  uint64_t                  flushed_{0};
+  bool                      write_failed_{false};
+  // target of the last flush round which failed to write or commit
+  int64_t                   failed_{-1};
+  bool                      flush_requested_{false};
+  bool                      suspend_requested_{false};
+  bool                      finished_{false};
+  IoExecutor*               executor_{nullptr};
+  MemoryBudget*             memory_{nullptr};
+  uint64_t                  task_{0};
+  mutable std::mutex        locker_{};
+  std::condition_variable   done_;
 };
 
 }  // namespace nlptk
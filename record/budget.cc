@@ -0,0 +1,209 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/budget.h"
+
+#include <chrono>                 // NOLINT(build/c++11)
+
+namespace nlptk {
+
+using std::string;
+
+void SummaryBudget::SetPolicy(SummaryType type, const BudgetPolicy& policy) {
+  auto& window = windows_[type];
+  window.policy = policy;
+  window.enabled = policy.min_interval_secs > 0.0 || policy.max_bytes > 0 ||
+                   policy.max_cpu_secs > 0.0;
+
+  uint8_t limits = window.enabled ? kLimited : 0;
+  if (policy.max_bytes > 0 || policy.max_cpu_secs > 0.0) {
+    limits |= kCharged;
+  }
+
+  if (policy.max_cpu_secs > 0.0) {
+    limits |= kTimed;
+  }
+
+  limits_[type] = limits;
+
+  auto enabled = false;
+  for (const auto& item : windows_) {
+    enabled = enabled || item.enabled;
+  }
+
+  enabled_ = enabled;
+}
+
+bool SummaryBudget::Enabled() const {
+  return enabled_;
+}
+
+bool SummaryBudget::Enabled(SummaryType type) const {
+  return limits_[type].load(std::memory_order_relaxed) & kLimited;
+}
+
+bool SummaryBudget::Charged(SummaryType type) const {
+  return limits_[type].load(std::memory_order_relaxed) & kCharged;
+}
+
+bool SummaryBudget::Timed(SummaryType type) const {
+  return limits_[type].load(std::memory_order_relaxed) & kTimed;
+}
+
+bool SummaryBudget::Admit(SummaryType type, const string& tag, size_t bytes,
+                          double now) {
+  auto& window = windows_[type];
+  if (!window.enabled) {
+    return true;
+  }
+
+  const auto& policy = window.policy;
+  TagState* state = nullptr;
+  if (policy.min_interval_secs > 0.0) {
+    state = &tags_[tag];
+    if (state->last >= 0 && now - state->last < policy.min_interval_secs) {
+      return Drop(&window, state);
+    }
+  }
+
+  if (now - window.start >= policy.window_secs) {
+    window.start = now;
+    window.bytes = 0;
+    window.cpu_secs = 0.0;
+  }
+
+  // a single call larger than the whole budget is still let through once
+  // per window, otherwise it could never be logged
+  if ((policy.max_bytes > 0 && window.bytes > 0 &&
+       window.bytes + bytes > policy.max_bytes) ||
+      (policy.max_cpu_secs > 0.0 && window.cpu_secs >= policy.max_cpu_secs)) {
+    return Drop(&window, state != nullptr ? state : &tags_[tag]);
+  }
+
+  if (state != nullptr) {
+    state->last = now;
+  }
+
+  return true;
+}
+
+void SummaryBudget::Charge(SummaryType type, size_t bytes, double cpu_secs) {
+  auto& window = windows_[type];
+  window.bytes += bytes;
+  window.cpu_secs += cpu_secs;
+}
+
+uint64_t SummaryBudget::Dropped(SummaryType type) const {
+  return windows_[type].dropped;
+}
+
+uint64_t SummaryBudget::Dropped(const string& tag) const {
+  auto iter = tags_.find(tag);
+  return iter == tags_.end() ? 0 : iter->second.dropped;
+}
+
+bool SummaryBudget::Drop(Window* window, TagState* state) {
+  ++window->dropped;
+  ++state->dropped;
+  return false;
+}
+
+void MemoryBudget::SetPolicy(const MemoryPolicy& policy) {
+  {
+    std::lock_guard<std::mutex> lock{lock_};
+    policy_ = policy;
+    enabled_ = policy.max_bytes > 0;
+  }
+
+  released_.notify_all();
+}
+
+bool MemoryBudget::Enabled() const {
+  return enabled_;
+}
+
+int MemoryBudget::Admit(SummaryType type, const string& tag, uint64_t bytes) {
+  if (!enabled_) {
+    return 1;
+  }
+
+  std::unique_lock<std::mutex> lock{lock_};
+  switch (policy_.mode) {
+    case MemoryPolicy::Mode::kBlock: {
+      ++waiters_;
+      auto fits = [&] { return !enabled_ || Fits(bytes, 1.0f); };
+      bool admitted = true;
+      if (policy_.block_secs > 0.0) {
+        admitted = released_.wait_for(
+            lock, std::chrono::duration<double>(policy_.block_secs), fits);
+      } else {
+        released_.wait(lock, fits);
+      }
+
+      --waiters_;
+      return admitted ? 1 : Drop(type, tag, -1);
+    }
+
+    case MemoryPolicy::Mode::kFailFast:
+      return Fits(bytes, 1.0f) ? 1 : Drop(type, tag, -1);
+
+    case MemoryPolicy::Mode::kDrop:
+      return Fits(bytes, policy_.drop_level[type]) ? 1 : Drop(type, tag, 0);
+  }
+
+  return 1;
+}
+
+void MemoryBudget::Add(uint64_t bytes) {
+  used_ += bytes;
+}
+
+void MemoryBudget::Release(uint64_t bytes) {
+  used_ -= bytes;
+  // taking the lock orders the wakeup after a waiter's check
+  if (waiters_ > 0) {
+    std::lock_guard<std::mutex> lock{lock_};
+    released_.notify_all();
+  }
+}
+
+uint64_t MemoryBudget::Used() const {
+  return used_;
+}
+
+uint64_t MemoryBudget::Dropped(SummaryType type) const {
+  std::lock_guard<std::mutex> lock{lock_};
+  return dropped_[type];
+}
+
+uint64_t MemoryBudget::Dropped(const string& tag) const {
+  std::lock_guard<std::mutex> lock{lock_};
+  auto iter = tags_.find(tag);
+  return iter == tags_.end() ? 0 : iter->second;
+}
+
+bool MemoryBudget::Fits(uint64_t bytes, float level) const {
+  // a summary larger than the whole budget still passes an empty queue,
+  // otherwise it could never be logged
+  uint64_t used = used_;
+  return used == 0 || used + bytes <= policy_.max_bytes * level;
+}
+
+int MemoryBudget::Drop(SummaryType type, const string& tag, int ret) {
+  ++dropped_[type];
+  ++tags_[tag];
+  return ret;
+}
+
+}  // namespace nlptk
@@ -0,0 +1,174 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_BUDGET_H_
+#define RECORD_BUDGET_H_
+
+#include <atomic>
+#include <condition_variable>     // NOLINT(build/c++11)
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <string>
+#include <unordered_map>
+
+namespace nlptk {
+
+enum SummaryType : int {
+  kScalarSummary = 0,
+  kHistogramSummary,
+  kImageSummary,
+  kAudioSummary,
+  kTextSummary,
+  kEmbeddingSummary,
+  kNumSummaryTypes,
+};
+
+// Budget of a summary type, the calls beyond it are dropped before any
+// encoding work is done. Zero means unlimited.
+struct BudgetPolicy {
+  // minimal interval between two calls of the same tag
+  double        min_interval_secs{0.0};
+  // bytes written and thread cpu time spent encoding per window
+  uint64_t      max_bytes{0};
+  double        max_cpu_secs{0.0};
+  double        window_secs{1.0};
+};
+
+class SummaryBudget {
+ public:
+  void SetPolicy(SummaryType type, const BudgetPolicy& policy);
+
+  bool Enabled() const;
+
+  // whether the calls of `type` are limited at all, charged with their
+  // cost and timed by the cpu clock, readable without any lock
+  bool Enabled(SummaryType type) const;
+
+  bool Charged(SummaryType type) const;
+
+  bool Timed(SummaryType type) const;
+
+  // Whether a call of `tag` expected to write about `bytes` is within the
+  // budget at `now`, a rejected call is counted as dropped.
+  bool Admit(SummaryType type, const std::string& tag, size_t bytes,
+             double now);
+
+  // charges an admitted call with what it actually cost
+  void Charge(SummaryType type, size_t bytes, double cpu_secs);
+
+  uint64_t Dropped(SummaryType type) const;
+
+  uint64_t Dropped(const std::string& tag) const;
+
+ private:
+  struct Window {
+    BudgetPolicy    policy;
+    bool            enabled{false};
+    double          start{0.0};
+    uint64_t        bytes{0};
+    double          cpu_secs{0.0};
+    uint64_t        dropped{0};
+  };
+
+  struct TagState {
+    double          last{-1.0};
+    uint64_t        dropped{0};
+  };
+
+  enum Limit : uint8_t {
+    kLimited = 1,
+    kCharged = 2,
+    kTimed = 4,
+  };
+
+  bool Drop(Window* window, TagState* state);
+
+ private:
+  std::atomic<bool>                             enabled_{false};
+  std::atomic<uint8_t>                          limits_[kNumSummaryTypes] = {};
+  Window                                        windows_[kNumSummaryTypes];
+  std::unordered_map<std::string, TagState>     tags_;
+};
+
+// What a Recorder does with a summary once the records its writers have
+// queued and not written yet exceed max_bytes, e.g., on a congested disk.
+struct MemoryPolicy {
+  enum class Mode : uint8_t {
+    kBlock,       // wait for the writers to catch up
+    kFailFast,    // reject the summary with -1
+    kDrop,        // drop the summary by its type, see drop_level
+  };
+
+  Mode          mode{Mode::kDrop};
+  // zero means unlimited
+  uint64_t      max_bytes{0};
+  // kBlock gives up and fails after waiting this long, zero waits forever
+  double        block_secs{0.0};
+  // kDrop drops a type once the queued bytes exceed this fraction of
+  // max_bytes, images, audio and embeddings go first, scalars never
+  float         drop_level[kNumSummaryTypes] = {
+      std::numeric_limits<float>::infinity(),   // scalar
+      0.75f,                                    // histogram
+      0.5f,                                     // image
+      0.5f,                                     // audio
+      0.75f,                                    // text
+      0.5f,                                     // embedding
+  };
+};
+
+// The bytes queued by all writers of a Recorder. Writers Add() what they
+// queue and Release() what they have written, the recorder asks Admit()
+// before it writes a summary.
+class MemoryBudget {
+ public:
+  void SetPolicy(const MemoryPolicy& policy);
+
+  bool Enabled() const;
+
+  // Waits, fails or drops by the policy when `bytes` more of `type` do not
+  // fit. Returns 1 if admitted, 0 if dropped and -1 if failed, both of the
+  // latter are counted as dropped.
+  int Admit(SummaryType type, const std::string& tag, uint64_t bytes);
+
+  void Add(uint64_t bytes);
+
+  void Release(uint64_t bytes);
+
+  uint64_t Used() const;
+
+  uint64_t Dropped(SummaryType type) const;
+
+  uint64_t Dropped(const std::string& tag) const;
+
+ private:
+  bool Fits(uint64_t bytes, float level) const;
+
+  int Drop(SummaryType type, const std::string& tag, int ret);
+
+ private:
+  mutable std::mutex                            lock_;
+  std::condition_variable                       released_;
+  MemoryPolicy                                  policy_;
+  std::atomic<bool>                             enabled_{false};
+  std::atomic<uint64_t>                         used_{0};
+  std::atomic<int>                              waiters_{0};
+  uint64_t                                      dropped_[kNumSummaryTypes]{};
+  std::unordered_map<std::string, uint64_t>     tags_;
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_BUDGET_H_
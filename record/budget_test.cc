@@ -0,0 +1,143 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/budget.h"
+
+#include <thread>                 // NOLINT(build/c++11)
+
+#include "gtest/gtest.h"
+
+namespace nlptk {
+
+TEST(SummaryBudget, MinInterval) {
+  SummaryBudget budget;
+  EXPECT_FALSE(budget.Enabled());
+
+  BudgetPolicy policy;
+  policy.min_interval_secs = 1.0;
+  budget.SetPolicy(kImageSummary, policy);
+  EXPECT_TRUE(budget.Enabled());
+  EXPECT_TRUE(budget.Enabled(kImageSummary));
+  EXPECT_FALSE(budget.Charged(kImageSummary));
+  EXPECT_FALSE(budget.Timed(kImageSummary));
+  // the other types are not limited by the budget of images
+  EXPECT_FALSE(budget.Enabled(kScalarSummary));
+
+  EXPECT_TRUE(budget.Admit(kImageSummary, "a", 100, 10.0));
+  EXPECT_FALSE(budget.Admit(kImageSummary, "a", 100, 10.5));
+  EXPECT_TRUE(budget.Admit(kImageSummary, "b", 100, 10.5));
+  EXPECT_TRUE(budget.Admit(kImageSummary, "a", 100, 11.0));
+  EXPECT_TRUE(budget.Admit(kScalarSummary, "a", 0, 11.0));
+
+  EXPECT_EQ(1, budget.Dropped(kImageSummary));
+  EXPECT_EQ(1, budget.Dropped("a"));
+  EXPECT_EQ(0, budget.Dropped("b"));
+}
+
+TEST(SummaryBudget, Bytes) {
+  SummaryBudget budget;
+  BudgetPolicy policy;
+  policy.max_bytes = 1000;
+  policy.window_secs = 1.0;
+  budget.SetPolicy(kAudioSummary, policy);
+  EXPECT_TRUE(budget.Charged(kAudioSummary));
+  EXPECT_FALSE(budget.Timed(kAudioSummary));
+
+  // a call larger than the budget passes once per window
+  EXPECT_TRUE(budget.Admit(kAudioSummary, "a", 2000, 0.0));
+  budget.Charge(kAudioSummary, 2000, 0.0);
+  EXPECT_FALSE(budget.Admit(kAudioSummary, "a", 10, 0.5));
+
+  EXPECT_TRUE(budget.Admit(kAudioSummary, "a", 600, 1.0));
+  budget.Charge(kAudioSummary, 600, 0.0);
+  EXPECT_TRUE(budget.Admit(kAudioSummary, "a", 400, 1.1));
+  budget.Charge(kAudioSummary, 400, 0.0);
+  EXPECT_FALSE(budget.Admit(kAudioSummary, "a", 1, 1.2));
+  EXPECT_EQ(2, budget.Dropped(kAudioSummary));
+}
+
+TEST(SummaryBudget, Cpu) {
+  SummaryBudget budget;
+  BudgetPolicy policy;
+  policy.max_cpu_secs = 0.01;
+  budget.SetPolicy(kHistogramSummary, policy);
+  EXPECT_TRUE(budget.Charged(kHistogramSummary));
+  EXPECT_TRUE(budget.Timed(kHistogramSummary));
+
+  EXPECT_TRUE(budget.Admit(kHistogramSummary, "h", 0, 0.0));
+  budget.Charge(kHistogramSummary, 100, 0.02);
+  EXPECT_FALSE(budget.Admit(kHistogramSummary, "h", 0, 0.1));
+  EXPECT_TRUE(budget.Admit(kHistogramSummary, "h", 0, 1.0));
+}
+
+TEST(MemoryBudget, Drop) {
+  MemoryBudget memory;
+  EXPECT_FALSE(memory.Enabled());
+  EXPECT_EQ(1, memory.Admit(kImageSummary, "img", 1 << 30));
+
+  MemoryPolicy policy;
+  policy.max_bytes = 1000;
+  memory.SetPolicy(policy);
+  EXPECT_TRUE(memory.Enabled());
+
+  // an empty queue takes anything once
+  EXPECT_EQ(1, memory.Admit(kImageSummary, "img", 2000));
+  memory.Add(400);
+  EXPECT_EQ(1, memory.Admit(kImageSummary, "img", 100));
+  EXPECT_EQ(0, memory.Admit(kImageSummary, "img", 101));
+  EXPECT_EQ(1, memory.Admit(kTextSummary, "txt", 300));
+  memory.Add(600);
+  EXPECT_EQ(0, memory.Admit(kHistogramSummary, "hist", 1));
+  EXPECT_EQ(1, memory.Admit(kScalarSummary, "loss", 1 << 20));
+  memory.Release(1000);
+  EXPECT_EQ(0, memory.Used());
+  EXPECT_EQ(1, memory.Admit(kHistogramSummary, "hist", 1));
+
+  EXPECT_EQ(1, memory.Dropped(kImageSummary));
+  EXPECT_EQ(1, memory.Dropped(kHistogramSummary));
+  EXPECT_EQ(0, memory.Dropped(kScalarSummary));
+  EXPECT_EQ(1, memory.Dropped("img"));
+  EXPECT_EQ(0, memory.Dropped("loss"));
+}
+
+TEST(MemoryBudget, FailFastAndBlock) {
+  MemoryBudget memory;
+  MemoryPolicy policy;
+  policy.max_bytes = 100;
+  policy.mode = MemoryPolicy::Mode::kFailFast;
+  memory.SetPolicy(policy);
+  memory.Add(100);
+  EXPECT_EQ(-1, memory.Admit(kScalarSummary, "loss", 1));
+  EXPECT_EQ(1, memory.Dropped("loss"));
+
+  policy.mode = MemoryPolicy::Mode::kBlock;
+  policy.block_secs = 0.01;
+  memory.SetPolicy(policy);
+  EXPECT_EQ(-1, memory.Admit(kScalarSummary, "loss", 1));
+
+  policy.block_secs = 0.0;
+  memory.SetPolicy(policy);
+  std::thread writer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    memory.Release(50);
+  });
+
+  EXPECT_EQ(1, memory.Admit(kImageSummary, "img", 50));
+  EXPECT_EQ(50, memory.Used());
+  writer.join();
+  EXPECT_EQ(2, memory.Dropped("loss"));
+  EXPECT_EQ(0, memory.Dropped("img"));
+}
+
+}  // namespace nlptk
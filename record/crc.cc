@@ -15,6 +15,12 @@
 #include "record/crc.h"
 
 #include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define NLPTK_HAS_SSE42_CRC 1
+#endif
 
 namespace nlptk {
 
@@ -86,8 +92,46 @@ static const uint32_t CRC_TABLE[] = {
     0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
 };
 
+#ifdef NLPTK_HAS_SSE42_CRC
+// the crc32 instruction of SSE 4.2 computes the same Castagnoli CRC as the
+// table, 8 bytes at a time
+__attribute__((target("sse4.2")))
+static uint32_t HardwareCRC32c(uint32_t crc, const char* buf, size_t len) {
+  uint64_t crc64 = crc;
+  for (; len >= 8; len -= 8, buf += 8) {
+    uint64_t v;
+    memcpy(&v, buf, sizeof(v));
+    crc64 = _mm_crc32_u64(crc64, v);
+  }
+
+  crc = static_cast<uint32_t>(crc64);
+  for (; len; --len, ++buf) {
+    crc = _mm_crc32_u8(crc, *buf);
+  }
+
+  return crc;
+}
+
+static bool DetectHardwareCRC() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+
+static const bool kHardwareCRC = DetectHardwareCRC();
+#endif  // NLPTK_HAS_SSE42_CRC
+
 uint32_t CRC32c(const char* buf, size_t len) {
-  uint32_t crc = _MASK;
+  return ExtendCRC32c(0, buf, len);
+}
+
+uint32_t ExtendCRC32c(uint32_t init, const char* buf, size_t len) {
+  uint32_t crc = init ^ _MASK;
+#ifdef NLPTK_HAS_SSE42_CRC
+  if (kHardwareCRC) {
+    return ~HardwareCRC32c(crc, buf, len);
+  }
+#endif
+
   for (; len; --len, ++buf) {
     crc = (CRC_TABLE[(crc ^ (*buf)) & 0xFF] ^ (crc >> 8));
   }
@@ -95,9 +139,12 @@ uint32_t CRC32c(const char* buf, size_t len) {
   return ~crc;
 }
 
-uint32_t MaskedCRC32c(const char* buf, size_t len) {
-  uint32_t crc = CRC32c(buf, len);
+uint32_t MaskCRC32c(uint32_t crc) {
   return ((crc >> 15) | (crc << 17)) + 0xA282EAD8;
 }
 
+uint32_t MaskedCRC32c(const char* buf, size_t len) {
+  return MaskCRC32c(CRC32c(buf, len));
+}
+
 }  // namespace nlptk
@@ -24,6 +24,12 @@ namespace nlptk {
 
 uint32_t CRC32c(const char* buf, size_t len);
 
+// CRC32c of the bytes summed up by `init` followed by `buf`, so a record
+// held in several buffers is checked without joining them.
+uint32_t ExtendCRC32c(uint32_t init, const char* buf, size_t len);
+
+uint32_t MaskCRC32c(uint32_t crc);
+
 uint32_t MaskedCRC32c(const char* buf, size_t len);
 
 }  // namespace nlptk
@@ -50,4 +50,15 @@ TEST(CRC, MaskedCRC32c) {
   EXPECT_EQ(0x15E88101, checksum);
 }
 
+TEST(CRC, ExtendCRC32c) {
+  string content = "qwassfaf121aba";
+  for (size_t i = 0; i <= content.size(); ++i) {
+    auto crc = ExtendCRC32c(CRC32c(content.data(), i), content.data() + i,
+                            content.size() - i);
+    EXPECT_EQ(CRC32c(content.data(), content.size()), crc);
+  }
+
+  EXPECT_EQ(0x5613858D, MaskCRC32c(CRC32c("121aba", 6)));
+}
+
 }  // namespace nlptk
@@ -0,0 +1,888 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/event_file.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+#include "glog/logging.h"
+#include "record/crc.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+// buffered bytes are written to the file once the buffer exceeds the size
+static const size_t kBufferSize = 64 * 1024;
+
+static const char kEventFileTag[] = ".out.tfevents.";
+static const char kIndexFileTag[] = ".out.tfindex.";
+static const char kIndexMagic[] = "TBIX";
+static const uint32_t kIndexVersion = 1;
+
+static int WriteFully(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    auto n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    data += n;
+    size -= n;
+  }
+
+  return 0;
+}
+
+static int WriteFullyV(int fd, struct iovec* iov, int iovcnt) {
+  while (iovcnt > 0) {
+    auto n = writev(fd, iov, iovcnt);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    for (; iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len; ++iov) {
+      n -= iov->iov_len;
+      --iovcnt;
+    }
+
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+      iov->iov_len -= n;
+    }
+  }
+
+  return 0;
+}
+
+void AppendRecord(const char* data, size_t size, string* buf) {
+  char header[kRecordHeaderSize];
+  uint64_t len = size;
+  memcpy(header, &len, sizeof(len));
+  uint32_t crc = MaskedCRC32c(header, sizeof(len));
+  memcpy(header + sizeof(len), &crc, sizeof(crc));
+
+  buf->append(header, sizeof(header));
+  buf->append(data, size);
+  crc = MaskedCRC32c(data, size);
+  buf->append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+}
+
+void FrameRecord(char* record, size_t size) {
+  uint64_t len = size;
+  memcpy(record, &len, sizeof(len));
+  uint32_t crc = MaskedCRC32c(record, sizeof(len));
+  memcpy(record + sizeof(len), &crc, sizeof(crc));
+  crc = MaskedCRC32c(record + kRecordHeaderSize, size);
+  memcpy(record + kRecordHeaderSize + size, &crc, sizeof(crc));
+}
+
+string EventFilePath(const string& prefix) {
+  return StringUtil::Format("%s%s%f.%s", prefix.c_str(), kEventFileTag,
+                            Timestamp(), Env::HostName.c_str());
+}
+
+vector<string> ListEventFiles(const string& prefix) {
+  auto pos = prefix.find_last_of('/');
+  auto dir = pos == string::npos ? string(".") : prefix.substr(0, pos);
+  auto name = pos == string::npos ? prefix : prefix.substr(pos + 1);
+  name.append(kEventFileTag);
+
+  vector<std::pair<double, string>> files;
+  DIR* dp = opendir(dir.c_str());
+  if (dp == nullptr) {
+    return {};
+  }
+
+  struct dirent* entry = nullptr;
+  while ((entry = readdir(dp)) != nullptr) {
+    if (strncmp(entry->d_name, name.c_str(), name.size()) != 0) {
+      continue;
+    }
+
+    // the timestamp embedded in the name orders the files
+    auto ts = std::strtod(entry->d_name + name.size(), nullptr);
+    files.emplace_back(ts, JoinPath(dir, entry->d_name));
+  }
+
+  closedir(dp);
+  std::sort(files.begin(), files.end());
+
+  vector<string> paths;
+  for (auto& item : files) {
+    paths.push_back(std::move(item.second));
+  }
+
+  return paths;
+}
+
+using Mode = DurabilityPolicy::Mode;
+using std::chrono::milliseconds;
+
+int64_t RecoverEventFile(const string& path, uint64_t* records,
+                         std::map<string, int64_t>* last_steps) {
+  EventReader reader(path);
+  if (!reader.Ready()) {
+    return -1;
+  }
+
+  EventMeta meta;
+  const char* data = nullptr;
+  size_t size = 0;
+  uint64_t count = 0;
+  while (reader.Next(&data, &size) > 0) {
+    ++count;
+    if (last_steps != nullptr &&
+        EventReader::Peek(data, size, &meta) >= 0) {
+      for (const auto& tag : meta.tags) {
+        (*last_steps)[tag] = meta.step;
+      }
+    }
+  }
+
+  if (records != nullptr) {
+    *records = count;
+  }
+
+  return reader.Offset();
+}
+
+string EventIndexPath(const string& event_path) {
+  auto pos = event_path.rfind(kEventFileTag);
+  if (pos == string::npos) {
+    return event_path + ".tfindex";
+  }
+
+  return event_path.substr(0, pos) + kIndexFileTag +
+         event_path.substr(pos + sizeof(kEventFileTag) - 1);
+}
+
+EventIndex::~EventIndex() {
+  Close();
+}
+
+int EventIndex::Open(const string& event_path, bool append) {
+  Close();
+
+  path_ = EventIndexPath(event_path);
+  auto flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+  fd_ = open(path_.c_str(), flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed create index file '" << path_ << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  // the tag ids of an appended index stay valid
+  if (append) {
+    return 0;
+  }
+
+  tag_ids_.clear();
+  blocks_.clear();
+  counts_.clear();
+  buffer_.assign(kIndexMagic, sizeof(kIndexMagic) - 1);
+  buffer_.append(reinterpret_cast<const char*>(&kIndexVersion),
+                 sizeof(kIndexVersion));
+  return 0;
+}
+
+void EventIndex::Add(uint64_t offset, const char* data, size_t size) {
+  size_t pos = 0;
+  while (pos + kRecordHeaderSize + kRecordFooterSize <= size) {
+    uint64_t len = 0;
+    memcpy(&len, data + pos, sizeof(len));
+    AddEvent(offset + pos, data + pos + kRecordHeaderSize, len);
+    pos += kRecordHeaderSize + len + kRecordFooterSize;
+  }
+}
+
+void EventIndex::AddEvent(uint64_t offset, const char* data, size_t size) {
+  // the head of a blob event is cut off in its payload, the tag and step
+  // in front of the cut are still indexed
+  if (EventReader::Peek(data, size, &meta_) < 0 && meta_.tags.empty()) {
+    return;
+  }
+
+  for (const auto& tag : meta_.tags) {
+    auto iter = tag_ids_.find(tag);
+    if (iter == tag_ids_.end()) {
+      uint32_t id = tag_ids_.size();
+      uint16_t tag_size = std::min<size_t>(tag.size(), UINT16_MAX);
+      string payload;
+      payload.append(reinterpret_cast<const char*>(&id), sizeof(id));
+      payload.append(reinterpret_cast<const char*>(&tag_size),
+                     sizeof(tag_size));
+      payload.append(tag.data(), tag_size);
+      AppendEntry(kIndexTag, payload);
+      iter = tag_ids_.emplace(tag, id).first;
+    }
+
+    auto& block = blocks_[iter->second];
+    block.append(reinterpret_cast<const char*>(&meta_.step),
+                 sizeof(meta_.step));
+    block.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    ++counts_[iter->second];
+  }
+}
+
+int EventIndex::Flush() {
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  for (const auto& item : blocks_) {
+    uint32_t count = counts_[item.first];
+    string payload;
+    payload.reserve(sizeof(item.first) + sizeof(count) + item.second.size());
+    payload.append(reinterpret_cast<const char*>(&item.first),
+                   sizeof(item.first));
+    payload.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    payload.append(item.second);
+    AppendEntry(kIndexBlock, payload);
+  }
+
+  blocks_.clear();
+  counts_.clear();
+  if (buffer_.empty()) {
+    return 0;
+  }
+
+  auto ret = WriteFully(fd_, buffer_.data(), buffer_.size());
+  if (ret < 0) {
+    LOG(ERROR) << "Failed to write index file '" << path_ << "', due to: "
+               << strerror(errno);
+  }
+
+  buffer_.clear();
+  return ret;
+}
+
+int EventIndex::Sync() {
+  if (Flush() < 0) {
+    return -1;
+  }
+
+  return fdatasync(fd_);
+}
+
+int EventIndex::Close() {
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  auto ret = Flush();
+  close(fd_);
+  fd_ = -1;
+  return ret;
+}
+
+bool EventIndex::IsOpen() const {
+  return fd_ >= 0;
+}
+
+void EventIndex::AppendEntry(uint8_t type, const string& payload) {
+  auto start = buffer_.size();
+  buffer_.push_back(static_cast<char>(type));
+  buffer_.append(payload);
+  uint32_t crc = MaskedCRC32c(buffer_.data() + start, buffer_.size() - start);
+  buffer_.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+}
+
+EventFile::EventFile(const string& prefix, const WriterOptions& options)
+    : prefix_(prefix), rotation_(options.rotation),
+      durability_(options.durability), indexed_(options.index) {
+}
+
+EventFile::~EventFile() {
+  Close();
+}
+
+int EventFile::Open(bool resume) {
+  if (fd_ >= 0) {
+    return 0;
+  }
+
+  if (resume) {
+    auto files = ListEventFiles(prefix_);
+    if (!files.empty()) {
+      return Resume(files.back());
+    }
+  }
+
+  // two files of the same writer must never share a name
+  do {
+    path_ = EventFilePath(prefix_);
+    fd_ = open(path_.c_str(),
+               O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC,
+               S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  } while (fd_ < 0 && errno == EEXIST);
+
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed create record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  bytes_ = 0;
+  records_ = 0;
+  unsynced_ = 0;
+  opened_ = Timestamp();
+  if (OpenIndex() < 0) {
+    return -1;
+  }
+
+  return WriteHeader();
+}
+
+int EventFile::Append(const char* data, size_t size, size_t records,
+                      uint64_t enqueued) {
+  if (suspended_ && Reopen() < 0) {
+    return -1;
+  }
+
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  Count(size, records, enqueued);
+
+  if (buffer_.empty()) {
+    buffered_since_ = Clock::now();
+  }
+
+  if (unsynced_ == 0) {
+    unsynced_since_ = Clock::now();
+  }
+
+  if (indexed_) {
+    index_.Add(bytes_, data, size);
+  }
+
+  buffer_.append(data, size);
+  bytes_ += size;
+  records_ += records;
+  unsynced_ += records;
+  if (buffer_.size() >= kBufferSize) {
+    return Flush();
+  }
+
+  return 0;
+}
+
+int EventFile::AppendBlob(const string& head, const char* data, size_t size,
+                          const string& tail, uint64_t enqueued) {
+  if (suspended_ && Reopen() < 0) {
+    return -1;
+  }
+
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  uint64_t start = nullptr != stats_ ? StatsCounters::Now() : 0;
+  uint64_t len = head.size() + size + tail.size();
+  char header[kRecordHeaderSize];
+  memcpy(header, &len, sizeof(len));
+  uint32_t crc = MaskedCRC32c(header, sizeof(len));
+  memcpy(header + sizeof(len), &crc, sizeof(crc));
+  crc = ExtendCRC32c(CRC32c(head.data(), head.size()), data, size);
+  crc = MaskCRC32c(ExtendCRC32c(crc, tail.data(), tail.size()));
+  if (nullptr != stats_) {
+    stats_->Add(StatsCounters::kChecksumNanos, StatsCounters::Now() - start);
+  }
+
+  auto total = kRecordHeaderSize + len + kRecordFooterSize;
+  Count(total, 1, enqueued);
+  if (unsynced_ == 0) {
+    unsynced_since_ = Clock::now();
+  }
+
+  if (indexed_) {
+    index_.AddEvent(bytes_, head.data(), head.size());
+  }
+
+  bytes_ += total;
+  records_ += 1;
+  unsynced_ += 1;
+  if (buffer_.size() + total < kBufferSize) {
+    if (buffer_.empty()) {
+      buffered_since_ = Clock::now();
+    }
+
+    buffer_.append(header, sizeof(header));
+    buffer_.append(head);
+    buffer_.append(data, size);
+    buffer_.append(tail);
+    buffer_.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    return 0;
+  }
+
+  // large payloads go from the caller's buffer to the file in one writev
+  // together with the buffered records
+  struct iovec iov[] = {
+      {&buffer_[0], buffer_.size()},
+      {header, sizeof(header)},
+      {const_cast<char*>(head.data()), head.size()},
+      {const_cast<char*>(data), size},
+      {const_cast<char*>(tail.data()), tail.size()},
+      {&crc, sizeof(crc)},
+  };
+
+  start = nullptr != stats_ ? StatsCounters::Now() : 0;
+  auto ret = WriteFullyV(fd_, iov, sizeof(iov) / sizeof(iov[0]));
+  buffer_.clear();
+  if (ret < 0) {
+    LOG(ERROR) << "Failed to write record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  Written(start, false);
+  return indexed_ ? index_.Flush() : 0;
+}
+
+int EventFile::Commit(bool force) {
+  if (suspended_) {
+    return 0;
+  }
+
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  // the clock is only read by the policies with deadlines
+  switch (durability_.mode) {
+    case Mode::kNone:
+      return force ? Flush() : 0;
+
+    case Mode::kBuffered:
+      if (force || Clock::now() >= Deadline()) {
+        return Flush();
+      }
+
+      return 0;
+
+    case Mode::kGroupCommit:
+      if (unsynced_ == 0) {
+        return force ? Flush() : 0;
+      }
+
+      if (force ||
+          (durability_.group_records == 0 && durability_.group_millis == 0) ||
+          (durability_.group_records > 0 &&
+           unsynced_ >= durability_.group_records) ||
+          Clock::now() >= Deadline()) {
+        return Sync();
+      }
+
+      return 0;
+
+    case Mode::kSync:
+      return Sync();
+  }
+
+  return 0;
+}
+
+EventFile::Clock::time_point EventFile::Deadline() const {
+  if (fd_ >= 0) {
+    if (durability_.mode == Mode::kBuffered && !buffer_.empty()) {
+      return buffered_since_ + milliseconds(durability_.max_latency_ms);
+    }
+
+    if (durability_.mode == Mode::kGroupCommit && unsynced_ > 0 &&
+        durability_.group_millis > 0) {
+      return unsynced_since_ + milliseconds(durability_.group_millis);
+    }
+  }
+
+  return Clock::time_point::max();
+}
+
+int EventFile::Flush() {
+  if (suspended_) {
+    return 0;
+  }
+
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  if (buffer_.empty()) {
+    return 0;
+  }
+
+  uint64_t start = nullptr != stats_ ? StatsCounters::Now() : 0;
+  if (WriteFully(fd_, buffer_.data(), buffer_.size()) < 0) {
+    LOG(ERROR) << "Failed to write record file '" << path_ << "', due to: "
+               << strerror(errno);
+    buffer_.clear();
+    return -1;
+  }
+
+  buffer_.clear();
+  Written(start, false);
+  return indexed_ ? index_.Flush() : 0;
+}
+
+int EventFile::Sync() {
+  if (suspended_) {
+    return 0;
+  }
+
+  if (Flush() < 0) {
+    return -1;
+  }
+
+  unsynced_ = 0;
+  uint64_t start = nullptr != stats_ ? StatsCounters::Now() : 0;
+  if (fdatasync(fd_) != 0 || (indexed_ && index_.Sync() != 0)) {
+    LOG(ERROR) << "Failed to sync record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  Written(start, true);
+  return 0;
+}
+
+void EventFile::SetStats(StatsCounters* stats) {
+  stats_ = stats;
+}
+
+void EventFile::Count(size_t bytes, size_t records, uint64_t enqueued) {
+  if (nullptr == stats_) {
+    return;
+  }
+
+  stats_->Add(StatsCounters::kEvents, records);
+  stats_->Add(StatsCounters::kBytes, bytes);
+  undurable_.emplace_back(enqueued > 0 ? enqueued : StatsCounters::Now(),
+                          records);
+}
+
+void EventFile::Written(uint64_t start, bool synced) {
+  if (nullptr == stats_) {
+    return;
+  }
+
+  auto now = StatsCounters::Now();
+  stats_->Add(StatsCounters::kWriteNanos, now - start);
+  if (!synced) {
+    stats_->Add(StatsCounters::kFlushes, 1);
+  }
+
+  // the records are durable once written under the policies which do not
+  // sync, and once synced under the others
+  bool syncing = durability_.mode == Mode::kGroupCommit ||
+                 durability_.mode == Mode::kSync;
+  if (synced == syncing) {
+    for (const auto& item : undurable_) {
+      stats_->AddLatency(now - item.first, item.second);
+    }
+
+    undurable_.clear();
+  }
+}
+
+int EventFile::Close() {
+  if (suspended_) {
+    suspended_ = false;
+    return 0;
+  }
+
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  auto ret = Commit(true);
+  if (close(fd_) != 0) {
+    LOG(ERROR) << "Failed to close record file '" << path_ << "', due to: "
+               << strerror(errno);
+    ret = -1;
+  }
+
+  fd_ = -1;
+  if (indexed_) {
+    index_.Close();
+  }
+
+  return ret;
+}
+
+bool EventFile::IsOpen() const {
+  return fd_ >= 0 || suspended_;
+}
+
+int EventFile::Suspend() {
+  if (fd_ < 0) {
+    return suspended_ ? 0 : -1;
+  }
+
+  auto ret = Close();
+  suspended_ = true;
+  return ret;
+}
+
+bool EventFile::Suspended() const {
+  return suspended_;
+}
+
+bool EventFile::NeedRotate() const {
+  if ((fd_ < 0 && !suspended_) || records_ == 0) {
+    return false;
+  }
+
+  return (rotation_.max_bytes > 0 && bytes_ >= rotation_.max_bytes) ||
+         (rotation_.max_records > 0 && records_ >= rotation_.max_records) ||
+         (rotation_.max_secs > 0 &&
+          Timestamp() - opened_ >= rotation_.max_secs);
+}
+
+int EventFile::Rotate() {
+  Close();
+  if (Open() < 0) {
+    return -1;
+  }
+
+  return EnforceRetention();
+}
+
+const string& EventFile::Path() const {
+  return path_;
+}
+
+int64_t EventFile::LastStep(const string& tag) const {
+  auto iter = last_steps_.find(tag);
+  return iter == last_steps_.end() ? -1 : iter->second;
+}
+
+int EventFile::Resume(const string& path) {
+  uint64_t records = 0;
+  auto valid = RecoverEventFile(path, &records, &last_steps_);
+  if (valid < 0) {
+    LOG(ERROR) << "Failed to recover record file '" << path << "'";
+    return -1;
+  }
+
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && st.st_size > valid) {
+    LOG(WARNING) << "Truncate torn tail of record file '" << path << "' from "
+                 << st.st_size << " to " << valid << " bytes";
+    if (truncate(path.c_str(), valid) != 0) {
+      LOG(ERROR) << "Failed to truncate record file '" << path
+                 << "', due to: " << strerror(errno);
+      return -1;
+    }
+  }
+
+  path_ = path;
+  fd_ = open(path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed to open record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  // the index of the resumed file is rebuilt from its intact records
+  if (OpenIndex() < 0) {
+    return -1;
+  }
+
+  if (indexed_) {
+    EventReader reader(path_);
+    const char* data = nullptr;
+    size_t size = 0;
+    for (auto offset = reader.Offset(); reader.Next(&data, &size) > 0;
+         offset = reader.Offset()) {
+      index_.AddEvent(offset, data, size);
+    }
+
+    index_.Flush();
+  }
+
+  bytes_ = valid;
+  records_ = records > 0 ? records - 1 : 0;
+  unsynced_ = 0;
+  opened_ = Timestamp();
+  LOG(INFO) << "Resumed record file '" << path_ << "' with " << records_
+            << " records";
+  return valid == 0 ? WriteHeader() : 0;
+}
+
+int EventFile::WriteHeader() {
+  tensorboard::Event event;
+  event.set_wall_time(Timestamp());
+  event.set_file_version("brain.Event:2");
+
+  string data, buf;
+  event.SerializeToString(&data);
+  AppendRecord(data.data(), data.size(), &buf);
+  buffer_.append(buf);
+  bytes_ += buf.size();
+  return Flush();
+}
+
+int EventFile::OpenIndex() {
+  return indexed_ ? index_.Open(path_) : 0;
+}
+
+int EventFile::Reopen() {
+  fd_ = open(path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed to reopen record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  suspended_ = false;
+  if (indexed_ && index_.Open(path_, true) < 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+// an event file counted by the retention of a run directory
+struct RunFile {
+  double      ts;
+  time_t      mtime;
+  std::string path;
+  // the directory, name and host of the writer, e.g., "run/events@host"
+  std::string writer;
+  // with the bytes of its index
+  uint64_t    size;
+};
+
+// the event files under `dir` and its subdirectories, returns their bytes
+static uint64_t ListRunFiles(const string& dir, vector<RunFile>* files) {
+  DIR* dp = opendir(dir.c_str());
+  if (dp == nullptr) {
+    LOG(ERROR) << "Failed to list directory '" << dir << "', due to: "
+               << strerror(errno);
+    return 0;
+  }
+
+  uint64_t total = 0;
+  struct dirent* entry = nullptr;
+  while ((entry = readdir(dp)) != nullptr) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+
+    struct stat st;
+    auto path = JoinPath(dir, entry->d_name);
+    if (lstat(path.c_str(), &st) != 0) {
+      continue;
+    }
+
+    // the sub-runs of AddScalars are subdirectories
+    if (S_ISDIR(st.st_mode)) {
+      total += ListRunFiles(path, files);
+      continue;
+    }
+
+    auto tag = strstr(entry->d_name, kEventFileTag);
+    if (tag == nullptr || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+
+    // "<name>.out.tfevents.<time>.<host>"
+    char* end = nullptr;
+    auto ts = std::strtod(tag + sizeof(kEventFileTag) - 1, &end);
+    auto host = *end == '.' ? end + 1 : end;
+    RunFile file{ts, st.st_mtime, path, "",
+                 static_cast<uint64_t>(st.st_size)};
+    file.writer = JoinPath(dir, string(entry->d_name, tag - entry->d_name));
+    file.writer.append("@").append(host);
+    if (stat(EventIndexPath(path).c_str(), &st) == 0) {
+      file.size += st.st_size;
+    }
+
+    total += file.size;
+    files->push_back(std::move(file));
+  }
+
+  closedir(dp);
+  return total;
+}
+
+int EventFile::EnforceRetention() {
+  if (rotation_.retention_bytes == 0) {
+    return 0;
+  }
+
+  // the event files of all the writers of the run, by their time
+  auto pos = prefix_.find_last_of('/');
+  auto dir = pos == string::npos ? string(".") : prefix_.substr(0, pos);
+  vector<RunFile> files;
+  auto total = ListRunFiles(dir, &files);
+  std::sort(files.begin(), files.end(),
+            [](const RunFile& a, const RunFile& b) { return a.ts < b.ts; });
+
+  // the newest file of every writer, this one included, may be written
+  std::map<string, string> newest;
+  for (const auto& file : files) {
+    newest[file.writer] = file.path;
+  }
+
+  // writers of other processes with the same name and host are told apart
+  // by time only, a file rotated by time is closed after max_secs
+  auto now = time(nullptr);
+  for (const auto& file : files) {
+    if (total <= rotation_.retention_bytes) {
+      break;
+    }
+
+    if (newest[file.writer] == file.path ||
+        (rotation_.max_secs > 0 &&
+         now - file.mtime < static_cast<time_t>(rotation_.max_secs))) {
+      continue;
+    }
+
+    if (unlink(file.path.c_str()) != 0) {
+      LOG(ERROR) << "Failed to remove record file '" << file.path
+                 << "', due to: " << strerror(errno);
+      continue;
+    }
+
+    unlink(EventIndexPath(file.path).c_str());
+    LOG(INFO) << "Removed record file '" << file.path << "'";
+    total -= file.size;
+  }
+
+  return 0;
+}
+
+}  // namespace nlptk
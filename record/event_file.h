@@ -0,0 +1,209 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_EVENT_FILE_H_
+#define RECORD_EVENT_FILE_H_
+
+#include <chrono>                 // NOLINT(build/c++11)
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "record/event_reader.h"
+#include "record/stats.h"
+#include "record/writer.h"
+
+namespace nlptk {
+
+// uint64 length, uint32 masked crc of length
+static const size_t kRecordHeaderSize = 12;
+// uint32 masked crc of data
+static const size_t kRecordFooterSize = 4;
+
+// Appends `data` framed as a tfrecord to `buf`.
+void AppendRecord(const char* data, size_t size, std::string* buf);
+
+// Frames the `size` bytes of data at `record + kRecordHeaderSize` in place,
+// i.e., fills in the header before and the footer behind them.
+void FrameRecord(char* record, size_t size);
+
+// Returns "<prefix>.out.tfevents.<timestamp>.<hostname>".
+std::string EventFilePath(const std::string& prefix);
+
+// Returns the existing event files of `prefix` sorted from oldest to newest.
+std::vector<std::string> ListEventFiles(const std::string& prefix);
+
+// Scans `path` from the start and returns the end offset of the last intact
+// record, everything behind it is a torn or corrupted tail. The number of
+// intact records and the last step of every tag are reported if requested.
+int64_t RecoverEventFile(const std::string& path, uint64_t* records = nullptr,
+                         std::map<std::string, int64_t>* last_steps = nullptr);
+
+// Returns the path of the sidecar index of an event file, the name keeps
+// "tfevents" out so that TensorBoard never mistakes it for events.
+std::string EventIndexPath(const std::string& event_path);
+
+// The sidecar index of an event file maps every tag to the steps and file
+// offsets of its records. It starts with "TBIX" and a uint32 version and
+// continues with entries of a type byte, a payload and the masked crc32c
+// of both:
+//   kIndexTag:    uint32 tag id, uint16 size, tag
+//   kIndexBlock:  uint32 tag id, uint32 count, count * (int64 step,
+//                 uint64 offset)
+// The index is append-only; blocks are written once the records they point
+// at have been written, so a reader never sees offsets of missing records.
+class EventIndex {
+ public:
+  enum : uint8_t {
+    kIndexTag = 1,
+    kIndexBlock = 2,
+  };
+
+  ~EventIndex();
+
+  // `append` continues the index of a file suspended by this process
+  int Open(const std::string& event_path, bool append = false);
+
+  // indexes the framed records `data` starting at file `offset`
+  void Add(uint64_t offset, const char* data, size_t size);
+
+  // indexes the serialized event of the record at file `offset`
+  void AddEvent(uint64_t offset, const char* data, size_t size);
+
+  int Flush();
+
+  int Sync();
+
+  int Close();
+
+  bool IsOpen() const;
+
+ private:
+  void AppendEntry(uint8_t type, const std::string& payload);
+
+  std::string                                 path_;
+  int                                         fd_{-1};
+  std::string                                 buffer_;
+  std::unordered_map<std::string, uint32_t>   tag_ids_;
+  std::map<uint32_t, std::string>             blocks_;
+  std::map<uint32_t, uint32_t>                counts_;
+  EventMeta                                   meta_;
+};
+
+// An append-only tfevents file owned by a single writer. It buffers framed
+// records, writes the "brain.Event:2" header into every new file, flushes
+// and syncs as the durability policy asks for and switches to a new file
+// when the rotation policy asks for it. With WriterOptions::index the
+// records are also indexed into a sidecar EventIndex.
+class EventFile {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  EventFile(const std::string& prefix, const WriterOptions& options);
+
+  ~EventFile();
+
+  // With `resume` the latest existing event file of the prefix is reopened
+  // for appending after its torn tail has been truncated.
+  int Open(bool resume = false);
+
+  // `data` holds `records` framed records, `enqueued` is when they were
+  // handed to the writer in StatsCounters::Now() nanoseconds, zero for now
+  int Append(const char* data, size_t size, size_t records = 1,
+             uint64_t enqueued = 0);
+
+  // Appends a record of the serialized event `head`, `data` and `tail`.
+  // Large payloads are written from `data` directly instead of being
+  // copied into the buffer.
+  int AppendBlob(const std::string& head, const char* data, size_t size,
+                 const std::string& tail, uint64_t enqueued = 0);
+
+  // counts the records, bytes, flushes, write time and latency into `stats`
+  void SetStats(StatsCounters* stats);
+
+  // Applies the durability policy after a batch of appends, `force` flushes
+  // (and syncs for syncing policies) regardless of the thresholds.
+  int Commit(bool force = false);
+
+  // The time the next Commit() is due, Clock::time_point::max() if nothing
+  // is pending.
+  Clock::time_point Deadline() const;
+
+  int Flush();
+
+  int Sync();
+
+  int Close();
+
+  // open or suspended
+  bool IsOpen() const;
+
+  // Closes the descriptors of an idle file to save them, the next Append()
+  // reopens the file for appending.
+  int Suspend();
+
+  bool Suspended() const;
+
+  bool NeedRotate() const;
+
+  int Rotate();
+
+  const std::string& Path() const;
+
+  // last step of `tag` in the resumed file, -1 if unknown
+  int64_t LastStep(const std::string& tag) const;
+
+ protected:
+  int Resume(const std::string& path);
+
+  int WriteHeader();
+
+  int EnforceRetention();
+
+  int OpenIndex();
+
+  int Reopen();
+
+  void Count(size_t bytes, size_t records, uint64_t enqueued);
+
+  // a write or sync started at `start` has finished
+  void Written(uint64_t start, bool synced);
+
+ private:
+  std::string       prefix_;
+  RotationPolicy    rotation_;
+  DurabilityPolicy  durability_;
+  std::string       path_;
+  int               fd_{-1};
+  std::string       buffer_;
+  uint64_t          bytes_{0};
+  uint64_t          records_{0};
+  double            opened_{0.0};
+  uint64_t          unsynced_{0};
+  Clock::time_point buffered_since_;
+  Clock::time_point unsynced_since_;
+  std::map<std::string, int64_t>  last_steps_;
+  bool              indexed_{false};
+  EventIndex        index_;
+  bool              suspended_{false};
+  StatsCounters*    stats_{nullptr};
+  // enqueue times and numbers of the records not durable yet
+  std::vector<std::pair<uint64_t, size_t>>  undurable_;
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_EVENT_FILE_H_
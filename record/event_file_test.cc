@@ -0,0 +1,290 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/event_file.h"
+
+#include <sys/stat.h>
+
+#include <chrono>                 // NOLINT(build/c++11)
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>                 // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "record/async_file_writer.h"
+#include "record/event_reader.h"
+#include "record/file_writer.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+static tensorboard::Event MakeEvent(int64_t step) {
+  tensorboard::Event event;
+  event.set_wall_time(Timestamp());
+  event.set_step(step);
+  auto v = event.mutable_summary()->add_value();
+  v->set_tag("loss");
+  v->set_simple_value(0.1 * step);
+  return event;
+}
+
+static int64_t FileSize(const string& prefix) {
+  auto files = ListEventFiles(prefix);
+  struct stat st;
+  if (files.empty() || stat(files.back().c_str(), &st) != 0) {
+    return -1;
+  }
+
+  return st.st_size;
+}
+
+TEST(EventFile, AppendRecord) {
+  string data = "121aba";
+  string buf;
+  AppendRecord(data.data(), data.size(), &buf);
+  ASSERT_EQ(kRecordHeaderSize + data.size() + kRecordFooterSize, buf.size());
+
+  uint64_t len = 0;
+  memcpy(&len, buf.data(), sizeof(len));
+  EXPECT_EQ(data.size(), len);
+  EXPECT_EQ(data, buf.substr(kRecordHeaderSize, data.size()));
+
+  uint32_t crc = 0;
+  memcpy(&crc, buf.data() + kRecordHeaderSize + data.size(), sizeof(crc));
+  EXPECT_EQ(0x5613858D, crc);
+}
+
+TEST(EventFile, RotateByRecords) {
+  ASSERT_EQ(0, MakeDirs("runs/rotate_sync"));
+  WriterOptions options;
+  options.rotation.max_records = 10;
+  FileWriter writer("runs/rotate_sync/events", options);
+  ASSERT_TRUE(writer.Ready());
+
+  for (int64_t i = 0; i < 35; ++i) {
+    EXPECT_LT(0, writer.Write(MakeEvent(i)));
+  }
+
+  writer.Close();
+  EXPECT_EQ(4, ListEventFiles("runs/rotate_sync/events").size());
+}
+
+TEST(EventFile, RotateWithRetention) {
+  ASSERT_EQ(0, MakeDirs("runs/rotate_async"));
+  WriterOptions options;
+  options.rotation.max_bytes = 1024;
+
+  // a former writer in the directory and one of a sub-run left a few files
+  ASSERT_EQ(0, MakeDirs("runs/rotate_async/sub"));
+  for (auto prefix : {"runs/rotate_async/other", "runs/rotate_async/sub/x"}) {
+    FileWriter other(prefix, options);
+    ASSERT_TRUE(other.Ready());
+    for (int64_t i = 0; i < 200; ++i) {
+      EXPECT_LT(0, other.Write(MakeEvent(i)));
+    }
+  }
+
+  auto others = ListEventFiles("runs/rotate_async/other");
+  ASSERT_LT(2, others.size());
+  auto subs = ListEventFiles("runs/rotate_async/sub/x");
+  ASSERT_LT(2, subs.size());
+
+  // the oldest file, of a writer of the same name on another host
+  string remote = "runs/rotate_async/events.out.tfevents.1.000000.remote";
+  std::ofstream(remote) << string(100, 'r');
+
+  options.rotation.retention_bytes = 4096;
+  AsyncFileWriter writer("runs/rotate_async/events", options);
+  ASSERT_TRUE(writer.Ready());
+
+  for (int64_t i = 0; i < 1000; ++i) {
+    EXPECT_LT(0, writer.Write(MakeEvent(i)));
+  }
+
+  writer.Close();
+  auto files = ListEventFiles("runs/rotate_async/events");
+  EXPECT_LT(2, files.size());
+  EXPECT_EQ(remote, files[0]);
+
+  // the files of the run count, the newest of every writer is kept
+  EXPECT_EQ(vector<string>({others.back()}),
+            ListEventFiles("runs/rotate_async/other"));
+  EXPECT_EQ(vector<string>({subs.back()}),
+            ListEventFiles("runs/rotate_async/sub/x"));
+  files.push_back(others.back());
+  files.push_back(subs.back());
+  uint64_t total = 0;
+  for (const auto& path : files) {
+    struct stat st;
+    ASSERT_EQ(0, stat(path.c_str(), &st));
+    total += st.st_size;
+  }
+
+  // the retention is enforced right after a rotation
+  EXPECT_GE(4096 + 1024 + 64, total);
+}
+
+TEST(EventFile, DurabilityNone) {
+  ASSERT_EQ(0, MakeDirs("runs/durability_none"));
+  WriterOptions options;
+  options.durability.mode = DurabilityPolicy::Mode::kNone;
+  FileWriter writer("runs/durability_none/events", options);
+  ASSERT_TRUE(writer.Ready());
+
+  auto size = FileSize("runs/durability_none/events");
+  ASSERT_LT(0, size);
+  for (int64_t i = 0; i < 3; ++i) {
+    EXPECT_LT(0, writer.Write(MakeEvent(i)));
+  }
+
+  EXPECT_EQ(size, FileSize("runs/durability_none/events"));
+  EXPECT_EQ(0, writer.Flush());
+  EXPECT_LT(size, FileSize("runs/durability_none/events"));
+}
+
+TEST(EventFile, DurabilityGroupCommit) {
+  ASSERT_EQ(0, MakeDirs("runs/durability_group"));
+  WriterOptions options;
+  options.durability.mode = DurabilityPolicy::Mode::kGroupCommit;
+  options.durability.group_records = 5;
+  FileWriter writer("runs/durability_group/events", options);
+  ASSERT_TRUE(writer.Ready());
+
+  auto size = FileSize("runs/durability_group/events");
+  for (int64_t i = 0; i < 4; ++i) {
+    EXPECT_LT(0, writer.Write(MakeEvent(i)));
+  }
+
+  EXPECT_EQ(size, FileSize("runs/durability_group/events"));
+  EXPECT_LT(0, writer.Write(MakeEvent(4)));
+  EXPECT_LT(size, FileSize("runs/durability_group/events"));
+}
+
+TEST(EventFile, DurabilityLatencyBound) {
+  ASSERT_EQ(0, MakeDirs("runs/durability_latency"));
+  WriterOptions options;
+  options.durability.max_latency_ms = 20;
+  AsyncFileWriter writer("runs/durability_latency/events", options);
+  ASSERT_TRUE(writer.Ready());
+
+  auto size = FileSize("runs/durability_latency/events");
+  EXPECT_LT(0, writer.Write(MakeEvent(0)));
+
+  // no Flush(), the worker wakes up at the latency deadline by itself
+  for (int i = 0; i < 100; ++i) {
+    if (FileSize("runs/durability_latency/events") > size) {
+      break;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  EXPECT_LT(size, FileSize("runs/durability_latency/events"));
+}
+
+TEST(EventFile, ResumeTornFile) {
+  ASSERT_EQ(0, MakeDirs("runs/resume"));
+  {
+    FileWriter writer("runs/resume/events");
+    for (int64_t i = 0; i < 10; ++i) {
+      EXPECT_LT(0, writer.Write(MakeEvent(i)));
+    }
+  }
+
+  auto files = ListEventFiles("runs/resume/events");
+  ASSERT_EQ(1, files.size());
+  auto valid = FileSize("runs/resume/events");
+
+  // a record torn by a crash in the middle of its payload
+  string record;
+  auto event = MakeEvent(10).SerializeAsString();
+  AppendRecord(event.data(), event.size(), &record);
+  {
+    std::ofstream fout(files[0], std::ios::binary | std::ios::app);
+    fout.write(record.data(), record.size() / 2);
+  }
+
+  ASSERT_LT(valid, FileSize("runs/resume/events"));
+  EXPECT_EQ(valid, RecoverEventFile(files[0]));
+
+  FileWriter writer("runs/resume/events", true);
+  ASSERT_TRUE(writer.Ready());
+  EXPECT_EQ(valid, FileSize("runs/resume/events"));
+  EXPECT_EQ(9, writer.LastStep("loss"));
+  EXPECT_EQ(-1, writer.LastStep("accuracy"));
+
+  for (int64_t i = 10; i < 20; ++i) {
+    EXPECT_LT(0, writer.Write(MakeEvent(i)));
+  }
+
+  writer.Close();
+  ASSERT_EQ(files, ListEventFiles("runs/resume/events"));
+
+  EventReader reader(files[0]);
+  tensorboard::Event parsed;
+  ASSERT_EQ(1, reader.Next(&parsed));
+  EXPECT_EQ("brain.Event:2", parsed.file_version());
+  for (int64_t i = 0; i < 20; ++i) {
+    ASSERT_EQ(1, reader.Next(&parsed));
+    EXPECT_EQ(i, parsed.step());
+  }
+
+  EXPECT_EQ(0, reader.Next(&parsed));
+}
+
+TEST(EventFile, Suspend) {
+  ASSERT_EQ(0, MakeDirs("runs/suspend"));
+  WriterOptions options;
+  options.index = true;
+  for (int async = 0; async < 2; ++async) {
+    auto prefix = StringUtil::Format("runs/suspend/%d", async);
+    {
+      std::unique_ptr<Writer> writer;
+      if (async) {
+        writer.reset(new AsyncFileWriter(prefix, options));
+      } else {
+        writer.reset(new FileWriter(prefix, options));
+      }
+
+      for (int64_t i = 0; i < 30; ++i) {
+        EXPECT_LT(0, writer->Write(MakeEvent(i)));
+        if (i % 10 == 9) {
+          EXPECT_EQ(0, writer->Suspend());
+          EXPECT_TRUE(writer->Ready());
+        }
+      }
+    }
+
+    auto files = ListEventFiles(prefix);
+    ASSERT_EQ(1, files.size());
+
+    EventReader reader(files[0]);
+    ASSERT_EQ(1, reader.LoadIndex());
+    ASSERT_EQ(30, reader.Lookup("loss")->size());
+    tensorboard::Event parsed;
+    for (int64_t i = 0; i < 30; ++i) {
+      ASSERT_EQ(1, reader.Next("loss", &parsed));
+      EXPECT_EQ(i, parsed.step());
+    }
+  }
+}
+
+}  // namespace nlptk
@@ -0,0 +1,430 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/event_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>                 // NOLINT(build/c++11)
+
+#include "glog/logging.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "record/crc.h"
+#include "record/event_file.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+// field numbers of Event, Summary and Summary.Value
+static const int kEventWallTime = 1;
+static const int kEventStep = 2;
+static const int kEventSummary = 5;
+static const int kSummaryValue = 1;
+static const int kValueTag = 1;
+
+// Calls `fn(data, size)` for the tag of every summary value of the event.
+template <class Fn>
+static int ForEachTag(CodedInputStream* input, EventMeta* meta, Fn fn) {
+  uint32_t tag = 0;
+  while ((tag = input->ReadTag()) != 0) {
+    auto field = WireFormatLite::GetTagFieldNumber(tag);
+    auto type = WireFormatLite::GetTagWireType(tag);
+    if (field == kEventWallTime && type == WireFormatLite::WIRETYPE_FIXED64) {
+      uint64_t bits = 0;
+      if (!input->ReadLittleEndian64(&bits)) {
+        return -1;
+      }
+
+      if (meta != nullptr) {
+        memcpy(&meta->wall_time, &bits, sizeof(bits));
+      }
+    } else if (field == kEventStep &&
+               type == WireFormatLite::WIRETYPE_VARINT) {
+      uint64_t step = 0;
+      if (!input->ReadVarint64(&step)) {
+        return -1;
+      }
+
+      if (meta != nullptr) {
+        meta->step = static_cast<int64_t>(step);
+      }
+    } else if (field == kEventSummary &&
+               type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      uint32_t len = 0;
+      if (!input->ReadVarint32(&len)) {
+        return -1;
+      }
+
+      auto summary_limit = input->PushLimit(len);
+      while ((tag = input->ReadTag()) != 0) {
+        if (WireFormatLite::GetTagFieldNumber(tag) != kSummaryValue ||
+            WireFormatLite::GetTagWireType(tag) !=
+                WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+          if (!WireFormatLite::SkipField(input, tag)) {
+            return -1;
+          }
+
+          continue;
+        }
+
+        if (!input->ReadVarint32(&len)) {
+          return -1;
+        }
+
+        auto value_limit = input->PushLimit(len);
+        while ((tag = input->ReadTag()) != 0) {
+          if (WireFormatLite::GetTagFieldNumber(tag) == kValueTag &&
+              WireFormatLite::GetTagWireType(tag) ==
+                  WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            const void* ptr = nullptr;
+            int avail = 0;
+            if (!input->ReadVarint32(&len)) {
+              return -1;
+            }
+
+            const char* name = "";
+            if (len > 0) {
+              if (!input->GetDirectBufferPointer(&ptr, &avail) ||
+                  avail < static_cast<int>(len)) {
+                return -1;
+              }
+
+              name = static_cast<const char*>(ptr);
+            }
+
+            if (fn(name, len)) {
+              return 1;
+            }
+
+            input->Skip(len);
+          } else if (!WireFormatLite::SkipField(input, tag)) {
+            return -1;
+          }
+        }
+
+        input->PopLimit(value_limit);
+      }
+
+      input->PopLimit(summary_limit);
+    } else if (!WireFormatLite::SkipField(input, tag)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+EventReader::EventReader(const string& path, bool verify)
+    : path_(path), verify_(verify) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOG(ERROR) << "Failed to open record file '" << path << "', due to: "
+               << strerror(errno);
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    LOG(ERROR) << "Failed to stat record file '" << path << "', due to: "
+               << strerror(errno);
+    close(fd);
+    return;
+  }
+
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      LOG(ERROR) << "Failed to map record file '" << path << "', due to: "
+                 << strerror(errno);
+      close(fd);
+      return;
+    }
+
+    madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(data);
+  }
+
+  close(fd);
+  ready_ = true;
+}
+
+EventReader::~EventReader() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool EventReader::Ready() const {
+  return ready_;
+}
+
+int EventReader::Next(const char** data, size_t* size) {
+  if (!ready_) {
+    return -1;
+  }
+
+  if (offset_ == size_) {
+    return 0;
+  }
+
+  if (size_ - offset_ < kRecordHeaderSize + kRecordFooterSize) {
+    return -1;
+  }
+
+  uint64_t len = 0;
+  uint32_t crc = 0;
+  const char* cur = data_ + offset_;
+  memcpy(&len, cur, sizeof(len));
+  memcpy(&crc, cur + sizeof(len), sizeof(crc));
+  if ((verify_ && crc != MaskedCRC32c(cur, sizeof(len))) ||
+      len > size_ - offset_ - kRecordHeaderSize - kRecordFooterSize) {
+    return -1;
+  }
+
+  cur += kRecordHeaderSize;
+  if (verify_) {
+    memcpy(&crc, cur + len, sizeof(crc));
+    if (crc != MaskedCRC32c(cur, len)) {
+      return -1;
+    }
+  }
+
+  *data = cur;
+  *size = len;
+  offset_ += kRecordHeaderSize + len + kRecordFooterSize;
+  return 1;
+}
+
+int EventReader::Next(tensorboard::Event* event) {
+  const char* data = nullptr;
+  size_t size = 0;
+  auto ret = Next(&data, &size);
+  if (ret <= 0) {
+    return ret;
+  }
+
+  return event->ParseFromArray(data, size) ? 1 : -1;
+}
+
+int EventReader::Next(const string& tag, tensorboard::Event* event) {
+  if (indexed_) {
+    auto entries = Lookup(tag);
+    if (entries == nullptr) {
+      offset_ = size_;
+      return 0;
+    }
+
+    auto iter = std::lower_bound(
+        entries->begin(), entries->end(), offset_,
+        [](const std::pair<int64_t, uint64_t>& entry, uint64_t offset) {
+          return entry.second < offset;
+        });
+    if (iter == entries->end()) {
+      offset_ = size_;
+      return 0;
+    }
+
+    if (Seek(iter->second) < 0) {
+      return -1;
+    }
+
+    return Next(event);
+  }
+
+  const char* data = nullptr;
+  size_t size = 0;
+  int ret = 0;
+  while ((ret = Next(&data, &size)) > 0) {
+    if (HasTag(data, size, tag)) {
+      return event->ParseFromArray(data, size) ? 1 : -1;
+    }
+  }
+
+  return ret;
+}
+
+int EventReader::LoadIndex() {
+  string data;
+  if (!ready_ || ReadFile(EventIndexPath(path_), &data) < 0) {
+    return -1;
+  }
+
+  if (data.size() < 8 || data.compare(0, 4, "TBIX") != 0) {
+    LOG(ERROR) << "Invalid index file of '" << path_ << "'";
+    return -1;
+  }
+
+  // a torn or corrupted tail of the index is ignored
+  std::unordered_map<uint32_t, string> tags;
+  index_.clear();
+  size_t pos = 8;
+  while (pos + 1 + sizeof(uint32_t) * 2 <= data.size()) {
+    auto type = static_cast<uint8_t>(data[pos]);
+    uint32_t id = 0;
+    memcpy(&id, data.data() + pos + 1, sizeof(id));
+    size_t size = 1 + sizeof(id);
+    if (type == EventIndex::kIndexTag) {
+      uint16_t len = 0;
+      if (pos + size + sizeof(len) > data.size()) {
+        break;
+      }
+
+      memcpy(&len, data.data() + pos + size, sizeof(len));
+      size += sizeof(len) + len;
+    } else if (type == EventIndex::kIndexBlock) {
+      uint32_t count = 0;
+      memcpy(&count, data.data() + pos + size, sizeof(count));
+      size += sizeof(count) + count * (sizeof(int64_t) + sizeof(uint64_t));
+    } else {
+      break;
+    }
+
+    uint32_t crc = 0;
+    if (pos + size + sizeof(crc) > data.size()) {
+      break;
+    }
+
+    memcpy(&crc, data.data() + pos + size, sizeof(crc));
+    if (crc != MaskedCRC32c(data.data() + pos, size)) {
+      break;
+    }
+
+    const char* cur = data.data() + pos + 1 + sizeof(id);
+    if (type == EventIndex::kIndexTag) {
+      tags[id].assign(cur + sizeof(uint16_t), size - 1 - sizeof(id) -
+                                                  sizeof(uint16_t));
+    } else if (tags.count(id) > 0) {
+      uint32_t count = 0;
+      memcpy(&count, cur, sizeof(count));
+      cur += sizeof(count);
+      auto& entries = index_[tags[id]];
+      for (uint32_t i = 0; i < count; ++i) {
+        int64_t step = 0;
+        uint64_t offset = 0;
+        memcpy(&step, cur, sizeof(step));
+        memcpy(&offset, cur + sizeof(step), sizeof(offset));
+        cur += sizeof(step) + sizeof(offset);
+        if (offset < size_) {
+          entries.emplace_back(step, offset);
+        }
+      }
+    }
+
+    pos += size + sizeof(crc);
+  }
+
+  indexed_ = true;
+  return index_.size();
+}
+
+const EventReader::IndexEntries* EventReader::Lookup(const string& tag) const {
+  auto iter = index_.find(tag);
+  return iter == index_.end() ? nullptr : &iter->second;
+}
+
+int EventReader::Seek(uint64_t offset) {
+  if (!ready_ || offset > size_) {
+    return -1;
+  }
+
+  offset_ = offset;
+  return 0;
+}
+
+uint64_t EventReader::Offset() const {
+  return offset_;
+}
+
+uint64_t EventReader::Size() const {
+  return size_;
+}
+
+int EventReader::Peek(const char* data, size_t size, EventMeta* meta) {
+  meta->wall_time = 0.0;
+  meta->step = 0;
+  meta->tags.clear();
+
+  CodedInputStream input(reinterpret_cast<const uint8_t*>(data), size);
+  return ForEachTag(&input, meta, [&](const char* tag, size_t len) {
+    meta->tags.emplace_back(tag, len);
+    return false;
+  });
+}
+
+bool EventReader::HasTag(const char* data, size_t size, const string& tag) {
+  CodedInputStream input(reinterpret_cast<const uint8_t*>(data), size);
+  return ForEachTag(&input, nullptr, [&](const char* name, size_t len) {
+    return len == tag.size() && memcmp(name, tag.data(), len) == 0;
+  }) > 0;
+}
+
+int64_t EventReader::Scan(const vector<string>& paths, size_t threads,
+                          const Visitor& visitor, bool verify) {
+  std::atomic<size_t> next{0};
+  std::atomic<int64_t> count{0};
+  std::atomic<bool> failed{false};
+
+  auto scan = [&]() {
+    size_t i = 0;
+    while ((i = next.fetch_add(1)) < paths.size()) {
+      EventReader reader(paths[i], verify);
+      const char* data = nullptr;
+      size_t size = 0;
+      int64_t n = 0;
+      uint64_t offset = reader.Offset();
+      int ret = 0;
+      while ((ret = reader.Next(&data, &size)) > 0) {
+        visitor(i, offset, data, size);
+        offset = reader.Offset();
+        ++n;
+      }
+
+      if (ret < 0) {
+        LOG(ERROR) << "Corrupted record in '" << paths[i] << "' at " << offset;
+        failed.store(true);
+      }
+
+      count.fetch_add(n);
+    }
+  };
+
+  threads = std::max<size_t>(1, std::min(threads, paths.size()));
+  vector<std::thread> workers;
+  for (size_t i = 1; i < threads; ++i) {
+    workers.emplace_back(scan);
+  }
+
+  scan();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  return failed ? -1 : count.load();
+}
+
+}  // namespace nlptk
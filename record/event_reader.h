@@ -0,0 +1,103 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_EVENT_READER_H_
+#define RECORD_EVENT_READER_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "proto/event.pb.h"
+
+namespace nlptk {
+
+// The fields of an event which are decoded without parsing the whole event.
+class EventMeta {
+ public:
+  double                    wall_time{0.0};
+  int64_t                   step{0};
+  std::vector<std::string>  tags;
+};
+
+// Reads a tfevents file through a read-only memory mapping. Records are
+// returned as views into the mapping and checked against their masked
+// CRC32c; events are only parsed when asked for.
+class EventReader {
+ public:
+  using Visitor = std::function<void(size_t file, uint64_t offset,
+                                     const char* data, size_t size)>;
+
+  // (step, file offset) of the records of a tag in file order
+  using IndexEntries = std::vector<std::pair<int64_t, uint64_t>>;
+
+  explicit EventReader(const std::string& path, bool verify = true);
+
+  ~EventReader();
+
+  bool Ready() const;
+
+  // Returns 1 and the payload of the next record, 0 at the end of the file
+  // and -1 on a truncated or corrupted record.
+  int Next(const char** data, size_t* size);
+
+  int Next(tensorboard::Event* event);
+
+  // Skips to the next event with a summary value of `tag`, only matching
+  // events are parsed. With a loaded index it seeks to the event directly.
+  int Next(const std::string& tag, tensorboard::Event* event);
+
+  // Loads the sidecar index written with WriterOptions::index, returns the
+  // number of indexed tags or -1 if the file has no index.
+  int LoadIndex();
+
+  // the indexed records of `tag`, nullptr if the tag is not indexed
+  const IndexEntries* Lookup(const std::string& tag) const;
+
+  int Seek(uint64_t offset);
+
+  // offset of the next record
+  uint64_t Offset() const;
+
+  uint64_t Size() const;
+
+  // Decodes wall_time, step and the summary tags of a serialized event.
+  static int Peek(const char* data, size_t size, EventMeta* meta);
+
+  static bool HasTag(const char* data, size_t size, const std::string& tag);
+
+  // Visits all records of `paths` with up to `threads` threads. The files
+  // are split across the threads and the records of a file are visited in
+  // order, `visitor` must be thread-safe. Returns the number of records or
+  // -1 if any file is corrupted.
+  static int64_t Scan(const std::vector<std::string>& paths, size_t threads,
+                      const Visitor& visitor, bool verify = true);
+
+ private:
+  std::string   path_;
+  bool          verify_;
+  const char*   data_{nullptr};
+  uint64_t      size_{0};
+  uint64_t      offset_{0};
+  bool          ready_{false};
+  bool          indexed_{false};
+  std::unordered_map<std::string, IndexEntries>   index_;
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_EVENT_READER_H_
@@ -0,0 +1,197 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/event_reader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "record/event_file.h"
+#include "record/file_writer.h"
+#include "record/recorder.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+static string WriteRun(const string& dir, int64_t steps) {
+  Recorder recorder(dir);
+  for (int64_t i = 0; i < steps; ++i) {
+    recorder.AddScalar("loss", 0.1 * i, i);
+    recorder.AddScalar("accuracy", 0.01 * i, i);
+  }
+
+  recorder.AddText("note", "done", steps);
+  auto files = ListEventFiles(JoinPath(dir, "events"));
+  return files.empty() ? "" : files.back();
+}
+
+TEST(EventReader, Next) {
+  auto path = WriteRun("runs/reader", 100);
+  EventReader reader(path);
+  ASSERT_TRUE(reader.Ready());
+
+  tensorboard::Event event;
+  ASSERT_EQ(1, reader.Next(&event));
+  EXPECT_EQ("brain.Event:2", event.file_version());
+
+  int count = 0;
+  while (reader.Next(&event) > 0) {
+    ++count;
+  }
+
+  EXPECT_EQ(201, count);
+  EXPECT_EQ(0, reader.Next(&event));
+}
+
+TEST(EventReader, TagFilter) {
+  auto path = WriteRun("runs/reader_tag", 100);
+  EventReader reader(path);
+  ASSERT_TRUE(reader.Ready());
+
+  tensorboard::Event event;
+  int64_t step = 0;
+  while (reader.Next("accuracy", &event) > 0) {
+    ASSERT_EQ(1, event.summary().value_size());
+    EXPECT_EQ("accuracy", event.summary().value(0).tag());
+    EXPECT_EQ(step++, event.step());
+  }
+
+  EXPECT_EQ(100, step);
+
+  ASSERT_EQ(0, reader.Seek(0));
+  ASSERT_EQ(1, reader.Next("note/text_summary", &event));
+  EXPECT_EQ(100, event.step());
+}
+
+TEST(EventReader, Peek) {
+  tensorboard::Event event;
+  event.set_wall_time(1.5);
+  event.set_step(42);
+  event.mutable_summary()->add_value()->set_tag("a");
+  event.mutable_summary()->add_value()->set_tag("b/c");
+  string data;
+  event.SerializeToString(&data);
+
+  EventMeta meta;
+  EXPECT_EQ(0, EventReader::Peek(data.data(), data.size(), &meta));
+  EXPECT_EQ(1.5, meta.wall_time);
+  EXPECT_EQ(42, meta.step);
+  EXPECT_EQ(vector<string>({"a", "b/c"}), meta.tags);
+
+  EXPECT_TRUE(EventReader::HasTag(data.data(), data.size(), "b/c"));
+  EXPECT_FALSE(EventReader::HasTag(data.data(), data.size(), "b"));
+}
+
+TEST(EventReader, Corrupted) {
+  auto path = WriteRun("runs/reader_corrupted", 10);
+  auto size = EventReader(path).Size();
+
+  // flip a byte in the payload of the last record
+  int fd = open(path.c_str(), O_RDWR);
+  ASSERT_LE(0, fd);
+  char c = 0;
+  ASSERT_EQ(1, pread(fd, &c, 1, size - kRecordFooterSize - 1));
+  c ^= 0x01;
+  ASSERT_EQ(1, pwrite(fd, &c, 1, size - kRecordFooterSize - 1));
+  close(fd);
+
+  EventReader reader(path);
+  tensorboard::Event event;
+  int ret = 0;
+  int count = 0;
+  while ((ret = reader.Next(&event)) > 0) {
+    ++count;
+  }
+
+  EXPECT_EQ(-1, ret);
+  EXPECT_EQ(21, count);
+
+  EventReader unchecked(path, false);
+  count = 0;
+  while (unchecked.Next(&event) > 0) {
+    ++count;
+  }
+
+  EXPECT_EQ(22, count);
+}
+
+TEST(EventReader, Scan) {
+  vector<string> paths;
+  for (int i = 0; i < 4; ++i) {
+    paths.push_back(WriteRun(StringUtil::Format("runs/reader_scan%d", i), 50));
+  }
+
+  std::atomic<int64_t> tags{0};
+  auto count = EventReader::Scan(paths, 4, [&](size_t, uint64_t,
+                                               const char* data, size_t size) {
+    if (EventReader::HasTag(data, size, "loss")) {
+      ++tags;
+    }
+  });
+
+  EXPECT_EQ(4 * 102, count);
+  EXPECT_EQ(4 * 50, tags.load());
+}
+
+TEST(EventReader, Index) {
+  ASSERT_EQ(0, MakeDirs("runs/reader_index"));
+  WriterOptions options;
+  options.index = true;
+  {
+    FileWriter writer("runs/reader_index/events", options);
+    for (int64_t i = 0; i < 100; ++i) {
+      tensorboard::Event event;
+      event.set_step(i);
+      event.mutable_summary()->add_value()->set_tag(i % 10 ? "loss" : "eval");
+      writer.Write(std::move(event));
+    }
+  }
+
+  auto path = ListEventFiles("runs/reader_index/events").back();
+  EventReader reader(path);
+  ASSERT_TRUE(reader.Ready());
+  ASSERT_EQ(2, reader.LoadIndex());
+  ASSERT_NE(nullptr, reader.Lookup("eval"));
+  EXPECT_EQ(nullptr, reader.Lookup("missing"));
+
+  auto entries = *reader.Lookup("eval");
+  ASSERT_EQ(10u, entries.size());
+  EXPECT_EQ(90, entries.back().first);
+
+  tensorboard::Event event;
+  ASSERT_EQ(0, reader.Seek(entries.back().second));
+  ASSERT_EQ(1, reader.Next(&event));
+  EXPECT_EQ(90, event.step());
+
+  ASSERT_EQ(0, reader.Seek(0));
+  int64_t step = 0;
+  while (reader.Next("eval", &event) > 0) {
+    EXPECT_EQ(step, event.step());
+    step += 10;
+  }
+
+  EXPECT_EQ(100, step);
+  EXPECT_EQ(0, reader.Next("missing", &event));
+}
+
+}  // namespace nlptk
@@ -14,81 +14,122 @@
 
 #include "record/file_writer.h"
 
-#include <ctime>
-
-#include "glog/logging.h"
-#include "record/crc.h"
-#include "record/utils.h"
-
 namespace nlptk {
 
 using std::string;
 
-FileWriter::FileWriter(const string& prefix, bool resume) {
-  auto path = StringUtil::Format("%s.out.tfevents.%f.%s", prefix.c_str(),
-                                 Timestamp(), Env::HostName.c_str());
-  fout_.open(path, std::ios::out | std::ios::binary |
-                       (resume ? std::ios::app : std::ios::trunc));
-  if (!fout_.is_open() || fout_.fail()) {
-    LOG(ERROR) << "Failed create record file '" << path << "'";
-    fout_.close();
-  }
+static WriterOptions MakeOptions(bool resume) {
+  WriterOptions options;
+  options.resume = resume;
+  return options;
+}
+
+FileWriter::FileWriter(const string& prefix, bool resume)
+    : FileWriter(prefix, MakeOptions(resume)) {
+}
+
+FileWriter::FileWriter(const string& prefix, const WriterOptions& options)
+    : file_(prefix, options) {
+  file_.SetStats(&stats_);
+  file_.Open(options.resume);
 }
 
 FileWriter::~FileWriter() {
-  if (fout_.is_open()) {
-    fout_.close();
+  if (file_.IsOpen()) {
+    file_.Close();
   }
 }
 
 int FileWriter::Write(tensorboard::Event&& event) {
-  if (!fout_.is_open()) {
+  if (!file_.IsOpen()) {
     return -1;
   }
 
+  auto start = StatsCounters::Now();
   string buf;
   event.SerializeToString(&buf);
+  stats_.Add(StatsCounters::kSerializeNanos, StatsCounters::Now() - start);
   return Write(buf);
 }
 
+int FileWriter::WriteRecords(const char* data, size_t size, size_t records) {
+  if (!file_.IsOpen() || size == 0) {
+    return -1;
+  }
+
+  if (file_.NeedRotate() && file_.Rotate() < 0) {
+    return -1;
+  }
+
+  if (file_.Append(data, size, records) < 0 || file_.Commit() < 0) {
+    return -1;
+  }
+
+  return size;
+}
+
+int FileWriter::WriteBlob(const string& head, Blob&& blob,
+                          const string& tail) {
+  if (!file_.IsOpen()) {
+    return -1;
+  }
+
+  if (file_.NeedRotate() && file_.Rotate() < 0) {
+    return -1;
+  }
+
+  if (file_.AppendBlob(head, blob.data(), blob.size(), tail) < 0 ||
+      file_.Commit() < 0) {
+    return -1;
+  }
+
+  return head.size() + blob.size() + tail.size();
+}
+
 int FileWriter::Flush() {
-  if (!fout_.is_open()) {
+  if (!file_.IsOpen()) {
     return -1;
   }
 
-  fout_.flush();
-  return 0;
+  return file_.Commit(true);
 }
 
 int FileWriter::Close() {
-  if (!fout_.is_open()) {
+  if (!file_.IsOpen()) {
     return -1;
   }
 
-  fout_.close();
-  return 0;
+  return file_.Close();
 }
 
 int FileWriter::Ready() const {
-  return fout_.is_open() && fout_.good();
+  return file_.IsOpen();
+}
+
+int FileWriter::Suspend() {
+  return file_.Suspend();
+}
+
+int64_t FileWriter::LastStep(const string& tag) const {
+  return file_.LastStep(tag);
 }
 
 int FileWriter::Write(const std::string& data) {
-  if (!fout_.is_open() || data.empty()) {
+  if (!file_.IsOpen() || data.empty()) {
     return -1;
   }
 
-  uint64_t header = data.size();
-  fout_.write(reinterpret_cast<const char*>(&header), sizeof(header));
-  auto crc = MaskedCRC32c(reinterpret_cast<const char*>(&header),
-                          sizeof(header));
-  fout_.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
-
-  fout_.write(data.data(), data.size());
-  crc = MaskedCRC32c(data.data(), data.size());
-  fout_.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+  if (file_.NeedRotate() && file_.Rotate() < 0) {
+    return -1;
+  }
 
-  fout_.flush();
+  auto start = StatsCounters::Now();
+  string buf;
+  AppendRecord(data.data(), data.size(), &buf);
+  stats_.Add(StatsCounters::kChecksumNanos, StatsCounters::Now() - start);
+  if (file_.Append(buf.data(), buf.size()) < 0 || file_.Commit() < 0) {
+    return -1;
+  }
 
   return data.size();
 }
@@ -15,9 +15,9 @@
 #ifndef RECORD_FILE_WRITER_H_
 #define RECORD_FILE_WRITER_H_
 
-#include <fstream>
 #include <string>
 
+#include "record/event_file.h"
 #include "record/writer.h"
 
 namespace nlptk {
@@ -26,21 +26,32 @@ class FileWriter : public Writer {
  public:
   explicit FileWriter(const std::string& path_prefix, bool resume = false);
 
+  FileWriter(const std::string& path_prefix, const WriterOptions& options);
+
   ~FileWriter();
 
   int Write(tensorboard::Event&& event) override;
 
+  int WriteRecords(const char* data, size_t size, size_t records) override;
+
+  int WriteBlob(const std::string& head, Blob&& blob,
+                const std::string& tail) override;
+
   int Flush() override;
 
   int Close() override;
 
   int Ready() const override;
 
+  int Suspend() override;
+
+  int64_t LastStep(const std::string& tag) const override;
+
  protected:
   int Write(const std::string& data);
 
  private:
-  std::ofstream   fout_;
+  EventFile   file_;
 };
 
 }  // namespace nlptk
@@ -0,0 +1,147 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/io_executor.h"
+
+#include <algorithm>
+
+namespace nlptk {
+
+IoExecutor::IoExecutor(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back(&IoExecutor::Run, this);
+  }
+}
+
+IoExecutor::~IoExecutor() {
+  {
+    std::lock_guard<std::mutex> lock{locker_};
+    stop_ = true;
+    wakeup_.notify_all();
+  }
+
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+uint64_t IoExecutor::Register(Task task) {
+  std::lock_guard<std::mutex> lock{locker_};
+  auto id = ++next_id_;
+  entries_[id].task = std::move(task);
+  return id;
+}
+
+void IoExecutor::Unregister(uint64_t id) {
+  std::unique_lock<std::mutex> lock{locker_};
+  auto iter = entries_.find(id);
+  if (iter == entries_.end()) {
+    return;
+  }
+
+  idle_.wait(lock, [&] { return !iter->second.running; });
+  entries_.erase(iter);
+  // queued ids and timers of the removed task are skipped by the threads
+}
+
+void IoExecutor::Notify(uint64_t id) {
+  std::lock_guard<std::mutex> lock{locker_};
+  auto iter = entries_.find(id);
+  if (iter != entries_.end()) {
+    Enqueue(id, &iter->second);
+  }
+}
+
+size_t IoExecutor::Threads() const {
+  return threads_.size();
+}
+
+size_t IoExecutor::Timers() const {
+  std::lock_guard<std::mutex> lock{locker_};
+  return timers_.size();
+}
+
+IoExecutor* IoExecutor::Default() {
+  static IoExecutor* executor = new IoExecutor();
+  return executor;
+}
+
+void IoExecutor::Enqueue(uint64_t id, Entry* entry) {
+  if (entry->running) {
+    entry->again = true;
+  } else if (!entry->queued) {
+    entry->queued = true;
+    ready_.push_back(id);
+    wakeup_.notify_one();
+  }
+}
+
+void IoExecutor::Run() {
+  std::unique_lock<std::mutex> lock{locker_};
+  while (!stop_) {
+    // move the tasks whose deadline expired to the ready queue
+    auto now = Clock::now();
+    while (!timers_.empty() && timers_.top().first <= now) {
+      auto timer = timers_.top();
+      timers_.pop();
+      auto iter = entries_.find(timer.second);
+      if (iter != entries_.end() && iter->second.deadline == timer.first) {
+        iter->second.deadline = Clock::time_point::max();
+        Enqueue(timer.second, &iter->second);
+      }
+    }
+
+    if (ready_.empty()) {
+      if (timers_.empty()) {
+        wakeup_.wait(lock);
+      } else {
+        wakeup_.wait_until(lock, timers_.top().first);
+      }
+
+      continue;
+    }
+
+    auto id = ready_.front();
+    ready_.pop_front();
+    auto iter = entries_.find(id);
+    if (iter == entries_.end()) {
+      continue;
+    }
+
+    auto& entry = iter->second;
+    entry.queued = false;
+    entry.running = true;
+    lock.unlock();
+
+    auto deadline = entry.task();
+
+    lock.lock();
+    entry.running = false;
+    idle_.notify_all();
+    if (entry.again) {
+      entry.again = false;
+      Enqueue(id, &entry);
+    } else if (deadline != entry.deadline) {
+      // a task keeping its deadline across rounds keeps its timer, the
+      // timer of a former deadline is skipped once it expires
+      entry.deadline = deadline;
+      if (deadline != Clock::time_point::max()) {
+        timers_.emplace(deadline, id);
+      }
+    }
+  }
+}
+
+}  // namespace nlptk
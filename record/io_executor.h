@@ -0,0 +1,94 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_IO_EXECUTOR_H_
+#define RECORD_IO_EXECUTOR_H_
+
+#include <chrono>                 // NOLINT(build/c++11)
+#include <condition_variable>     // NOLINT(build/c++11)
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <queue>
+#include <thread>                 // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+namespace nlptk {
+
+// A small fixed pool of threads doing the I/O of many writers, so the
+// number of threads does not grow with the number of writers. Every
+// writer registers a task which is run when the writer notifies it or
+// when the deadline returned by its last run expires. A task never runs on
+// two threads at once, and ready tasks are served in FIFO order, so a busy
+// writer can not starve the others.
+class IoExecutor {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // runs a round of work and returns when the task wants to run again,
+  // Clock::time_point::max() for never unless notified
+  using Task = std::function<Clock::time_point()>;
+
+  explicit IoExecutor(size_t threads = 2);
+
+  ~IoExecutor();
+
+  uint64_t Register(Task task);
+
+  // removes a task, waits until a running round of it is finished
+  void Unregister(uint64_t id);
+
+  // schedules a task to run as soon as a thread is free
+  void Notify(uint64_t id);
+
+  size_t Threads() const;
+
+  // timers pending, including the expired ones not popped yet
+  size_t Timers() const;
+
+  // the executor shared by the writers of the process, never destroyed so
+  // writers may outlive static destruction
+  static IoExecutor* Default();
+
+ private:
+  struct Entry {
+    Task                  task;
+    Clock::time_point     deadline{Clock::time_point::max()};
+    bool                  queued{false};
+    bool                  running{false};
+    bool                  again{false};    // notified while running
+  };
+
+  using Timer = std::pair<Clock::time_point, uint64_t>;
+
+  void Run();
+
+  void Enqueue(uint64_t id, Entry* entry);
+
+ private:
+  bool                                  stop_{false};
+  uint64_t                              next_id_{0};
+  std::map<uint64_t, Entry>             entries_;
+  std::deque<uint64_t>                  ready_;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+  std::vector<std::thread>              threads_;
+  mutable std::mutex                    locker_;
+  std::condition_variable               wakeup_;
+  std::condition_variable               idle_;
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_IO_EXECUTOR_H_
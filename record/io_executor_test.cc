@@ -0,0 +1,272 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/io_executor.h"
+
+#include <atomic>
+#include <condition_variable>     // NOLINT(build/c++11)
+#include <memory>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "record/async_file_writer.h"
+#include "record/event_file.h"
+#include "record/event_reader.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+TEST(IoExecutor, Notify) {
+  IoExecutor executor(2);
+  EXPECT_EQ(2, executor.Threads());
+
+  std::atomic<int> runs{0};
+  std::atomic<int> concurrent{0};
+  std::atomic<bool> overlapped{false};
+  auto id = executor.Register([&] {
+    if (++concurrent > 1) {
+      overlapped = true;
+    }
+
+    ++runs;
+    --concurrent;
+    return IoExecutor::Clock::time_point::max();
+  });
+
+  for (int i = 0; i < 1000; ++i) {
+    executor.Notify(id);
+  }
+
+  auto until = IoExecutor::Clock::now() + std::chrono::seconds(5);
+  while (runs == 0 && IoExecutor::Clock::now() < until) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  executor.Unregister(id);
+  EXPECT_LE(1, runs.load());
+  EXPECT_FALSE(overlapped.load());
+
+  // notifying a removed task is a no-op
+  executor.Notify(id);
+}
+
+TEST(IoExecutor, Deadline) {
+  IoExecutor executor(1);
+  std::atomic<int> runs{0};
+  auto id = executor.Register([&] {
+    ++runs;
+    return IoExecutor::Clock::now() + std::chrono::milliseconds(5);
+  });
+
+  executor.Notify(id);
+  auto until = IoExecutor::Clock::now() + std::chrono::seconds(5);
+  while (runs < 3 && IoExecutor::Clock::now() < until) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  executor.Unregister(id);
+  EXPECT_LE(3, runs.load());
+}
+
+TEST(IoExecutor, SameDeadline) {
+  IoExecutor executor(1);
+  std::mutex lock;
+  std::condition_variable ran;
+  int runs = 0;
+  auto deadline = IoExecutor::Clock::now() + std::chrono::hours(1);
+  auto id = executor.Register([&] {
+    std::lock_guard<std::mutex> guard{lock};
+    ++runs;
+    ran.notify_all();
+    return deadline;
+  });
+
+  // rounds within one window keep a single timer
+  for (int i = 1; i <= 100; ++i) {
+    executor.Notify(id);
+    std::unique_lock<std::mutex> guard{lock};
+    ran.wait(guard, [&] { return runs >= i; });
+  }
+
+  // the last round may still be finishing
+  executor.Unregister(id);
+  EXPECT_EQ(1, executor.Timers());
+}
+
+TEST(IoExecutor, SharedByWriters) {
+  const int kWriters = 64;
+  IoExecutor executor(2);
+  WriterOptions options;
+  vector<std::unique_ptr<AsyncFileWriter>> writers;
+  for (int i = 0; i < kWriters; ++i) {
+    auto dir = StringUtil::Format("runs/executor/%d", i);
+    ASSERT_EQ(0, MakeDirs(dir));
+    writers.emplace_back(
+        new AsyncFileWriter(JoinPath(dir, "events"), options, &executor));
+    ASSERT_TRUE(writers.back()->Ready());
+  }
+
+  for (int64_t step = 0; step < 100; ++step) {
+    for (auto& writer : writers) {
+      tensorboard::Event event;
+      event.set_step(step);
+      event.mutable_summary()->add_value()->set_tag("loss");
+      EXPECT_LT(0, writer->Write(std::move(event)));
+    }
+  }
+
+  writers[0]->Flush();
+  writers.clear();
+
+  for (int i = 0; i < kWriters; ++i) {
+    auto prefix = StringUtil::Format("runs/executor/%d/events", i);
+    EventReader reader(ListEventFiles(prefix).back());
+    tensorboard::Event event;
+    int count = 0;
+    while (reader.Next("loss", &event) > 0) {
+      EXPECT_EQ(count++, event.step());
+    }
+
+    EXPECT_EQ(100, count);
+  }
+}
+
+TEST(AsyncFileWriter, PriorityLanes) {
+  // the only thread is stalled until everything is queued
+  IoExecutor executor(1);
+  std::mutex stall;
+  std::unique_lock<std::mutex> stalled{stall};
+  auto blocker = executor.Register([&] {
+    std::lock_guard<std::mutex> lock{stall};
+    return IoExecutor::Clock::time_point::max();
+  });
+  executor.Notify(blocker);
+
+  ASSERT_EQ(0, MakeDirs("runs/lanes"));
+  AsyncFileWriter writer("runs/lanes/events", WriterOptions(), &executor);
+  ASSERT_TRUE(writer.Ready());
+  auto scalar = [&](int64_t step) {
+    tensorboard::Event event;
+    event.set_step(step);
+    auto value = event.mutable_summary()->add_value();
+    value->set_tag("loss");
+    value->set_simple_value(0.5f);
+    EXPECT_LT(0, writer.Write(std::move(event)));
+  };
+
+  scalar(0);
+  for (int64_t step = 0; step < 2; ++step) {
+    tensorboard::Event event;
+    event.set_step(step);
+    auto value = event.mutable_summary()->add_value();
+    value->set_tag("image");
+    value->mutable_image()->set_encoded_image_string(string(1 << 20, 'i'));
+    EXPECT_LT(0, writer.Write(std::move(event)));
+  }
+
+  for (int64_t step = 1; step < 50; ++step) {
+    scalar(step);
+  }
+
+  stalled.unlock();
+  writer.Flush();
+  writer.Close();
+  executor.Unregister(blocker);
+
+  EventReader reader(ListEventFiles("runs/lanes/events").back());
+  tensorboard::Event event;
+  vector<string> tags;
+  int64_t step = 0;
+  while (reader.Next(&event) > 0) {
+    if (event.summary().value_size() == 0) {
+      continue;
+    }
+
+    tags.push_back(event.summary().value(0).tag());
+    if (tags.back() == "loss") {
+      EXPECT_EQ(step++, event.step());
+    }
+  }
+
+  ASSERT_EQ(52, tags.size());
+  for (size_t i = 0; i < 50; ++i) {
+    EXPECT_EQ("loss", tags[i]);
+  }
+
+  EXPECT_EQ("image", tags[50]);
+  EXPECT_EQ("image", tags[51]);
+}
+
+TEST(AsyncFileWriter, SmallRecordBatches) {
+  IoExecutor executor(1);
+  std::mutex stall;
+  std::unique_lock<std::mutex> stalled{stall};
+  auto blocker = executor.Register([&] {
+    std::lock_guard<std::mutex> lock{stall};
+    return IoExecutor::Clock::time_point::max();
+  });
+  executor.Notify(blocker);
+
+  ASSERT_EQ(0, MakeDirs("runs/batch_lanes"));
+  AsyncFileWriter writer("runs/batch_lanes/events", WriterOptions(),
+                         &executor);
+  ASSERT_TRUE(writer.Ready());
+
+  tensorboard::Event image;
+  auto value = image.mutable_summary()->add_value();
+  value->set_tag("image");
+  value->mutable_image()->set_encoded_image_string(string(1 << 20, 'i'));
+  EXPECT_LT(0, writer.Write(std::move(image)));
+
+  // a batch of small records stays in the priority lane, however large
+  string records;
+  for (int64_t step = 0; step < 4096; ++step) {
+    tensorboard::Event event;
+    event.set_step(step);
+    event.mutable_summary()->add_value()->set_tag("batch");
+    string buf;
+    event.SerializeToString(&buf);
+    AppendRecord(buf.data(), buf.size(), &records);
+  }
+
+  ASSERT_LT(64 * 1024, records.size());
+  EXPECT_EQ(records.size(),
+            writer.WriteRecords(records.data(), records.size(), 4096));
+
+  stalled.unlock();
+  EXPECT_EQ(0, writer.Flush());
+  EXPECT_EQ(0, writer.Close());
+  EXPECT_EQ(-1, writer.Flush());
+  executor.Unregister(blocker);
+
+  EventReader reader(ListEventFiles("runs/batch_lanes/events").back());
+  tensorboard::Event event;
+  vector<string> tags;
+  while (reader.Next(&event) > 0) {
+    if (event.summary().value_size() > 0) {
+      tags.push_back(event.summary().value(0).tag());
+    }
+  }
+
+  ASSERT_EQ(4097, tags.size());
+  EXPECT_EQ("batch", tags.front());
+  EXPECT_EQ("image", tags.back());
+}
+
+}  // namespace nlptk
@@ -0,0 +1,590 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/io_uring_file_writer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define NLPTK_HAS_IO_URING 1
+#endif
+#endif
+
+#include "glog/logging.h"
+#include "record/crc.h"
+#include "record/event_file.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+// alignment of the staging buffers, file offsets and lengths for O_DIRECT
+static const size_t kBlockSize = 4096;
+
+// a short write is resumed from the last multiple of `align` it reached
+static int PWriteFully(int fd, const char* data, size_t size, uint64_t off,
+                       size_t align) {
+  while (size > 0) {
+    auto n = pwrite(fd, data, size, off);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    n = n / align * align;
+    if (n == 0) {
+      errno = EIO;
+      return -1;
+    }
+
+    data += n;
+    size -= n;
+    off += n;
+  }
+
+  return 0;
+}
+
+namespace internal {
+
+#ifdef NLPTK_HAS_IO_URING
+
+// A minimal io_uring on top of the raw system calls, only what the writer
+// needs: single-issuer writes and completion polling.
+class IoUring {
+ public:
+  static IoUring* Create(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+      LOG(INFO) << "io_uring is unavailable: " << strerror(errno);
+      return nullptr;
+    }
+
+    auto ring = new IoUring();
+    ring->fd_ = fd;
+    ring->sq_entries_ = params.sq_entries;
+    ring->sq_len_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len_ = params.cq_off.cqes +
+                    params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqes_len_ = params.sq_entries * sizeof(io_uring_sqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+      ring->sq_len_ = ring->cq_len_ = std::max(ring->sq_len_, ring->cq_len_);
+    }
+
+    ring->sq_ptr_ = mmap(nullptr, ring->sq_len_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr_ == MAP_FAILED) {
+      ring->sq_ptr_ = nullptr;
+      delete ring;
+      return nullptr;
+    }
+
+    ring->cq_ptr_ = single ? ring->sq_ptr_ :
+                    mmap(nullptr, ring->cq_len_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ptr_ == MAP_FAILED) {
+      ring->cq_ptr_ = nullptr;
+      delete ring;
+      return nullptr;
+    }
+
+    void* sqes = mmap(nullptr, ring->sqes_len_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      delete ring;
+      return nullptr;
+    }
+
+    auto sq = static_cast<char*>(ring->sq_ptr_);
+    auto cq = static_cast<char*>(ring->cq_ptr_);
+    ring->sqes_ = static_cast<io_uring_sqe*>(sqes);
+    ring->sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring->sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return ring;
+  }
+
+  ~IoUring() {
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_len_);
+    }
+
+    if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) {
+      munmap(cq_ptr_, cq_len_);
+    }
+
+    if (sq_ptr_ != nullptr) {
+      munmap(sq_ptr_, sq_len_);
+    }
+
+    close(fd_);
+  }
+
+  int Register(const vector<iovec>& iovs) {
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS,
+                iovs.data(), iovs.size()) < 0) {
+      LOG(INFO) << "Failed to register io_uring buffers: " << strerror(errno);
+      return -1;
+    }
+
+    registered_ = true;
+    return 0;
+  }
+
+  // queues and submits a single write, `index` is the registered buffer
+  int Write(int fd, const char* data, unsigned size, uint64_t offset,
+            unsigned index) {
+    unsigned tail = *sq_tail_;
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (tail - head >= sq_entries_) {
+      errno = EBUSY;
+      return -1;
+    }
+
+    auto sqe = &sqes_[tail & sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = registered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    sqe->buf_index = registered_ ? index : 0;
+    sqe->user_data = index;
+    sq_array_[tail & sq_mask_] = tail & sq_mask_;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    return Enter(1, 0);
+  }
+
+  int Enter(unsigned to_submit, unsigned min_complete) {
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true) {
+      auto ret = syscall(__NR_io_uring_enter, fd_, to_submit, min_complete,
+                         flags, nullptr, 0);
+      if (ret >= 0 || errno != EINTR) {
+        return ret;
+      }
+    }
+  }
+
+  bool Pop(uint64_t* user_data, int64_t* res) {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+
+    const auto& cqe = cqes_[head & cq_mask_];
+    *user_data = cqe.user_data;
+    *res = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  int             fd_{-1};
+  bool            registered_{false};
+  unsigned        sq_entries_{0};
+  size_t          sq_len_{0};
+  size_t          cq_len_{0};
+  size_t          sqes_len_{0};
+  void*           sq_ptr_{nullptr};
+  void*           cq_ptr_{nullptr};
+  io_uring_sqe*   sqes_{nullptr};
+  unsigned*       sq_head_{nullptr};
+  unsigned*       sq_tail_{nullptr};
+  unsigned        sq_mask_{0};
+  unsigned*       sq_array_{nullptr};
+  unsigned*       cq_head_{nullptr};
+  unsigned*       cq_tail_{nullptr};
+  unsigned        cq_mask_{0};
+  io_uring_cqe*   cqes_{nullptr};
+};
+
+#else
+
+class IoUring {
+ public:
+  static IoUring* Create(unsigned entries) {
+    return nullptr;
+  }
+
+  int Register(const vector<iovec>& iovs) {
+    return -1;
+  }
+
+  int Write(int fd, const char* data, unsigned size, uint64_t offset,
+            unsigned index) {
+    return -1;
+  }
+
+  int Enter(unsigned to_submit, unsigned min_complete) {
+    return -1;
+  }
+
+  bool Pop(uint64_t* user_data, int64_t* res) {
+    return false;
+  }
+};
+
+#endif  // NLPTK_HAS_IO_URING
+
+}  // namespace internal
+
+IoUringFileWriter::IoUringFileWriter(const string& prefix, size_t depth,
+                                     size_t buffer_size, bool direct_io,
+                                     uint64_t max_latency_ms)
+    : path_(EventFilePath(prefix)), direct_io_(direct_io),
+      max_latency_(std::chrono::milliseconds(max_latency_ms)) {
+  depth = std::max<size_t>(depth, 1);
+  buffer_size_ = std::max<size_t>(buffer_size, kBlockSize);
+  buffer_size_ = (buffer_size_ + kBlockSize - 1) / kBlockSize * kBlockSize;
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  auto mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+  if (direct_io_) {
+    fd_ = open(path_.c_str(), flags | O_DIRECT, mode);
+    if (fd_ < 0) {
+      LOG(WARNING) << "O_DIRECT is not supported for '" << path_
+                   << "', due to: " << strerror(errno);
+      direct_io_ = false;
+    }
+  }
+
+  if (fd_ < 0) {
+    fd_ = open(path_.c_str(), flags, mode);
+  }
+
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed create record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return;
+  }
+
+  vector<iovec> iovs;
+  buffers_.resize(depth);
+  for (auto& buf : buffers_) {
+    void* data = nullptr;
+    if (posix_memalign(&data, kBlockSize, buffer_size_) != 0) {
+      LOG(ERROR) << "Failed to allocate staging buffer of " << buffer_size_;
+      failed_ = true;
+      return;
+    }
+
+    buf.data = static_cast<char*>(data);
+    iovs.push_back({data, buffer_size_});
+  }
+
+  ring_ = internal::IoUring::Create(depth);
+  if (ring_ != nullptr) {
+    ring_->Register(iovs);
+  }
+
+  tensorboard::Event event;
+  event.set_wall_time(Timestamp());
+  event.set_file_version("brain.Event:2");
+  string buf;
+  event.SerializeToString(&buf);
+  Write(buf.data(), buf.size());
+}
+
+IoUringFileWriter::~IoUringFileWriter() {
+  Close();
+
+  for (auto& buf : buffers_) {
+    free(buf.data);
+  }
+
+  delete ring_;
+}
+
+int IoUringFileWriter::Write(tensorboard::Event&& event) {
+  if (!Ready()) {
+    return -1;
+  }
+
+  auto start = StatsCounters::Now();
+  string buf;
+  event.SerializeToString(&buf);
+  stats_.Add(StatsCounters::kSerializeNanos, StatsCounters::Now() - start);
+  if (Write(buf.data(), buf.size()) < 0) {
+    return -1;
+  }
+
+  stats_.Add(StatsCounters::kEvents, 1);
+  stats_.Add(StatsCounters::kBytes, kRecordHeaderSize + buf.size() +
+                                        kRecordFooterSize);
+  return buf.size();
+}
+
+int IoUringFileWriter::WriteRecords(const char* data, size_t size,
+                                    size_t records) {
+  if (!Ready() || size == 0) {
+    return -1;
+  }
+
+  if (Append(data, size) < 0 || Poll() < 0) {
+    return -1;
+  }
+
+  stats_.Add(StatsCounters::kEvents, records);
+  stats_.Add(StatsCounters::kBytes, size);
+  return size;
+}
+
+int IoUringFileWriter::WriteBlob(const string& head, Blob&& blob,
+                                 const string& tail) {
+  if (!Ready()) {
+    return -1;
+  }
+
+  uint64_t len = head.size() + blob.size() + tail.size();
+  char header[kRecordHeaderSize];
+  memcpy(header, &len, sizeof(len));
+  uint32_t crc = MaskedCRC32c(header, sizeof(len));
+  memcpy(header + sizeof(len), &crc, sizeof(crc));
+  crc = ExtendCRC32c(CRC32c(head.data(), head.size()), blob.data(),
+                     blob.size());
+  crc = MaskCRC32c(ExtendCRC32c(crc, tail.data(), tail.size()));
+
+  if (Append(header, sizeof(header)) < 0 ||
+      Append(head.data(), head.size()) < 0 ||
+      Append(blob.data(), blob.size()) < 0 ||
+      Append(tail.data(), tail.size()) < 0 ||
+      Append(reinterpret_cast<const char*>(&crc), sizeof(crc)) < 0) {
+    return -1;
+  }
+
+  blob.Reset();
+  if (Poll() < 0) {
+    return -1;
+  }
+
+  stats_.Add(StatsCounters::kEvents, 1);
+  stats_.Add(StatsCounters::kBytes, kRecordHeaderSize + len +
+                                        kRecordFooterSize);
+  return len;
+}
+
+int IoUringFileWriter::Flush() {
+  if (!Ready()) {
+    return -1;
+  }
+
+  auto& cur = buffers_[current_];
+  if (cur.size > cur.written && Submit() < 0) {
+    return -1;
+  }
+
+  return Reap(in_flight_);
+}
+
+int IoUringFileWriter::Close() {
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  int ret = failed_ ? -1 : Flush();
+  if (in_flight_ > 0) {
+    Reap(in_flight_);
+  }
+
+  if (direct_io_ && ftruncate(fd_, offset_) != 0) {
+    LOG(ERROR) << "Failed to truncate record file '" << path_ << "', due to: "
+               << strerror(errno);
+    ret = -1;
+  }
+
+  close(fd_);
+  fd_ = -1;
+  return ret;
+}
+
+int IoUringFileWriter::Ready() const {
+  return fd_ >= 0 && !failed_;
+}
+
+bool IoUringFileWriter::UseIoUring() const {
+  return ring_ != nullptr;
+}
+
+int IoUringFileWriter::Write(const char* data, size_t size) {
+  string record;
+  AppendRecord(data, size, &record);
+  if (Append(record.data(), record.size()) < 0) {
+    return -1;
+  }
+
+  return Poll();
+}
+
+int IoUringFileWriter::Append(const char* data, size_t size) {
+  const char* cur = data;
+  size_t left = size;
+  while (left > 0) {
+    auto& buf = buffers_[current_];
+    if (buf.size == buf.written) {
+      pending_since_ = Clock::now();
+    }
+
+    auto n = std::min(left, buffer_size_ - buf.size);
+    memcpy(buf.data + buf.size, cur, n);
+    buf.size += n;
+    cur += n;
+    left -= n;
+    offset_ += n;
+
+    if (buf.size == buffer_size_ && Submit() < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int IoUringFileWriter::Poll() {
+  if (Reap(0) < 0) {
+    return -1;
+  }
+
+  auto& buf = buffers_[current_];
+  if (buf.size > buf.written &&
+      Clock::now() - pending_since_ >= max_latency_) {
+    return Submit();
+  }
+
+  return 0;
+}
+
+int IoUringFileWriter::Submit() {
+  auto& buf = buffers_[current_];
+  if (buf.size <= buf.written) {
+    return 0;
+  }
+
+  // a padded tail block is rewritten by this write, which must not race
+  // with the write in flight that padded it
+  if (overlapped_ && Reap(in_flight_) < 0) {
+    return -1;
+  }
+
+  buf.length = buf.size;
+  if (direct_io_) {
+    buf.length = (buf.size + kBlockSize - 1) / kBlockSize * kBlockSize;
+    memset(buf.data + buf.size, 0, buf.length - buf.size);
+  }
+
+  overlapped_ = direct_io_ && buf.length != buf.size;
+  auto next_offset = buf.offset + buf.size;
+  size_t tail = 0;
+  if (direct_io_) {
+    tail = buf.size % kBlockSize;
+    next_offset -= tail;
+  }
+
+  if (ring_ != nullptr && ring_->Write(fd_, buf.data, buf.length, buf.offset,
+                                       current_) >= 0) {
+    buf.in_flight = true;
+    ++in_flight_;
+  } else if (Complete(current_, -EAGAIN) < 0) {
+    return -1;
+  }
+
+  auto prev = current_;
+  current_ = (current_ + 1) % buffers_.size();
+  while (buffers_[current_].in_flight) {
+    if (Reap(1) < 0) {
+      return -1;
+    }
+  }
+
+  auto& next = buffers_[current_];
+  next.offset = next_offset;
+  next.size = tail;
+  next.written = tail;
+  if (tail > 0) {
+    memcpy(next.data, buffers_[prev].data + buffers_[prev].size - tail, tail);
+  }
+
+  return 0;
+}
+
+int IoUringFileWriter::Reap(size_t min_complete) {
+  if (ring_ == nullptr || in_flight_ == 0) {
+    return failed_ ? -1 : 0;
+  }
+
+  min_complete = std::min(min_complete, in_flight_);
+  if (min_complete > 0 && ring_->Enter(0, min_complete) < 0) {
+    LOG(ERROR) << "Failed to wait for io_uring: " << strerror(errno);
+    failed_ = true;
+    return -1;
+  }
+
+  uint64_t index = 0;
+  int64_t res = 0;
+  while (ring_->Pop(&index, &res)) {
+    buffers_[index].in_flight = false;
+    --in_flight_;
+    Complete(index, res);
+  }
+
+  return failed_ ? -1 : 0;
+}
+
+int IoUringFileWriter::Complete(size_t index, int64_t res) {
+  auto& buf = buffers_[index];
+  size_t done = res < 0 ? 0 : res;
+
+  // short or failed writes are finished synchronously, from the last block
+  // boundary for O_DIRECT which rejects unaligned offsets
+  if (direct_io_) {
+    done = done / kBlockSize * kBlockSize;
+  }
+
+  if (done < buf.length &&
+      PWriteFully(fd_, buf.data + done, buf.length - done, buf.offset + done,
+                  direct_io_ ? kBlockSize : 1) < 0) {
+    LOG(ERROR) << "Failed to write record file '" << path_ << "', due to: "
+               << strerror(errno);
+    failed_ = true;
+    return -1;
+  }
+
+  return 0;
+}
+
+}  // namespace nlptk
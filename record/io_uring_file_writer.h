@@ -0,0 +1,117 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_IO_URING_FILE_WRITER_H_
+#define RECORD_IO_URING_FILE_WRITER_H_
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "record/writer.h"
+
+namespace nlptk {
+
+namespace internal {
+class IoUring;
+}  // namespace internal
+
+// Frames records into `queue_depth` staging buffers and writes full buffers
+// through io_uring, so up to `queue_depth` writes are in flight while the
+// caller keeps logging. A partial buffer is submitted by Flush(), or by the
+// next write once its first byte has waited `max_latency_ms`, so a slow
+// stream of events neither costs a write per event nor sits unwritten.
+//
+// With `direct_io` the file is opened with O_DIRECT, the staging buffers are
+// block aligned and the partial tail block is rewritten by the next write;
+// the file is truncated to its logical length on Close().
+//
+// Falls back to pwrite() from the same staging buffers when io_uring is not
+// supported by the kernel or forbidden by the sandbox.
+class IoUringFileWriter : public Writer {
+ public:
+  explicit IoUringFileWriter(const std::string& path_prefix,
+                             size_t queue_depth = 4,
+                             size_t buffer_size = 1 << 20,
+                             bool direct_io = false,
+                             uint64_t max_latency_ms = 100);
+
+  ~IoUringFileWriter();
+
+  int Write(tensorboard::Event&& event) override;
+
+  // copies the framed batch straight into the staging buffers
+  int WriteRecords(const char* data, size_t size, size_t records) override;
+
+  int WriteBlob(const std::string& head, Blob&& blob,
+                const std::string& tail) override;
+
+  int Flush() override;
+
+  int Close() override;
+
+  int Ready() const override;
+
+  bool UseIoUring() const;
+
+ protected:
+  int Write(const char* data, size_t size);
+
+  // copies framed bytes into the staging buffers, submits the full ones
+  int Append(const char* data, size_t size);
+
+  // collects finished writes without blocking, and submits the current
+  // buffer once its oldest byte has waited longer than `max_latency_`
+  int Poll();
+
+  // submits the filled part of the current buffer and moves to the next one
+  int Submit();
+
+  // collects completed writes, waits for `min_complete` of them
+  int Reap(size_t min_complete);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  class Buffer {
+   public:
+    char*       data{nullptr};
+    size_t      size{0};        // bytes filled
+    size_t      written{0};     // leading bytes already written to the file
+    size_t      length{0};      // bytes of the write in flight
+    uint64_t    offset{0};      // file offset of data[0]
+    bool        in_flight{false};
+  };
+
+  int Complete(size_t index, int64_t res);
+
+  std::string             path_;
+  int                     fd_{-1};
+  bool                    direct_io_;
+  size_t                  buffer_size_;
+  std::vector<Buffer>     buffers_;
+  size_t                  current_{0};
+  size_t                  in_flight_{0};
+  uint64_t                offset_{0};     // logical length of the file
+  bool                    overlapped_{false};
+  bool                    failed_{false};
+  Clock::duration         max_latency_;
+  Clock::time_point       pending_since_;   // first unsubmitted byte
+  internal::IoUring*      ring_{nullptr};
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_IO_URING_FILE_WRITER_H_
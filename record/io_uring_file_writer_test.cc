@@ -0,0 +1,155 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/io_uring_file_writer.h"
+
+#include <sys/stat.h>
+
+#include <string>
+#include <utility>
+
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+#include "record/event_file.h"
+#include "record/event_reader.h"
+#include "record/recorder.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+
+static void WriteEvents(bool direct_io) {
+  string dir = direct_io ? "runs/io_uring_direct" : "runs/io_uring";
+  ASSERT_EQ(0, MakeDirs(dir));
+  auto prefix = JoinPath(dir, "events");
+  {
+    IoUringFileWriter writer(prefix, 4, 4096, direct_io);
+    ASSERT_TRUE(writer.Ready());
+    LOG(INFO) << "io_uring enabled: " << writer.UseIoUring();
+
+    for (int64_t i = 0; i < 1000; ++i) {
+      tensorboard::Event event;
+      event.set_wall_time(Timestamp());
+      event.set_step(i);
+      auto v = event.mutable_summary()->add_value();
+      v->set_tag("loss");
+      v->set_simple_value(0.1 * i);
+      EXPECT_LT(0, writer.Write(std::move(event)));
+      if (i % 100 == 0) {
+        EXPECT_EQ(0, writer.Flush());
+      }
+    }
+
+    EXPECT_EQ(0, writer.Close());
+  }
+
+  auto files = ListEventFiles(prefix);
+  ASSERT_EQ(1, files.size());
+  EXPECT_EQ(1001, EventReader::Scan(files, 1, [](size_t, uint64_t,
+                                                 const char*, size_t) {}));
+}
+
+TEST(IoUringFileWriter, Write) {
+  WriteEvents(false);
+}
+
+TEST(IoUringFileWriter, WriteDirect) {
+  WriteEvents(true);
+}
+
+static void WriteBatches(bool direct_io) {
+  string dir = direct_io ? "runs/io_uring_batch_direct" : "runs/io_uring_batch";
+  ASSERT_EQ(0, MakeDirs(dir));
+  auto prefix = JoinPath(dir, "events");
+  {
+    IoUringFileWriter writer(prefix, 2, 4096, direct_io);
+    ASSERT_TRUE(writer.Ready());
+
+    for (int64_t i = 0; i < 100; ++i) {
+      string records;
+      for (int64_t j = 0; j < 10; ++j) {
+        tensorboard::Event event;
+        event.set_step(i * 10 + j);
+        string buf;
+        event.SerializeToString(&buf);
+        AppendRecord(buf.data(), buf.size(), &records);
+      }
+
+      EXPECT_EQ(records.size(),
+                writer.WriteRecords(records.data(), records.size(), 10));
+
+      tensorboard::Event event;
+      event.set_step(i);
+      string head;
+      event.SerializeToString(&head);
+      string tail;
+      event.SerializeToString(&tail);
+      EXPECT_EQ(head.size() + 1000 + tail.size(),
+                writer.WriteBlob(head, Blob(string(1000, 'x')), tail));
+    }
+
+    EXPECT_EQ(0, writer.Close());
+  }
+
+  auto files = ListEventFiles(prefix);
+  ASSERT_EQ(1, files.size());
+  EXPECT_EQ(1101, EventReader::Scan(files, 1, [](size_t, uint64_t,
+                                                 const char*, size_t) {}));
+}
+
+TEST(IoUringFileWriter, WriteBatches) {
+  WriteBatches(false);
+}
+
+TEST(IoUringFileWriter, WriteBatchesDirect) {
+  WriteBatches(true);
+}
+
+TEST(IoUringFileWriter, MaxLatency) {
+  ASSERT_EQ(0, MakeDirs("runs/io_uring_latency"));
+  auto prefix = JoinPath("runs/io_uring_latency", "events");
+  IoUringFileWriter writer(prefix, 4, 4096, false, 3600 * 1000);
+  ASSERT_TRUE(writer.Ready());
+
+  tensorboard::Event event;
+  event.set_step(1);
+  EXPECT_LT(0, writer.Write(std::move(event)));
+
+  // a partial buffer waits for Flush() within the latency bound
+  auto files = ListEventFiles(prefix);
+  ASSERT_EQ(1, files.size());
+  struct stat st;
+  ASSERT_EQ(0, stat(files[0].c_str(), &st));
+  EXPECT_EQ(0, st.st_size);
+
+  EXPECT_EQ(0, writer.Flush());
+  ASSERT_EQ(0, stat(files[0].c_str(), &st));
+  EXPECT_LT(0, st.st_size);
+}
+
+TEST(IoUringFileWriter, Recorder) {
+  Recorder recorder("runs/io_uring_recorder", [](const string& p) -> Writer* {
+                      return new IoUringFileWriter(p);
+                    });
+  ASSERT_TRUE(recorder.Ready());
+
+  for (int64_t i = 0; i < 100; ++i) {
+    EXPECT_LT(0, recorder.AddScalar("io_uring_scalar", 0.01 * i, i));
+  }
+
+  EXPECT_LT(0, recorder.AddText("io_uring_text", "Here is the text!", 0));
+}
+
+}  // namespace nlptk
@@ -0,0 +1,512 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/journal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <utility>
+
+#include "glog/logging.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "record/event_file.h"
+#include "record/file_writer.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+
+// entries are written to the file in chunks of this size
+static const size_t kJournalBufferSize = 1 << 20;
+
+static void WriteString(CodedOutputStream* out, const string& str) {
+  out->WriteVarint32(str.size());
+  out->WriteString(str);
+}
+
+// the sizes of the encoded images, audio and texts of `event`, which are
+// cleared
+static void StripPayloads(tensorboard::Event* event, vector<uint64_t>* sizes) {
+  for (auto& value : *event->mutable_summary()->mutable_value()) {
+    if (value.has_image()) {
+      auto image = value.mutable_image();
+      sizes->push_back(image->encoded_image_string().size());
+      image->clear_encoded_image_string();
+    } else if (value.has_audio()) {
+      auto audio = value.mutable_audio();
+      sizes->push_back(audio->encoded_audio_string().size());
+      audio->clear_encoded_audio_string();
+    } else if (value.has_tensor()) {
+      for (auto& str : *value.mutable_tensor()->mutable_string_val()) {
+        sizes->push_back(str.size());
+        str.clear();
+      }
+    }
+  }
+}
+
+// the reverse of StripPayloads() with filler bytes
+static void FillPayloads(tensorboard::Event* event,
+                         const vector<uint64_t>& sizes) {
+  size_t i = 0;
+  for (auto& value : *event->mutable_summary()->mutable_value()) {
+    if (i >= sizes.size()) {
+      break;
+    }
+
+    if (value.has_image()) {
+      value.mutable_image()->set_encoded_image_string(string(sizes[i++], 'i'));
+    } else if (value.has_audio()) {
+      value.mutable_audio()->set_encoded_audio_string(string(sizes[i++], 'a'));
+    } else if (value.has_tensor()) {
+      for (auto& str : *value.mutable_tensor()->mutable_string_val()) {
+        if (i < sizes.size()) {
+          str.assign(sizes[i++], 't');
+        }
+      }
+    }
+  }
+}
+
+void JournalEntry::Clear() {
+  kind = kWriter;
+  time = 0;
+  duration = 0;
+  thread = 0;
+  writer = 0;
+  prefix.clear();
+  call = kAddScalar;
+  tag.clear();
+  step = -1;
+  count = 0;
+  bytes = 0;
+  width = 0;
+  height = 0;
+  channels = 0;
+  events.clear();
+  head.clear();
+  blob.clear();
+  tail.clear();
+}
+
+Journal::Journal(const string& path, const JournalOptions& options)
+    : path_(path), options_(options), start_(StatsCounters::Now()) {
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed to open journal '" << path << "', due to: "
+               << strerror(errno);
+  }
+}
+
+Journal::~Journal() {
+  Close();
+}
+
+bool Journal::Ready() const {
+  return fd_ >= 0;
+}
+
+int Journal::Close() {
+  std::lock_guard<std::mutex> lock{lock_};
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  int ret = WriteBuffer();
+  close(fd_);
+  fd_ = -1;
+  return ret;
+}
+
+std::function<Writer*(const string&)> Journal::Maker(
+    Journal* journal, std::function<Writer*(const string&)> maker) {
+  return [journal, maker](const string& prefix) -> Writer* {
+    auto writer = maker ? maker(prefix) : new FileWriter(prefix);
+    return new JournalWriter(journal, prefix, writer);
+  };
+}
+
+uint64_t Journal::Start() const {
+  return start_;
+}
+
+void Journal::AddCall(JournalEntry::Call call, const string& tag,
+                      int64_t step, uint64_t count, uint64_t bytes,
+                      int32_t width, int32_t height, int32_t channels) {
+  auto now = StatsCounters::Now();
+  string entry;
+  {
+    StringOutputStream stream(&entry);
+    CodedOutputStream out(&stream);
+    uint8_t kind = JournalEntry::kCall;
+    out.WriteRaw(&kind, 1);
+    out.WriteVarint64(now - start_);
+    out.WriteVarint32(Thread());
+    uint8_t code = call;
+    out.WriteRaw(&code, 1);
+    WriteString(&out, tag);
+    out.WriteVarint64(WireFormatLite::ZigZagEncode64(step));
+    out.WriteVarint64(count);
+    out.WriteVarint64(bytes);
+    out.WriteVarint32(width);
+    out.WriteVarint32(height);
+    out.WriteVarint32(channels);
+  }
+
+  Append(entry);
+}
+
+uint32_t Journal::AddWriter(const string& prefix) {
+  auto id = writers_++;
+  string entry;
+  {
+    StringOutputStream stream(&entry);
+    CodedOutputStream out(&stream);
+    uint8_t kind = JournalEntry::kWriter;
+    out.WriteRaw(&kind, 1);
+    out.WriteVarint64(StatsCounters::Now() - start_);
+    out.WriteVarint32(id);
+    WriteString(&out, prefix);
+  }
+
+  Append(entry);
+  return id;
+}
+
+void Journal::AddWrite(uint32_t writer, JournalEntry::Kind kind,
+                       const char* data, size_t size, size_t records,
+                       uint64_t start) {
+  auto now = StatsCounters::Now();
+  string entry;
+  {
+    StringOutputStream stream(&entry);
+    CodedOutputStream out(&stream);
+    uint8_t code = kind;
+    out.WriteRaw(&code, 1);
+    out.WriteVarint64(start - start_);
+    out.WriteVarint32(writer);
+    out.WriteVarint64(now - start);
+    out.WriteVarint32(records);
+
+    // `data` holds framed records
+    size_t pos = 0;
+    string stripped;
+    vector<uint64_t> sizes;
+    for (size_t i = 0; i < records; ++i) {
+      uint64_t len = 0;
+      if (pos + kRecordHeaderSize + kRecordFooterSize > size) {
+        break;
+      }
+
+      memcpy(&len, data + pos, sizeof(len));
+      const char* event = data + pos + kRecordHeaderSize;
+      pos += kRecordHeaderSize + len + kRecordFooterSize;
+      sizes.clear();
+      tensorboard::Event parsed;
+      if (options_.synthesize_payloads && parsed.ParseFromArray(event, len)) {
+        StripPayloads(&parsed, &sizes);
+        parsed.SerializeToString(&stripped);
+        event = stripped.data();
+        len = stripped.size();
+      }
+
+      out.WriteVarint32(len);
+      out.WriteRaw(event, len);
+      out.WriteVarint32(sizes.size());
+      for (auto payload : sizes) {
+        out.WriteVarint64(payload);
+      }
+    }
+  }
+
+  Append(entry);
+}
+
+void Journal::AddWriteBlob(uint32_t writer, const string& head,
+                           const Blob& blob, const string& tail,
+                           uint64_t start) {
+  auto now = StatsCounters::Now();
+  string entry;
+  {
+    StringOutputStream stream(&entry);
+    CodedOutputStream out(&stream);
+    uint8_t kind = JournalEntry::kWriteBlob;
+    out.WriteRaw(&kind, 1);
+    out.WriteVarint64(start - start_);
+    out.WriteVarint32(writer);
+    out.WriteVarint64(now - start);
+    WriteString(&out, head);
+    WriteString(&out, tail);
+    out.WriteVarint64(blob.size());
+    uint8_t synthesized = options_.synthesize_payloads;
+    out.WriteRaw(&synthesized, 1);
+    if (!synthesized) {
+      out.WriteRaw(blob.data(), blob.size());
+    }
+  }
+
+  Append(entry);
+}
+
+void Journal::AddFlush(uint32_t writer, uint64_t start) {
+  auto now = StatsCounters::Now();
+  string entry;
+  {
+    StringOutputStream stream(&entry);
+    CodedOutputStream out(&stream);
+    uint8_t kind = JournalEntry::kFlush;
+    out.WriteRaw(&kind, 1);
+    out.WriteVarint64(start - start_);
+    out.WriteVarint32(writer);
+    out.WriteVarint64(now - start);
+  }
+
+  Append(entry);
+}
+
+void Journal::Append(const string& entry) {
+  std::lock_guard<std::mutex> lock{lock_};
+  if (fd_ < 0) {
+    return;
+  }
+
+  AppendRecord(entry.data(), entry.size(), &buffer_);
+  if (buffer_.size() >= kJournalBufferSize) {
+    WriteBuffer();
+  }
+}
+
+int Journal::WriteBuffer() {
+  const char* data = buffer_.data();
+  size_t left = buffer_.size();
+  while (left > 0) {
+    auto n = write(fd_, data, left);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (n < 0) {
+      LOG(ERROR) << "Failed to write journal '" << path_ << "', due to: "
+                 << strerror(errno);
+      break;
+    }
+
+    data += n;
+    left -= n;
+  }
+
+  buffer_.clear();
+  return left > 0 ? -1 : 0;
+}
+
+uint32_t Journal::Thread() {
+  // ids are given out per journal, in the order threads first log
+  thread_local const Journal* journal = nullptr;
+  thread_local uint32_t id = 0;
+  if (journal != this) {
+    journal = this;
+    id = threads_++;
+  }
+
+  return id;
+}
+
+JournalWriter::JournalWriter(Journal* journal, const string& prefix,
+                             Writer* writer)
+    : journal_(journal), id_(journal->AddWriter(prefix)), writer_(writer) {
+}
+
+int JournalWriter::Write(tensorboard::Event&& event) {
+  // framed for the journal only, the event goes to the writer as it is
+  string record;
+  string buf;
+  event.SerializeToString(&buf);
+  AppendRecord(buf.data(), buf.size(), &record);
+
+  auto start = StatsCounters::Now();
+  auto ret = writer_->Write(std::move(event));
+  journal_->AddWrite(id_, JournalEntry::kWrite, record.data(), record.size(),
+                     1, start);
+  return ret;
+}
+
+int JournalWriter::WriteRecords(const char* data, size_t size,
+                                size_t records) {
+  auto start = StatsCounters::Now();
+  auto ret = writer_->WriteRecords(data, size, records);
+  journal_->AddWrite(id_, JournalEntry::kWriteRecords, data, size, records,
+                     start);
+  return ret;
+}
+
+int JournalWriter::WriteBlob(const string& head, Blob&& blob,
+                             const string& tail) {
+  // the blob is gone once written, so it is journaled before
+  auto start = StatsCounters::Now();
+  journal_->AddWriteBlob(id_, head, blob, tail, start);
+  return writer_->WriteBlob(head, std::move(blob), tail);
+}
+
+void JournalWriter::SetMemoryBudget(MemoryBudget* budget) {
+  writer_->SetMemoryBudget(budget);
+}
+
+int JournalWriter::Flush() {
+  auto start = StatsCounters::Now();
+  auto ret = writer_->Flush();
+  journal_->AddFlush(id_, start);
+  return ret;
+}
+
+int JournalWriter::Close() {
+  return writer_->Close();
+}
+
+int JournalWriter::Ready() const {
+  return writer_->Ready();
+}
+
+int JournalWriter::Suspend() {
+  return writer_->Suspend();
+}
+
+int64_t JournalWriter::LastStep(const string& tag) const {
+  return writer_->LastStep(tag);
+}
+
+WriterStats JournalWriter::Stats() const {
+  return writer_->Stats();
+}
+
+JournalReader::JournalReader(const string& path) : reader_(path) {
+}
+
+bool JournalReader::Ready() const {
+  return reader_.Ready();
+}
+
+// the payloads and blobs left out of a journal are rebuilt by their size,
+// which cannot exceed that of a protobuf message
+static const uint64_t kMaxSynthesizedBytes = INT_MAX;
+
+static bool ReadString(CodedInputStream* in, string* str) {
+  uint32_t size = 0;
+  return in->ReadVarint32(&size) && in->ReadString(str, size);
+}
+
+int JournalReader::Next(JournalEntry* entry) {
+  const char* data = nullptr;
+  size_t size = 0;
+  auto ret = reader_.Next(&data, &size);
+  if (ret <= 0) {
+    return ret;
+  }
+
+  entry->Clear();
+  CodedInputStream in(reinterpret_cast<const uint8_t*>(data), size);
+  in.SetTotalBytesLimit(INT_MAX);
+  uint8_t kind = 0;
+  uint64_t step = 0;
+  uint32_t records = 0;
+  uint32_t shape[3] = {0, 0, 0};
+  bool ok = in.ReadRaw(&kind, 1) && in.ReadVarint64(&entry->time);
+  entry->kind = static_cast<JournalEntry::Kind>(kind);
+  switch (entry->kind) {
+    case JournalEntry::kWriter:
+      ok = ok && in.ReadVarint32(&entry->writer) &&
+           ReadString(&in, &entry->prefix);
+      break;
+    case JournalEntry::kCall:
+      ok = ok && in.ReadVarint32(&entry->thread) && in.ReadRaw(&kind, 1) &&
+           ReadString(&in, &entry->tag) && in.ReadVarint64(&step) &&
+           in.ReadVarint64(&entry->count) && in.ReadVarint64(&entry->bytes) &&
+           in.ReadVarint32(&shape[0]) && in.ReadVarint32(&shape[1]) &&
+           in.ReadVarint32(&shape[2]);
+      entry->call = static_cast<JournalEntry::Call>(kind);
+      entry->step = WireFormatLite::ZigZagDecode64(step);
+      entry->width = shape[0];
+      entry->height = shape[1];
+      entry->channels = shape[2];
+      break;
+    case JournalEntry::kWrite:
+    case JournalEntry::kWriteRecords:
+      ok = ok && in.ReadVarint32(&entry->writer) &&
+           in.ReadVarint64(&entry->duration) && in.ReadVarint32(&records);
+      for (uint32_t i = 0; ok && i < records; ++i) {
+        string event;
+        uint32_t payloads = 0;
+        ok = ReadString(&in, &event) && in.ReadVarint32(&payloads) &&
+             payloads <= size - in.CurrentPosition();   // a byte at least
+        vector<uint64_t> sizes(ok ? payloads : 0);
+        uint64_t total = 0;
+        for (auto& payload : sizes) {
+          ok = ok && in.ReadVarint64(&payload) &&
+               payload <= kMaxSynthesizedBytes - total;
+          total += ok ? payload : 0;
+        }
+
+        tensorboard::Event parsed;
+        if (ok && !sizes.empty() && parsed.ParseFromString(event)) {
+          FillPayloads(&parsed, sizes);
+          parsed.SerializeToString(&event);
+        }
+
+        entry->events.push_back(std::move(event));
+      }
+      break;
+    case JournalEntry::kWriteBlob: {
+      uint64_t blob_size = 0;
+      uint8_t synthesized = 0;
+      ok = ok && in.ReadVarint32(&entry->writer) &&
+           in.ReadVarint64(&entry->duration) &&
+           ReadString(&in, &entry->head) && ReadString(&in, &entry->tail) &&
+           in.ReadVarint64(&blob_size) && in.ReadRaw(&synthesized, 1) &&
+           blob_size <= (synthesized ? kMaxSynthesizedBytes
+                                     : size - in.CurrentPosition());
+      if (ok && synthesized) {
+        entry->blob.assign(blob_size, 'b');
+      } else {
+        ok = ok && in.ReadString(&entry->blob, blob_size);
+      }
+      break;
+    }
+    case JournalEntry::kFlush:
+      ok = ok && in.ReadVarint32(&entry->writer) &&
+           in.ReadVarint64(&entry->duration);
+      break;
+    default:
+      ok = false;
+  }
+
+  if (!ok) {
+    LOG(ERROR) << "Corrupted journal entry of kind " << static_cast<int>(kind);
+    return -1;
+  }
+
+  return 1;
+}
+
+}  // namespace nlptk
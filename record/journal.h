@@ -0,0 +1,212 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_JOURNAL_H_
+#define RECORD_JOURNAL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+
+#include "record/event_reader.h"
+#include "record/writer.h"
+
+namespace nlptk {
+
+class JournalOptions {
+ public:
+  // Journals the encoded images, audio and texts by their sizes only, the
+  // replay writes filler bytes of the same sizes instead.
+  bool    synthesize_payloads{false};
+};
+
+// An entry of a journal. Times are nanoseconds since the journal started.
+class JournalEntry {
+ public:
+  enum Kind : uint8_t {
+    kWriter = 1,      // a writer `writer` of `prefix` was created
+    kCall,            // Recorder::Add* `call`
+    kWrite,           // Writer::Write of `events[0]`
+    kWriteRecords,    // Writer::WriteRecords of `events`
+    kWriteBlob,       // Writer::WriteBlob of `head`, `blob` and `tail`
+    kFlush,           // Writer::Flush
+  };
+
+  enum Call : uint8_t {
+    kAddScalar = 0,
+    kAddScalars,
+    kAddHistogram,
+    kAddHistogramRaw,
+    kAddImage,
+    kAddImages,
+    kAddAudio,
+    kAddText,
+    kAddEmbedding,
+  };
+
+  void Clear();
+
+ public:
+  Kind                      kind{kWriter};
+  uint64_t                  time{0};
+  // how long the call into the writer took
+  uint64_t                  duration{0};
+  uint32_t                  thread{0};
+  uint32_t                  writer{0};
+  std::string               prefix;
+
+  Call                      call{kAddScalar};
+  std::string               tag;
+  int64_t                   step{-1};
+  // scalars, histogram values or buckets, images or embedding points
+  uint64_t                  count{0};
+  // bytes of the values or encoded payloads of the call
+  uint64_t                  bytes{0};
+  // the ImageMetadata of images
+  int32_t                   width{0};
+  int32_t                   height{0};
+  int32_t                   channels{0};
+
+  // serialized events, payloads are filled in when synthesized
+  std::vector<std::string>  events;
+  std::string               head;
+  std::string               blob;
+  std::string               tail;
+};
+
+// Captures the Add* calls of a Recorder and the events they result in into
+// a compact binary journal, to benchmark writers and encoders against the
+// logging patterns of real jobs, see bench/journal_replay.cc:
+//
+//   Journal journal("job.journal");
+//   Recorder recorder(dir, Journal::Maker(&journal));
+//   recorder.SetJournal(&journal);
+//
+// Entries are varint encoded and framed as TFRecords. Journaling is guarded
+// by a lock and meant for capture runs, not for every job.
+class Journal {
+ public:
+  explicit Journal(const std::string& path,
+                   const JournalOptions& options = JournalOptions());
+
+  ~Journal();
+
+  bool Ready() const;
+
+  int Close();
+
+  // A Recorder::WriterMaker wrapping the writers of `maker`, FileWriter by
+  // default, into JournalWriter.
+  static std::function<Writer*(const std::string&)> Maker(
+      Journal* journal,
+      std::function<Writer*(const std::string&)> maker = nullptr);
+
+  void AddCall(JournalEntry::Call call, const std::string& tag, int64_t step,
+               uint64_t count, uint64_t bytes, int32_t width = 0,
+               int32_t height = 0, int32_t channels = 0);
+
+  // returns the id of the writer
+  uint32_t AddWriter(const std::string& prefix);
+
+  // the events of `data` are journaled, with their payloads stripped
+  // if synthesized
+  void AddWrite(uint32_t writer, JournalEntry::Kind kind, const char* data,
+                size_t size, size_t records, uint64_t start);
+
+  void AddWriteBlob(uint32_t writer, const std::string& head,
+                    const Blob& blob, const std::string& tail,
+                    uint64_t start);
+
+  void AddFlush(uint32_t writer, uint64_t start);
+
+  // StatsCounters::Now() of the journal start
+  uint64_t Start() const;
+
+ private:
+  // appends an entry framed as a record under lock_
+  void Append(const std::string& entry);
+
+  // writes and clears buffer_ under lock_
+  int WriteBuffer();
+
+  // a small id of the calling thread
+  uint32_t Thread();
+
+ private:
+  std::string           path_;
+  JournalOptions        options_;
+  int                   fd_{-1};
+  uint64_t              start_{0};
+  std::string           buffer_;
+  std::atomic<uint32_t> writers_{0};
+  std::atomic<uint32_t> threads_{0};
+  std::mutex            lock_;
+};
+
+// Writes into another writer and journals every write into it.
+class JournalWriter : public Writer {
+ public:
+  // takes `writer` over
+  JournalWriter(Journal* journal, const std::string& path_prefix,
+                Writer* writer);
+
+  int Write(tensorboard::Event&& event) override;
+
+  int WriteRecords(const char* data, size_t size, size_t records) override;
+
+  int WriteBlob(const std::string& head, Blob&& blob,
+                const std::string& tail) override;
+
+  void SetMemoryBudget(MemoryBudget* budget) override;
+
+  int Flush() override;
+
+  int Close() override;
+
+  int Ready() const override;
+
+  int Suspend() override;
+
+  int64_t LastStep(const std::string& tag) const override;
+
+  WriterStats Stats() const override;
+
+ private:
+  Journal*                  journal_;
+  uint32_t                  id_;
+  std::unique_ptr<Writer>   writer_;
+};
+
+// Reads the entries of a journal back.
+class JournalReader {
+ public:
+  explicit JournalReader(const std::string& path);
+
+  bool Ready() const;
+
+  // Returns 1 and the next entry, 0 at the end of the journal and -1 on a
+  // corrupted entry.
+  int Next(JournalEntry* entry);
+
+ private:
+  EventReader   reader_;
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_JOURNAL_H_
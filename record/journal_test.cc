@@ -0,0 +1,197 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/journal.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "record/event_file.h"
+#include "record/recorder.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+// journals a recorder logging scalars, a text and images, returns the
+// entries read back
+static vector<JournalEntry> Capture(const string& dir, bool synthesize) {
+  MakeDirs(dir);
+  JournalOptions options;
+  options.synthesize_payloads = synthesize;
+  {
+    Journal journal(dir + "/journal", options);
+    EXPECT_TRUE(journal.Ready());
+    Recorder recorder(dir, Journal::Maker(&journal));
+    EXPECT_TRUE(recorder.Ready());
+    recorder.SetJournal(&journal);
+    for (int64_t i = 0; i < 10; ++i) {
+      recorder.AddScalar("loss", 0.1 * i, i);
+    }
+
+    recorder.AddText("note", string(100, 'n'), 10);
+    recorder.AddImage("img", string(1000, 'p'), {10, 10, 3}, 10);
+    recorder.AddImage("img", Blob(string(2000, 'q')), {20, 10, 3}, 11);
+    recorder.Flush();
+  }
+
+  vector<JournalEntry> entries;
+  JournalReader reader(dir + "/journal");
+  EXPECT_TRUE(reader.Ready());
+  JournalEntry entry;
+  int ret = 0;
+  while ((ret = reader.Next(&entry)) > 0) {
+    entries.push_back(entry);
+  }
+
+  EXPECT_EQ(0, ret);
+  return entries;
+}
+
+TEST(Journal, Capture) {
+  auto entries = Capture("runs/journal", false);
+  int calls = 0;
+  int flushes = 0;
+  vector<tensorboard::Event> events;
+  vector<string> blobs;
+  uint64_t time = 0;
+  for (const auto& entry : entries) {
+    EXPECT_LE(time, entry.time + entry.duration);
+    time = entry.time;
+    switch (entry.kind) {
+      case JournalEntry::kWriter:
+        EXPECT_EQ(0, entry.writer);
+        EXPECT_EQ("runs/journal", entry.prefix.substr(0, 12));
+        break;
+      case JournalEntry::kCall:
+        EXPECT_EQ(0, entry.thread);
+        if (calls < 10) {
+          EXPECT_EQ(JournalEntry::kAddScalar, entry.call);
+          EXPECT_EQ("loss", entry.tag);
+          EXPECT_EQ(calls, entry.step);
+        } else if (calls == 10) {
+          EXPECT_EQ(JournalEntry::kAddText, entry.call);
+          EXPECT_EQ(100, entry.bytes);
+        } else {
+          EXPECT_EQ(JournalEntry::kAddImage, entry.call);
+          EXPECT_EQ(calls == 11 ? 1000 : 2000, entry.bytes);
+          EXPECT_EQ(calls == 11 ? 10 : 20, entry.width);
+          EXPECT_EQ(10, entry.height);
+          EXPECT_EQ(3, entry.channels);
+        }
+        ++calls;
+        break;
+      case JournalEntry::kWrite:
+      case JournalEntry::kWriteRecords:
+        for (const auto& data : entry.events) {
+          events.emplace_back();
+          EXPECT_TRUE(events.back().ParseFromString(data));
+        }
+        break;
+      case JournalEntry::kWriteBlob:
+        EXPECT_LT(0, entry.head.size());
+        blobs.push_back(entry.blob);
+        break;
+      case JournalEntry::kFlush:
+        ++flushes;
+        break;
+    }
+  }
+
+  EXPECT_EQ(13, calls);
+  EXPECT_EQ(1, flushes);
+  // the scalars and the text, images are written as blobs
+  ASSERT_EQ(11, events.size());
+  EXPECT_EQ("loss", events[0].summary().value(0).tag());
+  EXPECT_EQ(9, events[9].step());
+  EXPECT_EQ(vector<string>({string(1000, 'p'), string(2000, 'q')}), blobs);
+}
+
+TEST(Journal, SynthesizedPayloads) {
+  auto entries = Capture("runs/journal_synthesized", true);
+  vector<tensorboard::Event> events;
+  vector<string> blobs;
+  for (const auto& entry : entries) {
+    for (const auto& data : entry.events) {
+      events.emplace_back();
+      EXPECT_TRUE(events.back().ParseFromString(data));
+    }
+
+    if (entry.kind == JournalEntry::kWriteBlob) {
+      blobs.push_back(entry.blob);
+    }
+  }
+
+  ASSERT_EQ(11, events.size());
+  EXPECT_EQ(0.9f, events[9].summary().value(0).simple_value());
+  const auto& text = events[10].summary().value(0).tensor().string_val(0);
+  EXPECT_EQ(string(100, 't'), text);
+  EXPECT_EQ(vector<string>({string(1000, 'b'), string(2000, 'b')}), blobs);
+}
+
+TEST(Journal, AddImages) {
+  string dir = "runs/journal_images";
+  MakeDirs(dir);
+  {
+    Journal journal(dir + "/journal");
+    ASSERT_TRUE(journal.Ready());
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+    recorder.SetJournal(&journal);
+    vector<string> images = {string(100, 'p'), string(300, 'q')};
+    recorder.AddImages("img", images, {10, 10, 1}, 0);
+    recorder.SetJournal(nullptr);
+    recorder.AddImages("img", images, {10, 10, 1}, 1);
+  }
+
+  JournalReader reader(dir + "/journal");
+  JournalEntry entry;
+  ASSERT_EQ(1, reader.Next(&entry));
+  EXPECT_EQ(JournalEntry::kAddImages, entry.call);
+  EXPECT_EQ(2, entry.count);
+  EXPECT_EQ(400, entry.bytes);
+  EXPECT_EQ(10, entry.width);
+  EXPECT_EQ(10, entry.height);
+  EXPECT_EQ(1, entry.channels);
+  EXPECT_EQ(0, reader.Next(&entry));
+}
+
+TEST(Journal, Corrupted) {
+  // a blob of 2^40 synthesized bytes, then a record of 2^28 - 1 payloads
+  const string entries[] = {
+    string("\x05\x00\x00\x00\x00\x00\x80\x80\x80\x80\x80\x20\x01", 13),
+    string("\x03\x00\x00\x00\x01\x00\xff\xff\xff\x7f\x01", 11),
+  };
+
+  for (const auto& data : entries) {
+    string buf;
+    AppendRecord(data.data(), data.size(), &buf);
+    string path = "runs/journal_corrupted";
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_NE(nullptr, file);
+    ASSERT_EQ(1, fwrite(buf.data(), buf.size(), 1, file));
+    fclose(file);
+
+    JournalReader reader(path);
+    ASSERT_TRUE(reader.Ready());
+    JournalEntry entry;
+    EXPECT_EQ(-1, reader.Next(&entry));
+  }
+}
+
+}  // namespace nlptk
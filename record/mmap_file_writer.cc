@@ -0,0 +1,380 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/mmap_file_writer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "glog/logging.h"
+#include "record/crc.h"
+#include "record/event_file.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+
+using Mode = DurabilityPolicy::Mode;
+
+MmapFileWriter::MmapFileWriter(const string& prefix, size_t extent_size,
+                               const DurabilityPolicy& durability)
+    : path_(EventFilePath(prefix)), durability_(durability) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  extent_size_ = std::max(extent_size, page);
+  extent_size_ = (extent_size_ + page - 1) / page * page;
+
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+             S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed create record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return;
+  }
+
+  if (Map(0, &current_) < 0) {
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  want_spare_ = true;
+  worker_ = std::thread(&MmapFileWriter::SyncExtents, this);
+
+  tensorboard::Event event;
+  event.set_wall_time(Timestamp());
+  event.set_file_version("brain.Event:2");
+  string buf;
+  event.SerializeToString(&buf);
+  Write(buf.data(), buf.size());
+}
+
+MmapFileWriter::~MmapFileWriter() {
+  Close();
+}
+
+int MmapFileWriter::Write(tensorboard::Event&& event) {
+  if (!Ready()) {
+    return -1;
+  }
+
+  auto start = StatsCounters::Now();
+  string buf;
+  event.SerializeToString(&buf);
+  stats_.Add(StatsCounters::kSerializeNanos, StatsCounters::Now() - start);
+  if (Write(buf.data(), buf.size()) < 0 || Commit(false) < 0) {
+    return -1;
+  }
+
+  stats_.Add(StatsCounters::kEvents, 1);
+  stats_.Add(StatsCounters::kBytes, kRecordHeaderSize + buf.size() +
+                                        kRecordFooterSize);
+  return buf.size();
+}
+
+int MmapFileWriter::WriteRecords(const char* data, size_t size,
+                                 size_t records) {
+  if (!Ready() || size == 0) {
+    return -1;
+  }
+
+  if (Append(&data, &size, 1, records) < 0 || Commit(false) < 0) {
+    return -1;
+  }
+
+  stats_.Add(StatsCounters::kEvents, records);
+  stats_.Add(StatsCounters::kBytes, size);
+  return size;
+}
+
+int MmapFileWriter::WriteBlob(const string& head, Blob&& blob,
+                              const string& tail) {
+  if (!Ready()) {
+    return -1;
+  }
+
+  uint64_t len = head.size() + blob.size() + tail.size();
+  char header[kRecordHeaderSize];
+  memcpy(header, &len, sizeof(len));
+  uint32_t crc = MaskedCRC32c(header, sizeof(len));
+  memcpy(header + sizeof(len), &crc, sizeof(crc));
+  crc = ExtendCRC32c(CRC32c(head.data(), head.size()), blob.data(),
+                     blob.size());
+  crc = MaskCRC32c(ExtendCRC32c(crc, tail.data(), tail.size()));
+
+  const char* parts[] = {header, head.data(), blob.data(), tail.data(),
+                         reinterpret_cast<const char*>(&crc)};
+  const size_t sizes[] = {sizeof(header), head.size(), blob.size(),
+                          tail.size(), sizeof(crc)};
+  if (Append(parts, sizes, 5, 1) < 0) {
+    return -1;
+  }
+
+  blob.Reset();
+  if (Commit(false) < 0) {
+    return -1;
+  }
+
+  stats_.Add(StatsCounters::kEvents, 1);
+  stats_.Add(StatsCounters::kBytes, kRecordHeaderSize + len +
+                                        kRecordFooterSize);
+  return len;
+}
+
+int MmapFileWriter::Flush() {
+  if (!Ready()) {
+    return -1;
+  }
+
+  return Commit(true);
+}
+
+int MmapFileWriter::Close() {
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{locker_};
+    stop_ = true;
+    wakeup_.notify_one();
+  }
+
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+
+  int ret = failed_ ? -1 : 0;
+  for (auto extent : {current_, spare_}) {
+    if (extent.data != nullptr) {
+      msync(extent.data, extent_size_, MS_SYNC);
+      munmap(extent.data, extent_size_);
+    }
+  }
+
+  current_ = Extent();
+  spare_ = Extent();
+  if (ftruncate(fd_, length_) != 0) {
+    LOG(ERROR) << "Failed to truncate record file '" << path_ << "', due to: "
+               << strerror(errno);
+    ret = -1;
+  }
+
+  close(fd_);
+  fd_ = -1;
+  return ret;
+}
+
+int MmapFileWriter::Ready() const {
+  return fd_ >= 0 && !failed_;
+}
+
+int MmapFileWriter::Write(const char* data, size_t size) {
+  char header[kRecordHeaderSize];
+  uint64_t len = size;
+  memcpy(header, &len, sizeof(len));
+  uint32_t crc = MaskedCRC32c(header, sizeof(len));
+  memcpy(header + sizeof(len), &crc, sizeof(crc));
+  uint32_t footer = MaskedCRC32c(data, size);
+
+  const char* parts[] = {header, data, reinterpret_cast<const char*>(&footer)};
+  const size_t sizes[] = {sizeof(header), size, sizeof(footer)};
+  return Append(parts, sizes, 3, 1);
+}
+
+int MmapFileWriter::Append(const char* const* parts, const size_t* sizes,
+                           int count, size_t records) {
+  size_t used = used_;
+  uint64_t total = 0;
+  for (int i = 0; i < count; ++i) {
+    const char* cur = parts[i];
+    size_t left = sizes[i];
+    while (left > 0) {
+      if (used == extent_size_) {
+        if (NextExtent() < 0) {
+          return -1;
+        }
+
+        used = 0;
+      }
+
+      auto n = std::min(left, extent_size_ - used);
+      memcpy(current_.data + used, cur, n);
+      used += n;
+      cur += n;
+      left -= n;
+    }
+
+    total += sizes[i];
+  }
+
+  // the group commit deadline is the only one which needs the clock
+  if (unsynced_ == 0 && durability_.mode == Mode::kGroupCommit &&
+      durability_.group_millis > 0) {
+    unsynced_since_ = Clock::now();
+  }
+
+  used_ = used;
+  length_ += total;
+  unsynced_ += records;
+  return 0;
+}
+
+int MmapFileWriter::Commit(bool force) {
+  switch (durability_.mode) {
+    case Mode::kNone:
+    case Mode::kBuffered:
+      // start the writeback of the records, they are in the page cache
+      if (force && msync(current_.data, used_, MS_ASYNC) != 0) {
+        LOG(ERROR) << "Failed to sync record file '" << path_
+                   << "', due to: " << strerror(errno);
+        return -1;
+      }
+
+      return 0;
+
+    case Mode::kGroupCommit: {
+      if (unsynced_ == 0) {
+        return 0;
+      }
+
+      auto millis = std::chrono::milliseconds(durability_.group_millis);
+      if (force ||
+          (durability_.group_records == 0 && durability_.group_millis == 0) ||
+          (durability_.group_records > 0 &&
+           unsynced_ >= durability_.group_records) ||
+          (durability_.group_millis > 0 &&
+           Clock::now() >= unsynced_since_ + millis)) {
+        return Sync();
+      }
+
+      return 0;
+    }
+
+    case Mode::kSync:
+      return unsynced_ > 0 ? Sync() : 0;
+  }
+
+  return 0;
+}
+
+int MmapFileWriter::Sync() {
+  int ret = 0;
+  if (synced_ < current_.offset) {
+    // part of the records is in retired extents, which the background
+    // thread may be unmapping, sync them through the file
+    ret = fdatasync(fd_);
+  } else {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = (synced_ - current_.offset) / page * page;
+    ret = msync(current_.data + begin, used_ - begin, MS_SYNC);
+  }
+
+  if (ret != 0) {
+    LOG(ERROR) << "Failed to sync record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  synced_ = length_;
+  unsynced_ = 0;
+  return 0;
+}
+
+int MmapFileWriter::NextExtent() {
+  std::unique_lock<std::mutex> lock{locker_};
+  retired_.push_back(current_);
+  ready_.wait(lock, [&] { return spare_.data != nullptr || failed_; });
+  if (failed_) {
+    current_ = Extent();
+    return -1;
+  }
+
+  current_ = spare_;
+  spare_ = Extent();
+  want_spare_ = true;
+  wakeup_.notify_one();
+  return 0;
+}
+
+int MmapFileWriter::SyncExtents() {
+  std::unique_lock<std::mutex> lock{locker_};
+  while (true) {
+    wakeup_.wait(lock, [&] {
+      return stop_ || !retired_.empty() || want_spare_;
+    });
+
+    if (want_spare_ && !stop_) {
+      want_spare_ = false;
+      auto offset = current_.offset + extent_size_;
+      lock.unlock();
+
+      Extent spare;
+      auto ret = Map(offset, &spare);
+
+      lock.lock();
+      spare_ = spare;
+      if (ret < 0) {
+        failed_.store(true);
+      }
+      ready_.notify_all();
+    }
+
+    while (!retired_.empty()) {
+      auto extent = retired_.front();
+      retired_.pop_front();
+      lock.unlock();
+
+      msync(extent.data, extent_size_, MS_SYNC);
+      munmap(extent.data, extent_size_);
+
+      lock.lock();
+    }
+
+    if (stop_) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+int MmapFileWriter::Map(uint64_t offset, Extent* extent) {
+  if (fallocate(fd_, 0, offset, extent_size_) != 0 &&
+      ftruncate(fd_, offset + extent_size_) != 0) {
+    LOG(ERROR) << "Failed to allocate record file '" << path_
+               << "', due to: " << strerror(errno);
+    return -1;
+  }
+
+  void* data = mmap(nullptr, extent_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, offset);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Failed to map record file '" << path_ << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  madvise(data, extent_size_, MADV_SEQUENTIAL);
+  extent->data = static_cast<char*>(data);
+  extent->offset = offset;
+  return 0;
+}
+
+}  // namespace nlptk
@@ -0,0 +1,120 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_MMAP_FILE_WRITER_H_
+#define RECORD_MMAP_FILE_WRITER_H_
+
+#include <atomic>
+#include <chrono>                 // NOLINT(build/c++11)
+#include <condition_variable>     // NOLINT(build/c++11)
+#include <cstdint>
+#include <deque>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <string>
+#include <thread>                 // NOLINT(build/c++11)
+
+#include "record/writer.h"
+
+namespace nlptk {
+
+// Preallocates the event file in extents of `extent_size` bytes and copies
+// framed records into a shared mapping of the current extent, so writing a
+// record is a plain memcpy. A background thread maps the next extent ahead
+// of time and msyncs and unmaps the filled ones. The records stay in the
+// page cache if the process crashes.
+//
+// Until Close() truncates the file to its logical length, readers see the
+// preallocated zeros behind the last record as a truncated record.
+//
+// The copied records are in the page cache, which meets the kNone and
+// kBuffered durability policies as soon as they are written; Flush() only
+// starts their writeback. kGroupCommit and kSync msync them synchronously.
+class MmapFileWriter : public Writer {
+ public:
+  explicit MmapFileWriter(const std::string& path_prefix,
+                          size_t extent_size = 64 << 20,
+                          const DurabilityPolicy& durability =
+                              DurabilityPolicy());
+
+  ~MmapFileWriter();
+
+  int Write(tensorboard::Event&& event) override;
+
+  // copies the framed batch straight into the mapping
+  int WriteRecords(const char* data, size_t size, size_t records) override;
+
+  int WriteBlob(const std::string& head, Blob&& blob,
+                const std::string& tail) override;
+
+  int Flush() override;
+
+  int Close() override;
+
+  int Ready() const override;
+
+ protected:
+  int Write(const char* data, size_t size);
+
+  // copies the `count` byte ranges of `records` records into the mapping,
+  // the file only grows once all of them are copied
+  int Append(const char* const* parts, const size_t* sizes, int count,
+             size_t records);
+
+  // applies the durability policy, `force` on Flush()
+  int Commit(bool force);
+
+  // msyncs the records written since the last sync
+  int Sync();
+
+  int NextExtent();
+
+  int SyncExtents();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  class Extent {
+   public:
+    char*       data{nullptr};
+    uint64_t    offset{0};
+  };
+
+  int Map(uint64_t offset, Extent* extent);
+
+  std::string               path_;
+  int                       fd_{-1};
+  size_t                    extent_size_;
+  Extent                    current_;
+  size_t                    used_{0};       // bytes used of current extent
+  uint64_t                  length_{0};     // logical length of the file
+  DurabilityPolicy          durability_;
+  uint64_t                  synced_{0};     // length at the last sync
+  uint64_t                  unsynced_{0};   // records since the last sync
+  Clock::time_point         unsynced_since_;
+  std::atomic<bool>         failed_{false};
+
+  // state shared with the background thread
+  Extent                    spare_;
+  bool                      want_spare_{false};
+  std::deque<Extent>        retired_;
+  bool                      stop_{false};
+  std::thread               worker_;
+  std::mutex                locker_{};
+  std::condition_variable   wakeup_;
+  std::condition_variable   ready_;
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_MMAP_FILE_WRITER_H_
@@ -0,0 +1,138 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/mmap_file_writer.h"
+
+#include <string>
+#include <utility>
+
+#include "gtest/gtest.h"
+#include "record/event_file.h"
+#include "record/event_reader.h"
+#include "record/recorder.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+
+TEST(MmapFileWriter, Write) {
+  ASSERT_EQ(0, MakeDirs("runs/mmap"));
+  uint64_t length = 0;
+  {
+    // small extents, so records cross extent boundaries
+    MmapFileWriter writer("runs/mmap/events", 4096);
+    ASSERT_TRUE(writer.Ready());
+
+    for (int64_t i = 0; i < 1000; ++i) {
+      tensorboard::Event event;
+      event.set_wall_time(Timestamp());
+      event.set_step(i);
+      auto v = event.mutable_summary()->add_value();
+      v->set_tag("loss");
+      v->set_simple_value(0.1 * i);
+      auto size = writer.Write(std::move(event));
+      ASSERT_LT(0, size);
+      length += size + kRecordHeaderSize + kRecordFooterSize;
+    }
+
+    EXPECT_EQ(0, writer.Flush());
+    EXPECT_EQ(0, writer.Close());
+  }
+
+  auto files = ListEventFiles("runs/mmap/events");
+  ASSERT_EQ(1, files.size());
+
+  EventReader reader(files[0]);
+  ASSERT_TRUE(reader.Ready());
+
+  tensorboard::Event event;
+  ASSERT_EQ(1, reader.Next(&event));
+  EXPECT_EQ("brain.Event:2", event.file_version());
+  EXPECT_EQ(length, reader.Size() - reader.Offset());
+
+  int64_t step = 0;
+  while (reader.Next(&event) > 0) {
+    EXPECT_EQ(step++, event.step());
+  }
+
+  EXPECT_EQ(1000, step);
+  EXPECT_EQ(reader.Size(), reader.Offset());
+}
+
+static void WriteBatches(const string& dir, DurabilityPolicy::Mode mode) {
+  ASSERT_EQ(0, MakeDirs(dir));
+  auto prefix = JoinPath(dir, "events");
+  {
+    DurabilityPolicy durability;
+    durability.mode = mode;
+    durability.group_records = 8;
+    MmapFileWriter writer(prefix, 4096, durability);
+    ASSERT_TRUE(writer.Ready());
+
+    for (int64_t i = 0; i < 100; ++i) {
+      string records;
+      for (int64_t j = 0; j < 10; ++j) {
+        tensorboard::Event event;
+        event.set_step(i * 10 + j);
+        string buf;
+        event.SerializeToString(&buf);
+        AppendRecord(buf.data(), buf.size(), &records);
+      }
+
+      EXPECT_EQ(records.size(),
+                writer.WriteRecords(records.data(), records.size(), 10));
+
+      tensorboard::Event event;
+      event.set_step(i);
+      string head;
+      event.SerializeToString(&head);
+      EXPECT_EQ(head.size() + 1000,
+                writer.WriteBlob(head, Blob(string(1000, 'x')), ""));
+    }
+
+    EXPECT_EQ(0, writer.Flush());
+    EXPECT_EQ(0, writer.Close());
+  }
+
+  auto files = ListEventFiles(prefix);
+  ASSERT_EQ(1, files.size());
+  EXPECT_EQ(1101, EventReader::Scan(files, 1, [](size_t, uint64_t,
+                                                 const char*, size_t) {}));
+}
+
+TEST(MmapFileWriter, WriteBatches) {
+  WriteBatches("runs/mmap_batch", DurabilityPolicy::Mode::kBuffered);
+}
+
+TEST(MmapFileWriter, GroupCommit) {
+  WriteBatches("runs/mmap_group", DurabilityPolicy::Mode::kGroupCommit);
+}
+
+TEST(MmapFileWriter, Sync) {
+  WriteBatches("runs/mmap_sync", DurabilityPolicy::Mode::kSync);
+}
+
+TEST(MmapFileWriter, Recorder) {
+  Recorder recorder("runs/mmap_recorder", [](const string& p) -> Writer* {
+                      return new MmapFileWriter(p, 1 << 20);
+                    });
+  ASSERT_TRUE(recorder.Ready());
+
+  for (int64_t i = 0; i < 100; ++i) {
+    EXPECT_LT(0, recorder.AddScalar("mmap_scalar", 0.01 * i, i));
+  }
+}
+
+}  // namespace nlptk
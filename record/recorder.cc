@@ -17,14 +17,20 @@
 #include <sys/stat.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>                 // NOLINT(build/c++11)
+#include <cstdlib>
 #include <ctime>
+#include <iterator>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <fstream>
 
 #include "glog/logging.h"
 #include "proto/summary.pb.h"
+#include "record/event_file.h"
 #include "record/file_writer.h"
 #include "record/summary.h"
 #include "record/utils.h"
@@ -38,6 +44,30 @@ using std::vector;
 using tensorboard::Event;
 using tensorboard::Summary;
 
+// minimal interval between two rewrites of the projector config file
+static const double kProjectorSyncSecs = 5.0;
+static const char kProjectorConfig[] = "projector_config.pbtxt";
+
+// event files of the routed blob summaries, and the texts routed with them
+static const char kBlobEvents[] = "events.blobs";
+static const size_t kBlobTextSize = 64 * 1024;
+
+static std::atomic<uint64_t> next_recorder_id{0};
+
+// the ids of the recorders alive, the threads prune their caches of stages
+// to them once `destroyed` moved on
+struct LiveRecorders {
+  std::mutex                    lock;
+  std::unordered_set<uint64_t>  ids;
+  std::atomic<uint64_t>         destroyed{0};
+};
+
+static LiveRecorders& Live() {
+  // leaked, threads may outlive the static destructors
+  static auto live = new LiveRecorders();
+  return *live;
+}
+
 ImageMetadata::ImageMetadata(int w, int h, int c)
     : width(w), height(h), colorspace(c) {
 }
@@ -46,21 +76,6 @@ AudioMetadata::AudioMetadata(int64_t n, int64_t l, float s, const string& c)
     : num_channels(n), length_frames(l), sample_rate(s), content_type(c) {
 }
 
-int AddEvent(Writer* writer, Summary* summary, int step) {
-  assert(writer);
-  assert(summary);
-
-  Event event;
-  double wall_time = Timestamp();
-  event.set_wall_time(wall_time);
-  event.set_allocated_summary(summary);
-  if (step >= 0) {
-    event.set_step(step);
-  }
-
-  return writer->Write(std::move(event));
-}
-
 string Replace(const string& txt, char old_value, char new_value) {
   if (txt.find(old_value)) {
     auto new_txt = txt;
@@ -71,12 +86,28 @@ string Replace(const string& txt, char old_value, char new_value) {
   return txt;
 }
 
+// splitmix64, a tiny deterministic generator for the reservoir sampling
+static uint64_t NextRandom(std::atomic<uint64_t>* state) {
+  const uint64_t kGamma = 0x9e3779b97f4a7c15ULL;
+  uint64_t z = state->fetch_add(kGamma, std::memory_order_relaxed) + kGamma;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
 const Recorder::WriterMaker Recorder::Default = [](const string& p) -> Writer* {
   return new FileWriter(p);
 };
 
+const char* const Recorder::kStatsPrefix = "tensorboard.cpp/";
+
 Recorder::Recorder(const string& log_dir, WriterMaker maker)
-    : log_dir_(log_dir), make_writer_(maker) {
+    : log_dir_(log_dir), make_writer_(maker), id_(++next_recorder_id) {
+  {
+    std::lock_guard<std::mutex> lock{Live().lock};
+    Live().ids.insert(id_);
+  }
+
   if (StringUtil::EmptyOrSpaces(log_dir_)) {
     char buf[32];
     auto now = time(nullptr);
@@ -98,23 +129,840 @@ Recorder::Recorder(const string& log_dir, WriterMaker maker)
   }
 
   if (IsExisted(log_dir_)) {
-    writer_ = make_writer_(JoinPath(log_dir_, "events"));
-    writers_[log_dir_] = writer_;
+    slot_ = NewSlot(log_dir_);
+    writer_ = slot_->writer;
+    LoadProjectConfig();
   }
 }
 
 Recorder::~Recorder() {
+  {
+    std::lock_guard<std::mutex> lock{Live().lock};
+    Live().ids.erase(id_);
+    Live().destroyed.fetch_add(1, std::memory_order_release);
+  }
+
+  StopStatsLogging();
+  WritePendingWindows();
+  WriteStaged();
+  if (embeddings_dirty_) {
+    SyncProjectConfig();
+  }
+
   for (auto& item : writers_) {
-    item.second->Close();
+    item.second->writer->Close();
+    delete item.second->writer;
     delete item.second;
     item.second = nullptr;
   }
 
   writer_ = nullptr;
+  slot_ = nullptr;
 }
 
 bool Recorder::Ready() const {
-  return (nullptr != writer_) && writer_->Ready();
+  if (nullptr == writer_) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock{slot_->lock};
+  return writer_->Ready();
+}
+
+int Recorder::Flush() {
+  int ret = WritePendingWindows() < 0 ? -1 : 0;
+  if (WriteStaged() < 0) {
+    ret = -1;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{state_lock_};
+    if (embeddings_dirty_ && SyncProjectConfig() < 0) {
+      ret = -1;
+    }
+  }
+
+  vector<Slot*> slots;
+  {
+    std::lock_guard<std::mutex> lock{writers_lock_};
+    for (auto& item : writers_) {
+      slots.push_back(item.second);
+    }
+  }
+
+  for (auto slot : slots) {
+    std::lock_guard<std::mutex> lock{slot->lock};
+    if (slot->writer->Flush() < 0) {
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+void Recorder::SetStaging(size_t bytes) {
+  staging_ = bytes;
+}
+
+Recorder::Slot* Recorder::NewSlot(const string& dir, const string& name) {
+  auto slot = new Slot();
+  auto prefix = JoinPath(dir, name);
+  slot->writer = make_writer_(prefix);
+  slot->writer->SetMemoryBudget(&memory_);
+  writers_[name == "events" ? dir : prefix] = slot;
+  return slot;
+}
+
+void Recorder::SetBlobRouting(bool enable) {
+  if (nullptr == writer_) {
+    return;
+  }
+
+  Slot* slot = nullptr;
+  if (enable) {
+    std::lock_guard<std::mutex> lock{writers_lock_};
+    auto iter = writers_.find(JoinPath(log_dir_, kBlobEvents));
+    slot = iter != writers_.end() ? iter->second
+                                  : NewSlot(log_dir_, kBlobEvents);
+  }
+
+  blob_slot_ = slot;
+}
+
+Recorder::Slot* Recorder::BlobSlot() const {
+  auto slot = blob_slot_.load();
+  return nullptr != slot ? slot : slot_;
+}
+
+void Recorder::SetMaxOpenWriters(size_t max_open) {
+  std::lock_guard<std::mutex> lock{writers_lock_};
+  max_open_ = max_open;
+  if (max_open_ > 0) {
+    Evict(nullptr);
+  }
+}
+
+Recorder::Slot* Recorder::ScalarsSlot(const string& main_tag,
+                                      const string& key) {
+  auto dir = log_dir_ + "/" + Replace(main_tag, '/', '_') + "_" + key;
+  auto iter = writers_.find(dir);
+  if (iter != writers_.end()) {
+    return iter->second;
+  }
+
+  if (IsExisted(dir)) {
+    if (!IsDirectory(dir)) {
+      dir = GetDirectoryPath(dir, true);
+      iter = writers_.find(dir);
+      if (iter != writers_.end()) {
+        return iter->second;
+      }
+    }
+  } else {
+    if (MakeDirs(dir) < 0) {
+      LOG(ERROR) << "Failed to create tensorboard log dir: " << dir;
+      return nullptr;
+    }
+
+    LOG(INFO) << "Created tensorboard log dir: " << dir;
+  }
+
+  auto slot = NewSlot(dir);
+  slot->used = ++ticks_;
+  ++open_;
+  if (max_open_ > 0) {
+    Evict(slot);
+  }
+
+  return slot;
+}
+
+void Recorder::Acquire(Slot* slot) const {
+  if (0 == max_open_ || slot == slot_) {
+    return;
+  }
+
+  slot->used.store(++ticks_, std::memory_order_relaxed);
+  if (!slot->suspended) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock{writers_lock_};
+  if (slot->suspended) {
+    // reopened by the write that follows
+    slot->suspended = false;
+    ++open_;
+    Evict(slot);
+  }
+}
+
+void Recorder::Evict(Slot* keep) const {
+  while (open_ > max_open_) {
+    Slot* victim = nullptr;
+    for (const auto& item : writers_) {
+      auto slot = item.second;
+      if (slot == slot_ || slot == keep || slot->suspended) {
+        continue;
+      }
+
+      if (nullptr == victim || slot->used < victim->used) {
+        victim = slot;
+      }
+    }
+
+    if (nullptr == victim) {
+      break;
+    }
+
+    std::lock_guard<std::mutex> lock{victim->lock};
+    if (victim->writer->Suspend() < 0) {
+      LOG_EVERY_N(WARNING, 100) << "Failed to suspend writer, "
+                                << open_ << " writers kept open";
+      break;
+    }
+
+    victim->suspended = true;
+    --open_;
+  }
+}
+
+Recorder::Stage* Recorder::LocalStage() const {
+  // recorder ids are never reused, so a stale entry is never looked up,
+  // it is dropped once any recorder is destroyed
+  thread_local std::unordered_map<uint64_t, Stage*> cache;
+  thread_local uint64_t destroyed = 0;
+  auto& live = Live();
+  auto now = live.destroyed.load(std::memory_order_acquire);
+  if (now != destroyed) {
+    std::lock_guard<std::mutex> lock{live.lock};
+    for (auto it = cache.begin(); it != cache.end();) {
+      it = live.ids.count(it->first) > 0 ? std::next(it) : cache.erase(it);
+    }
+
+    destroyed = now;
+  }
+
+  auto& stage = cache[id_];
+  if (nullptr == stage) {
+    std::lock_guard<std::mutex> lock{stages_lock_};
+    stages_.emplace_back(new Stage());
+    stage = stages_.back().get();
+  }
+
+  return stage;
+}
+
+int Recorder::Write(Slot* slot, Summary* summary, int64_t step) const {
+  assert(slot);
+  assert(summary);
+
+  auto stage = Batching(step);
+  if (nullptr != stage) {
+    return Collect(stage, slot, summary);
+  }
+
+  Event event;
+  double wall_time = Timestamp();
+  event.set_wall_time(wall_time);
+  event.set_allocated_summary(summary);
+  if (step >= 0) {
+    event.set_step(step);
+  }
+
+  return WriteEvent(slot, std::move(event));
+}
+
+int Recorder::WriteEvent(Slot* slot, Event&& event) const {
+  if (0 == staging_) {
+    Acquire(slot);
+    std::lock_guard<std::mutex> lock{slot->lock};
+    return slot->writer->Write(std::move(event));
+  }
+
+  auto start = StatsCounters::Now();
+  size_t size = event.ByteSizeLong();
+  string record(kRecordHeaderSize + size + kRecordFooterSize, '\0');
+  event.SerializeWithCachedSizesToArray(
+      reinterpret_cast<uint8_t*>(&record[kRecordHeaderSize]));
+  stats_.Add(StatsCounters::kSerializeNanos, StatsCounters::Now() - start);
+  return WriteRecord(slot, &record[0], size);
+}
+
+Recorder::Stage* Recorder::Batching(int64_t step) const {
+  if (0 == batching_) {
+    return nullptr;
+  }
+
+  auto stage = LocalStage();
+  if (!stage->batching || (step >= 0 && step != stage->step)) {
+    return nullptr;
+  }
+
+  return stage;
+}
+
+int Recorder::Collect(Stage* stage, Slot* slot, Summary* summary) const {
+  int size = summary->ByteSizeLong();
+  auto values = stage->events[slot].mutable_summary()->mutable_value();
+  auto count = summary->value_size();
+  vector<tensorboard::Summary_Value*> released(count);
+  summary->mutable_value()->ExtractSubrange(0, count, released.data());
+  for (auto value : released) {
+    values->AddAllocated(value);
+  }
+
+  delete summary;
+  return size;
+}
+
+StepBatch Recorder::BeginStep(int64_t step) const {
+  auto stage = LocalStage();
+  if (stage->batching) {
+    CommitStep();
+  }
+
+  stage->batching = true;
+  stage->step = step;
+  ++batching_;
+  return StepBatch(this, step);
+}
+
+int Recorder::CommitStep() const {
+  auto stage = LocalStage();
+  if (!stage->batching) {
+    return 0;
+  }
+
+  stage->batching = false;
+  --batching_;
+
+  std::map<Slot*, Event> events;
+  events.swap(stage->events);
+  int ret = 0;
+  auto wall_time = Timestamp();
+  for (auto& item : events) {
+    auto& event = item.second;
+    event.set_wall_time(wall_time);
+    if (stage->step >= 0) {
+      event.set_step(stage->step);
+    }
+
+    auto cnt = WriteEvent(item.first, std::move(event));
+    if (cnt < 0 || ret < 0) {
+      ret = -1;
+    } else {
+      ret += cnt;
+    }
+  }
+
+  return ret;
+}
+
+StepBatch::StepBatch(const Recorder* recorder, int64_t step)
+    : recorder_(recorder), step_(step) {
+}
+
+StepBatch::StepBatch(StepBatch&& other)
+    : recorder_(other.recorder_), step_(other.step_) {
+  other.recorder_ = nullptr;
+}
+
+StepBatch::~StepBatch() {
+  Commit();
+}
+
+int StepBatch::Commit() {
+  if (nullptr == recorder_) {
+    return 0;
+  }
+
+  auto ret = recorder_->CommitStep();
+  recorder_ = nullptr;
+  return ret;
+}
+
+int Recorder::WriteRecord(Slot* slot, char* record, size_t size) const {
+  auto start = StatsCounters::Now();
+  FrameRecord(record, size);
+  stats_.Add(StatsCounters::kChecksumNanos, StatsCounters::Now() - start);
+  auto framed = kRecordHeaderSize + size + kRecordFooterSize;
+  if (0 == staging_) {
+    Acquire(slot);
+    std::lock_guard<std::mutex> lock{slot->lock};
+    return slot->writer->WriteRecords(record, framed, 1) < 0 ? -1 : size;
+  }
+
+  auto stage = LocalStage();
+  std::unique_lock<std::mutex> lock{stage->lock};
+  auto& batch = stage->batches[slot];
+  batch.data.append(record, framed);
+  ++batch.records;
+  if (batch.data.size() >= staging_) {
+    Batch full;
+    std::swap(full, batch);
+    lock.unlock();
+    if (WriteBatch(slot, full) < 0) {
+      return -1;
+    }
+  }
+
+  return size;
+}
+
+int Recorder::WriteBlob(Slot* slot, Summary* summary, Blob&& blob,
+                        int64_t step) const {
+  std::unique_ptr<Summary> owner(summary);
+  if (0 == blob.size()) {
+    LOG(ERROR) << "Empty blob data!";
+    return -1;
+  }
+
+  // the event of a step batch holds the payload
+  if (nullptr != Batching(step)) {
+    auto value = summary->mutable_value(0);
+    if (value->has_image()) {
+      value->mutable_image()->set_encoded_image_string(blob.data(),
+                                                       blob.size());
+    } else {
+      value->mutable_audio()->set_encoded_audio_string(blob.data(),
+                                                       blob.size());
+    }
+
+    blob.Reset();
+    return Write(slot, owner.release(), step);
+  }
+
+  string head, tail;
+  if (EncodeBlobEvent(*summary, Timestamp(), step, blob.size(), &head,
+                      &tail) < 0) {
+    LOG(ERROR) << "Failed to encode blob event";
+    return -1;
+  }
+
+  // records staged by this thread go first
+  if (staging_ > 0) {
+    Batch staged;
+    auto stage = LocalStage();
+    {
+      std::lock_guard<std::mutex> lock{stage->lock};
+      auto iter = stage->batches.find(slot);
+      if (iter != stage->batches.end()) {
+        std::swap(staged, iter->second);
+      }
+    }
+
+    if (staged.records > 0 && WriteBatch(slot, staged) < 0) {
+      return -1;
+    }
+  }
+
+  Acquire(slot);
+  std::lock_guard<std::mutex> lock{slot->lock};
+  return slot->writer->WriteBlob(head, std::move(blob), tail);
+}
+
+int Recorder::WriteBatch(Slot* slot, const Batch& batch) const {
+  Acquire(slot);
+  std::lock_guard<std::mutex> lock{slot->lock};
+  return slot->writer->WriteRecords(batch.data.data(), batch.data.size(),
+                                    batch.records);
+}
+
+int Recorder::WriteStaged() const {
+  int ret = 0;
+  std::lock_guard<std::mutex> lock{stages_lock_};
+  for (auto& stage : stages_) {
+    std::unordered_map<Slot*, Batch> batches;
+    {
+      std::lock_guard<std::mutex> stage_lock{stage->lock};
+      batches.swap(stage->batches);
+    }
+
+    for (const auto& item : batches) {
+      if (item.second.records > 0 && WriteBatch(item.first, item.second) < 0) {
+        ret = -1;
+      }
+    }
+  }
+
+  return ret;
+}
+
+int64_t Recorder::LastStep(const string& tag) const {
+  if (nullptr == writer_) {
+    return -1;
+  }
+
+  return writer_->LastStep(tag);
+}
+
+Recorder::Sampler::Sampler(const SamplingPolicy& policy, const string& tag,
+                           bool inherited)
+    : policy(policy),
+      state(policy.seed ^ std::hash<string>()(tag)),
+      inherited(inherited) {
+}
+
+bool Recorder::Sampler::Keep() {
+  auto calls = count.fetch_add(1, std::memory_order_relaxed) + 1;
+  switch (policy.mode) {
+    case SamplingPolicy::kEveryN:
+      return policy.every_n <= 1 || (calls - 1) % policy.every_n == 0;
+    case SamplingPolicy::kInterval: {
+      auto now = Timestamp();
+      auto previous = last.load(std::memory_order_relaxed);
+      if (previous >= 0 && now - previous < policy.interval_secs) {
+        return false;
+      }
+
+      // of the callers racing for the interval only one is kept
+      return last.compare_exchange_strong(previous, now,
+                                          std::memory_order_relaxed);
+    }
+    case SamplingPolicy::kReservoir:
+      return calls <= policy.size ||
+             NextRandom(&state) % calls < policy.size;
+    default:
+      return true;
+  }
+}
+
+void Recorder::SetSampling(const string& tag, const SamplingPolicy& policy) {
+  std::lock_guard<std::shared_timed_mutex> lock{samplers_lock_};
+  sampled_ = true;
+  if (tag.empty()) {
+    sampling_ = policy;
+    for (auto iter = samplers_.begin(); iter != samplers_.end();) {
+      if (iter->second->inherited) {
+        iter = samplers_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+
+    return;
+  }
+
+  samplers_[tag].reset(new Sampler(policy, tag, false));
+}
+
+bool Recorder::Sample(const string& tag) const {
+  if (!sampled_) {
+    return true;
+  }
+
+  {
+    std::shared_lock<std::shared_timed_mutex> lock{samplers_lock_};
+    auto iter = samplers_.find(tag);
+    if (iter != samplers_.end()) {
+      return iter->second->Keep();
+    }
+
+    if (sampling_.mode == SamplingPolicy::kAll) {
+      return true;
+    }
+  }
+
+  // the first call for the tag under the default policy
+  std::lock_guard<std::shared_timed_mutex> lock{samplers_lock_};
+  auto iter = samplers_.find(tag);
+  if (iter == samplers_.end()) {
+    if (sampling_.mode == SamplingPolicy::kAll) {
+      return true;
+    }
+
+    std::unique_ptr<Sampler> sampler(new Sampler(sampling_, tag, true));
+    iter = samplers_.emplace(tag, std::move(sampler)).first;
+  }
+
+  return iter->second->Keep();
+}
+
+void Recorder::SetAggregation(const string& tag,
+                              const AggregationPolicy& policy) {
+  aggregator_.SetPolicy(tag, policy);
+}
+
+bool Recorder::Aggregate(const string& tag, float value, int64_t step,
+                         int* ret) const {
+  if (!aggregator_.Enabled()) {
+    return false;
+  }
+
+  auto window = aggregator_.Get(tag);
+  return nullptr != window && Aggregate(window, value, step, ret);
+}
+
+bool Recorder::Aggregate(const TagHandle::Interned* tag, float value,
+                         int64_t step, int* ret) const {
+  if (!aggregator_.Enabled()) {
+    return false;
+  }
+
+  auto window = tag->window.load(std::memory_order_acquire);
+  if (nullptr == window) {
+    window = aggregator_.Get(tag->name);
+    if (nullptr == window) {
+      return false;
+    }
+
+    tag->window.store(window, std::memory_order_release);
+  }
+
+  return Aggregate(window, value, step, ret);
+}
+
+bool Recorder::Aggregate(ScalarAggregator::Window* window, float value,
+                         int64_t step, int* ret) const {
+  std::unique_lock<std::mutex> lock{window->lock};
+  if (!window->policy.Enabled()) {
+    return false;
+  }
+
+  // the clock is only read by windows closed by time
+  auto now = window->policy.window_secs > 0.0 ? Timestamp() : 0.0;
+  window->Add(value, step, now);
+  if (!window->Full(now)) {
+    *ret = 0;
+    return true;
+  }
+
+  int64_t window_step = -1;
+  auto summary = WindowSummary(window, &window_step);
+  lock.unlock();
+  *ret = Write(slot_, summary, window_step);
+  return true;
+}
+
+Summary* Recorder::WindowSummary(ScalarAggregator::Window* window,
+                                 int64_t* step) const {
+  auto summary = Scalar(window->tag, window->sum / window->count);
+  auto add_value = [&](const char* name, float value) {
+    auto v = summary->add_value();
+    v->set_tag(summary->value(0).tag() + name);
+    v->set_simple_value(value);
+  };
+
+  const auto& policy = window->policy;
+  if (policy.min) {
+    add_value("/min", window->min);
+  }
+
+  if (policy.max) {
+    add_value("/max", window->max);
+  }
+
+  if (policy.last) {
+    add_value("/last", window->last);
+  }
+
+  if (policy.count) {
+    add_value("/count", window->count);
+  }
+
+  *step = window->step;
+  window->Reset();
+  return summary;
+}
+
+int Recorder::WritePendingWindows() const {
+  if (nullptr == writer_ || !aggregator_.Enabled()) {
+    return 0;
+  }
+
+  vector<std::pair<Summary*, int64_t>> summaries;
+  for (auto window : aggregator_.Pending()) {
+    // the window may have been closed by a call since
+    std::lock_guard<std::mutex> lock{window->lock};
+    if (0 == window->count) {
+      continue;
+    }
+
+    int64_t step = -1;
+    auto summary = WindowSummary(window, &step);
+    summaries.emplace_back(summary, step);
+  }
+
+  int ret = 0;
+  for (const auto& item : summaries) {
+    if (Write(slot_, item.first, item.second) < 0) {
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+void Recorder::SetBudget(SummaryType type, const BudgetPolicy& policy) {
+  std::lock_guard<std::mutex> lock{state_lock_};
+  budget_.SetPolicy(type, policy);
+}
+
+void Recorder::SetMemoryBudget(const MemoryPolicy& policy) {
+  memory_.SetPolicy(policy);
+}
+
+uint64_t Recorder::QueuedBytes() const {
+  return memory_.Used();
+}
+
+uint64_t Recorder::Dropped(SummaryType type) const {
+  std::lock_guard<std::mutex> lock{state_lock_};
+  return budget_.Dropped(type) + memory_.Dropped(type);
+}
+
+uint64_t Recorder::Dropped(const string& tag) const {
+  std::lock_guard<std::mutex> lock{state_lock_};
+  return budget_.Dropped(tag) + memory_.Dropped(tag);
+}
+
+WriterStats Recorder::Stats() const {
+  auto stats = stats_.Snapshot();
+  vector<Slot*> slots;
+  {
+    std::lock_guard<std::mutex> lock{writers_lock_};
+    for (auto& item : writers_) {
+      slots.push_back(item.second);
+    }
+  }
+
+  // the writers count their own stats without the slot locks
+  for (auto slot : slots) {
+    stats += slot->writer->Stats();
+  }
+
+  std::lock_guard<std::mutex> lock{state_lock_};
+  for (int type = 0; type < kNumSummaryTypes; ++type) {
+    stats.dropped += budget_.Dropped(static_cast<SummaryType>(type)) +
+                     memory_.Dropped(static_cast<SummaryType>(type));
+  }
+
+  return stats;
+}
+
+void Recorder::SetJournal(Journal* journal) {
+  journal_.store(journal, std::memory_order_release);
+}
+
+void Recorder::Journaled(JournalEntry::Call call, const string& tag,
+                         int64_t step, uint64_t count, uint64_t bytes,
+                         const ImageMetadata* image) const {
+  auto journal = journal_.load(std::memory_order_acquire);
+  if (nullptr == journal) {
+    return;
+  }
+
+  if (nullptr != image) {
+    journal->AddCall(call, tag, step, count, bytes, image->width,
+                     image->height, image->colorspace);
+  } else {
+    journal->AddCall(call, tag, step, count, bytes);
+  }
+}
+
+void Recorder::SetStatsLogging(double interval_secs, const string& prefix) {
+  StopStatsLogging();
+  if (interval_secs <= 0.0 || nullptr == writer_) {
+    return;
+  }
+
+  stats_interval_ = interval_secs;
+  stats_prefix_ = prefix;
+  stats_stop_ = false;
+  stats_logger_ = std::thread(&Recorder::LogStats, this);
+}
+
+void Recorder::StopStatsLogging() {
+  if (!stats_logger_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{stats_lock_};
+    stats_stop_ = true;
+  }
+
+  stats_wakeup_.notify_one();
+  stats_logger_.join();
+}
+
+void Recorder::LogStats() {
+  auto interval = std::chrono::duration<double>(stats_interval_);
+  int64_t step = 0;
+  std::unique_lock<std::mutex> lock{stats_lock_};
+  while (!stats_wakeup_.wait_for(lock, interval, [&] { return stats_stop_; })) {
+    lock.unlock();
+    auto stats = Stats();
+    const std::pair<const char*, double> scalars[] = {
+        {"events", stats.events},
+        {"bytes", stats.bytes},
+        {"dropped", stats.dropped},
+        {"flushes", stats.flushes},
+        {"queue_depth", stats.queue_depth},
+        {"serialize_secs", stats.serialize_secs},
+        {"checksum_secs", stats.checksum_secs},
+        {"write_secs", stats.write_secs},
+        {"latency_p50", stats.Latency(0.5)},
+        {"latency_p99", stats.Latency(0.99)},
+    };
+
+    // bypasses sampling and budgets, the reports are never dropped
+    for (const auto& item : scalars) {
+      Write(slot_, Scalar(stats_prefix_ + item.first, item.second), step);
+    }
+
+    ++step;
+    lock.lock();
+  }
+}
+
+int Recorder::Admit(SummaryType type, const string& tag, size_t bytes,
+                    double* cpu) const {
+  if (budget_.Enabled(type)) {
+    std::unique_lock<std::mutex> lock{state_lock_};
+    if (!budget_.Admit(type, tag, bytes, Timestamp())) {
+      auto dropped = budget_.Dropped(type);
+      lock.unlock();
+      LOG_EVERY_N(WARNING, 1000) << "Dropped summary '" << tag
+                                 << "' beyond the budget, " << dropped
+                                 << " dropped";
+      return 0;
+    }
+  }
+
+  if (memory_.Enabled()) {
+    auto admitted = memory_.Admit(type, tag, bytes);
+    if (admitted <= 0) {
+      LOG_EVERY_N(WARNING, 1000) << (admitted < 0 ? "Failed" : "Dropped")
+                                 << " summary '" << tag << "' beyond the "
+                                 << "memory budget, " << memory_.Used()
+                                 << " bytes queued";
+      return admitted;
+    }
+  }
+
+  // the cpu clock is a syscall, only read for types with a cpu cap
+  if (budget_.Timed(type)) {
+    *cpu = ThreadCpuTime();
+  }
+
+  return 1;
+}
+
+int Recorder::Charge(SummaryType type, double cpu, int ret) const {
+  if (ret < 0 || !budget_.Charged(type)) {
+    return ret;
+  }
+
+  // the calls taken by an aggregation window write nothing, but spent cpu
+  auto timed = budget_.Timed(type);
+  if (ret > 0 || timed) {
+    auto spent = timed ? ThreadCpuTime() - cpu : 0.0;
+    std::lock_guard<std::mutex> lock{state_lock_};
+    budget_.Charge(type, ret, spent);
+  }
+
+  return ret;
 }
 
 int Recorder::AddScalar(const string& tag, float value, int64_t step) const {
@@ -122,44 +970,126 @@ int Recorder::AddScalar(const string& tag, float value, int64_t step) const {
     return -1;
   }
 
+  Journaled(JournalEntry::kAddScalar, tag, step, 1, sizeof(value));
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kScalarSummary, tag, 0, &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
+  int ret = 0;
+  if (Aggregate(tag, value, step, &ret)) {
+    return Charge(kScalarSummary, cpu, ret);
+  }
+
   auto summary = Scalar(tag, value);
   if (nullptr == summary) {
     return -1;
   }
 
-  return AddEvent(writer_, summary, step);
+  return Charge(kScalarSummary, cpu, Write(slot_, summary, step));
+}
+
+TagHandle Recorder::Intern(const string& tag) const {
+  std::lock_guard<std::mutex> lock{state_lock_};
+  auto& interned = interned_[tag];
+  if (nullptr == interned) {
+    interned.reset(new TagHandle::Interned());
+    interned->name = tag;
+    interned->prefix = ScalarEventPrefix(tag);
+  }
+
+  return TagHandle(interned.get());
+}
+
+int Recorder::AddScalar(TagHandle handle, float value, int64_t step) const {
+  if (nullptr == writer_ || !handle.Valid()) {
+    return -1;
+  }
+
+  Journaled(JournalEntry::kAddScalar, handle.tag_->name, step, 1,
+            sizeof(value));
+
+  const auto& tag = handle.tag_->name;
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kScalarSummary, tag, 0, &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
+  int ret = 0;
+  if (Aggregate(handle.tag_, value, step, &ret)) {
+    return Charge(kScalarSummary, cpu, ret);
+  }
+
+  if (nullptr != Batching(step)) {
+    return Charge(kScalarSummary, cpu, Write(slot_, Scalar(tag, value), step));
+  }
+
+  const auto& prefix = handle.tag_->prefix;
+  char inline_record[512];
+  std::unique_ptr<char[]> heap_record;
+  char* record = inline_record;
+  auto capacity = kRecordHeaderSize + prefix.size() + kScalarEventOverhead +
+                  kRecordFooterSize;
+  if (capacity > sizeof(inline_record)) {
+    heap_record.reset(new char[capacity]);
+    record = heap_record.get();
+  }
+
+  auto start = StatsCounters::Now();
+  auto size = EncodeScalarEvent(prefix, Timestamp(), step, value,
+                                record + kRecordHeaderSize);
+  stats_.Add(StatsCounters::kSerializeNanos, StatsCounters::Now() - start);
+  return Charge(kScalarSummary, cpu, WriteRecord(slot_, record, size));
 }
 
 int Recorder::AddScalars(const string& main_tag,
                          const map<string, float>& tag_values,
                          int64_t global_step) {
-  int ret = 0;
-  for (const auto& item : tag_values) {
-    auto dir = log_dir_ + "/" + Replace(main_tag, '/', '_') + "_" + item.first;
-    auto iter = writers_.find(dir);
-    if (iter == writers_.end()) {
-      if (IsExisted(dir)) {
-        if (!IsDirectory(dir)) {
-          dir = GetDirectoryPath(dir, true);
-          iter = writers_.find(dir);
-        }
-      } else {
-        if (MakeDirs(dir) < 0) {
-          LOG(ERROR) << "Failed to create tensorboard log dir: " << dir;
-        } else {
-          LOG(INFO) << "Created tensorboard log dir: " << dir;
-        }
-      }
+  Journaled(JournalEntry::kAddScalars, main_tag, global_step,
+            tag_values.size(), tag_values.size() * sizeof(float));
+
+  if (!Sample(main_tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kScalarSummary, main_tag, 0, &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
 
-      if (iter == writers_.end() && IsExisted(dir)) {
-        auto writer = make_writer_(JoinPath(dir, "events"));
-        iter = writers_.emplace(dir, writer).first;
+  vector<Slot*> slots;
+  slots.reserve(tag_values.size());
+  {
+    std::lock_guard<std::mutex> lock{writers_lock_};
+    auto& table = scalars_[main_tag];
+    for (const auto& item : tag_values) {
+      auto& slot = table[item.first];
+      if (nullptr == slot) {
+        slot = ScalarsSlot(main_tag, item.first);
       }
+
+      slots.push_back(slot);
     }
+  }
 
-    if (iter != writers_.end()) {
+  int ret = 0;
+  auto slot = slots.begin();
+  for (const auto& item : tag_values) {
+    if (nullptr != *slot) {
       auto summary = Scalar(main_tag, item.second);
-      auto cnt = AddEvent(iter->second, summary, global_step);
+      auto cnt = Write(*slot, summary, global_step);
       if (cnt < 0 || ret < 0) {
         ret = -1;
       } else {
@@ -168,9 +1098,11 @@ int Recorder::AddScalars(const string& main_tag,
     } else {
       ret = -1;
     }
+
+    ++slot;
   }
 
-  return ret;
+  return Charge(kScalarSummary, cpu, ret);
 }
 
 int Recorder::AddHistogram(const string& tag, const vector<double>& values,
@@ -179,12 +1111,26 @@ int Recorder::AddHistogram(const string& tag, const vector<double>& values,
     return -1;
   }
 
+  Journaled(JournalEntry::kAddHistogram, tag, global_step, values.size(),
+            values.size() * sizeof(double));
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kHistogramSummary, tag, 0, &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
   auto summary = Histogram(tag, values, bins);
   if (nullptr == summary) {
     return -1;
   }
 
-  return AddEvent(writer_, summary, global_step);
+  auto ret = Write(slot_, summary, global_step);
+  return Charge(kHistogramSummary, cpu, ret);
 }
 
 int Recorder::AddHistogramRaw(const string& tag, double min, double max,
@@ -196,13 +1142,29 @@ int Recorder::AddHistogramRaw(const string& tag, double min, double max,
     return -1;
   }
 
+  Journaled(JournalEntry::kAddHistogramRaw, tag, global_step,
+            bucket_counts.size(),
+            (bucket_limits.size() + bucket_counts.size()) * sizeof(double));
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto bytes = bucket_limits.size() * 2 * sizeof(double);
+  auto admitted = Admit(kHistogramSummary, tag, bytes, &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
   auto summary = HistogramRaw(tag, min, max, num, sum, sum_squares,
                               bucket_limits, bucket_counts);
   if (nullptr == summary) {
     return -1;
   }
 
-  return AddEvent(writer_, summary, global_step);
+  auto ret = Write(slot_, summary, global_step);
+  return Charge(kHistogramSummary, cpu, ret);
 }
 
 int Recorder::AddImage(const string& tag, const string& img,
@@ -211,12 +1173,56 @@ int Recorder::AddImage(const string& tag, const string& img,
     return -1;
   }
 
+  Journaled(JournalEntry::kAddImage, tag, global_step, 1, img.size(), &meta);
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kImageSummary, tag, img.size(), &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
   auto summary = Image(tag, img, meta.height, meta.width, meta.colorspace);
   if (nullptr == summary) {
     return -1;
   }
 
-  return AddEvent(writer_, summary, global_step);
+  return Charge(kImageSummary, cpu, Write(BlobSlot(), summary, global_step));
+}
+
+int Recorder::AddImage(const string& tag, string&& img,
+                       const ImageMetadata& meta, int64_t global_step) const {
+  return AddImage(tag, Blob(std::move(img)), meta, global_step);
+}
+
+int Recorder::AddImage(const string& tag, Blob img, const ImageMetadata& meta,
+                       int64_t global_step) const {
+  if (nullptr == writer_) {
+    return -1;
+  }
+
+  Journaled(JournalEntry::kAddImage, tag, global_step, 1, img.size(), &meta);
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kImageSummary, tag, img.size(), &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
+  auto summary = ImageBlob(tag, meta.height, meta.width, meta.colorspace);
+  if (nullptr == summary) {
+    return -1;
+  }
+
+  return Charge(kImageSummary, cpu,
+                WriteBlob(BlobSlot(), summary, std::move(img), global_step));
 }
 
 int Recorder::AddImages(const string& tag, const vector<string>& imgs,
@@ -225,12 +1231,30 @@ int Recorder::AddImages(const string& tag, const vector<string>& imgs,
     return -1;
   }
 
+  size_t bytes = 0;
+  for (const auto& img : imgs) {
+    bytes += img.size();
+  }
+
+  Journaled(JournalEntry::kAddImages, tag, global_step, imgs.size(), bytes,
+            &meta);
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kImageSummary, tag, bytes, &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
   auto summary = Images(tag, imgs, meta.height, meta.width, meta.colorspace);
   if (nullptr == summary) {
     return -1;
   }
 
-  return AddEvent(writer_, summary, global_step);
+  return Charge(kImageSummary, cpu, Write(BlobSlot(), summary, global_step));
 }
 
 int Recorder::AddAudio(const string& tag, const string& audio,
@@ -239,13 +1263,54 @@ int Recorder::AddAudio(const string& tag, const string& audio,
     return -1;
   }
 
+  Journaled(JournalEntry::kAddAudio, tag, global_step, 1, audio.size());
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kAudioSummary, tag, audio.size(), &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
   auto summary = Audio(tag, audio, amd.sample_rate, amd.num_channels,
                        amd.length_frames, amd.content_type);
   if (nullptr == summary) {
     return -1;
   }
 
-  return AddEvent(writer_, summary, global_step);
+  return Charge(kAudioSummary, cpu, Write(BlobSlot(), summary, global_step));
+}
+
+int Recorder::AddAudio(const string& tag, string&& audio,
+                       const AudioMetadata& amd, int64_t global_step) const {
+  return AddAudio(tag, Blob(std::move(audio)), amd, global_step);
+}
+
+int Recorder::AddAudio(const string& tag, Blob audio, const AudioMetadata& amd,
+                       int64_t global_step) const {
+  if (nullptr == writer_) {
+    return -1;
+  }
+
+  Journaled(JournalEntry::kAddAudio, tag, global_step, 1, audio.size());
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kAudioSummary, tag, audio.size(), &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
+  auto summary = AudioBlob(tag, amd.sample_rate, amd.num_channels,
+                           amd.length_frames, amd.content_type);
+  return Charge(kAudioSummary, cpu,
+                WriteBlob(BlobSlot(), summary, std::move(audio), global_step));
 }
 
 int Recorder::AddText(const string& tag, const string& text, int64_t s) const {
@@ -253,12 +1318,25 @@ int Recorder::AddText(const string& tag, const string& text, int64_t s) const {
     return -1;
   }
 
+  Journaled(JournalEntry::kAddText, tag, s, 1, text.size());
+
+  if (!Sample(tag)) {
+    return 0;
+  }
+
+  double cpu = 0.0;
+  auto admitted = Admit(kTextSummary, tag, text.size(), &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
   auto summary = Text(tag, text);
   if (nullptr == summary) {
     return -1;
   }
 
-  return AddEvent(writer_, summary, s);
+  auto slot = text.size() >= kBlobTextSize ? BlobSlot() : slot_;
+  return Charge(kTextSummary, cpu, Write(slot, summary, s));
 }
 
 int Recorder::AddEmbedding(const vector<float>& mat, size_t N, size_t D,
@@ -268,11 +1346,21 @@ int Recorder::AddEmbedding(const vector<float>& mat, size_t N, size_t D,
     return -1;
   }
 
+  Journaled(JournalEntry::kAddEmbedding, tag, global_step, N,
+            mat.size() * sizeof(float));
+
   if (mat.size() != N * D) {
     LOG(ERROR) << "Ivalid data size: " << mat.size() << " != " << N << '*' << D;
     return -1;
   }
 
+  double cpu = 0.0;
+  auto admitted = Admit(kEmbeddingSummary, tag, mat.size() * sizeof(float),
+                        &cpu);
+  if (admitted <= 0) {
+    return admitted;
+  }
+
   if (global_step < 0) {
     global_step = 0;
   }
@@ -335,6 +1423,7 @@ int Recorder::AddEmbedding(const vector<float>& mat, size_t N, size_t D,
     fout.close();
   }
 
+  Charge(kEmbeddingSummary, cpu, mat.size() * sizeof(float));
   return AddProjectConfig(tag, subdir,
                           metadata.empty() ? "" : "metadata.tsv",
                           "",
@@ -344,14 +1433,6 @@ int Recorder::AddEmbedding(const vector<float>& mat, size_t N, size_t D,
 int Recorder::AddProjectConfig(const string& tag, const string& dir,
                                const string& mfn, const string& lifn,
                                int64_t step) const {
-  auto path = log_dir_ + "/projector_config.pbtxt";
-  std::ofstream fout(path, std::ios::app);
-  if (!fout.is_open() || fout.fail()) {
-    LOG(ERROR) << "Failed to create projector config: " << path;
-    fout.close();
-    return -1;
-  }
-
   string txt = "embeddings {\n";
   StringUtil::AppendFormat(&txt, "  tensor_name: \"%s:%05d\"\n",
                            tag.c_str(), step);
@@ -375,9 +1456,82 @@ int Recorder::AddProjectConfig(const string& tag, const string& dir,
   }
 
   txt.append("}\n");
-  fout << txt;
-  fout.close();
+
+  std::lock_guard<std::mutex> lock{state_lock_};
+  auto& entry = embeddings_[EmbeddingKey(tag, step)];
+  if (entry != txt) {
+    entry = txt;
+    embeddings_dirty_ = true;
+  }
+
+  // debounce the rewrites, pending entries are written by a later call,
+  // Flush() or the destructor
+  if (embeddings_dirty_ &&
+      Timestamp() - embeddings_synced_ >= kProjectorSyncSecs) {
+    if (SyncProjectConfig() < 0) {
+      return -1;
+    }
+  }
+
   return txt.size();
 }
 
+int Recorder::LoadProjectConfig() {
+  string content;
+  auto path = JoinPath(log_dir_, kProjectorConfig);
+  if (!IsExisted(path) || ReadFile(path, &content) < 0) {
+    return 0;
+  }
+
+  // parse the blocks written by AddProjectConfig, i.e., "embeddings {"
+  // followed by fields and terminated by a single "}" line
+  size_t pos = 0;
+  while ((pos = content.find("embeddings {\n", pos)) != string::npos) {
+    auto end = content.find("\n}\n", pos);
+    if (end == string::npos) {
+      break;
+    }
+
+    end += 3;
+    auto block = content.substr(pos, end - pos);
+    pos = end;
+
+    static const char kName[] = "tensor_name: \"";
+    auto name_pos = block.find(kName);
+    if (name_pos == string::npos) {
+      continue;
+    }
+
+    name_pos += sizeof(kName) - 1;
+    auto name_end = block.find('"', name_pos);
+    auto name = block.substr(name_pos, name_end - name_pos);
+    auto colon = name.rfind(':');
+    if (name_end == string::npos || colon == string::npos) {
+      continue;
+    }
+
+    auto step = std::strtoll(name.c_str() + colon + 1, nullptr, 10);
+    embeddings_[EmbeddingKey(name.substr(0, colon), step)] = block;
+  }
+
+  return embeddings_.size();
+}
+
+int Recorder::SyncProjectConfig() const {
+  string content;
+  for (const auto& item : embeddings_) {
+    content.append(item.second);
+  }
+
+  auto path = JoinPath(log_dir_, kProjectorConfig);
+  if (WriteFileAtomically(path, content) < 0) {
+    LOG(ERROR) << "Failed to write projector config: " << path;
+    return -1;
+  }
+
+  embeddings_synced_ = Timestamp();
+  embeddings_dirty_ = false;
+  return content.size();
+}
+
 }  // namespace nlptk
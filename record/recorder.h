@@ -15,11 +15,23 @@
 #ifndef RECORD_RECORDER_H_
 #define RECORD_RECORDER_H_
 
+#include <atomic>
+#include <condition_variable>     // NOLINT(build/c++11)
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <shared_mutex>           // NOLINT(build/c++14)
 #include <string>
+#include <thread>                 // NOLINT(build/c++11)
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "record/aggregator.h"
+#include "record/budget.h"
+#include "record/journal.h"
+#include "record/stats.h"
 #include "record/writer.h"
 
 namespace nlptk {
@@ -48,6 +60,77 @@ class AudioMetadata {
   std::string   content_type  = "audio/wav";
 };
 
+// Client side downsampling of the calls for a tag, TensorBoard keeps only
+// about 1000 scalars and 10 images per tag anyway.
+struct SamplingPolicy {
+  enum Mode {
+    kAll,         // keep every call
+    kEveryN,      // keep the 1st, (n+1)-th, (2n+1)-th ... call
+    kInterval,    // keep at most one call every `interval_secs`
+    kReservoir,   // keep the i-th call with probability `size / i`
+  };
+
+  Mode          mode{kAll};
+  uint64_t      every_n{1};
+  double        interval_secs{0.0};
+  // the first `size` calls are always kept, the calls kept afterwards grow
+  // logarithmically, i.e., about size * (1 + ln(calls / size)) in total
+  uint64_t      size{1000};
+  uint64_t      seed{0};
+};
+
+// A tag interned by a Recorder, it caches the encoded scalar event of the
+// tag up to the value. Handles stay valid as long as their recorder.
+class TagHandle {
+ public:
+  TagHandle() = default;
+
+  bool Valid() const {
+    return nullptr != tag_;
+  }
+
+ private:
+  friend class Recorder;
+
+  struct Interned {
+    std::string     name;
+    std::string     prefix;
+    // the aggregation window of the tag, set on its first aggregated call
+    mutable std::atomic<ScalarAggregator::Window*>  window{nullptr};
+  };
+
+  explicit TagHandle(const Interned* tag) : tag_(tag) {
+  }
+
+  const Interned*   tag_{nullptr};
+};
+
+class Recorder;
+
+// Collects the summaries added by the calling thread for one step and
+// writes them as a single event per writer, with a single wall time, when
+// committed or destroyed. See Recorder::BeginStep().
+class StepBatch {
+ public:
+  StepBatch(StepBatch&& other);
+
+  ~StepBatch();
+
+  int Commit();
+
+ private:
+  friend class Recorder;
+
+  StepBatch(const Recorder* recorder, int64_t step);
+
+  const Recorder*   recorder_;
+  int64_t           step_;
+};
+
+// A Recorder may be used from many threads. Events are written under a lock
+// per writer, or, with SetStaging(), framed into a buffer of the calling
+// thread and handed to the writers in batches. The Set* methods configure
+// the recorder and are expected to be called before logging starts.
 class Recorder {
  public:
   using WriterMaker = std::function<Writer*(const std::string&)>;
@@ -58,9 +141,87 @@ class Recorder {
 
   bool Ready() const;
 
+  int Flush();
+
+  // Last step of `tag` found in the event file resumed by the writer, so a
+  // restarted trainer can skip the steps logged before, -1 if unknown.
+  int64_t LastStep(const std::string& tag) const;
+
+  // Stages the framed records of every thread in a buffer of its own and
+  // hands them to the writers in batches of about `bytes`, 0 writes every
+  // event at once. Staged records reach the writers by Flush() at latest,
+  // records of different threads may be interleaved in batches.
+  void SetStaging(size_t bytes);
+
+  // Caps the number of open AddScalars writers. The least recently used
+  // ones are suspended and transparently reopened for appending on their
+  // next write, 0 (the default) keeps every writer open.
+  void SetMaxOpenWriters(size_t max_open);
+
+  // Downsamples the calls for `tag` before any summary is built, an empty
+  // tag sets the default policy of the tags without their own.
+  void SetSampling(const std::string& tag, const SamplingPolicy& policy);
+
+  // Aggregates the scalars of `tag` over windows of steps or seconds, an
+  // empty tag sets the default policy of the tags without their own. Open
+  // windows are written by Flush() and the destructor.
+  void SetAggregation(const std::string& tag, const AggregationPolicy& policy);
+
+  // Limits the calls of a summary type by a minimal interval per tag and a
+  // byte or cpu budget per window, calls beyond it are dropped before any
+  // encoding work is done.
+  void SetBudget(SummaryType type, const BudgetPolicy& policy);
+
+  // Writes image and audio summaries and texts of 64KB or more into the
+  // sibling event files "events.blobs" of the run directory with their
+  // own writer, so the main event files of scalars and histograms stay
+  // small and quick for TensorBoard to load.
+  void SetBlobRouting(bool enable);
+
+  // Bounds the bytes queued by all writers of the recorder and not written
+  // yet, summaries beyond it block, fail or are dropped by the policy.
+  // Only writers which queue records, e.g., AsyncFileWriter, are charged.
+  void SetMemoryBudget(const MemoryPolicy& policy);
+
+  uint64_t QueuedBytes() const;
+
+  // number of calls dropped by the budget or the memory budget
+  uint64_t Dropped(SummaryType type) const;
+
+  uint64_t Dropped(const std::string& tag) const;
+
+  // What the writers of the recorder have cost so far, plus the encoding
+  // done by the recorder itself. The calls dropped by the budgets count.
+  WriterStats Stats() const;
+
+  // Logs Stats() as scalars "<prefix>events", "<prefix>bytes" ... every
+  // `interval_secs` from a background thread, the step counting the
+  // reports. Tags under `prefix` are reserved for it, 0 stops logging.
+  void SetStatsLogging(double interval_secs,
+                       const std::string& prefix = kStatsPrefix);
+
+  static const char* const kStatsPrefix;
+
+  // Journals every Add* call into `journal`, which outlives the recorder,
+  // nullptr stops it. May be called while other threads log. Wrap the
+  // writers by Journal::Maker() to journal the events written as well.
+  void SetJournal(Journal* journal);
+
   int AddScalar(const std::string& tag, float scalar_value,
                 int64_t global_step = -1) const;
 
+  TagHandle Intern(const std::string& tag) const;
+
+  // Opens a batch of the calling thread for `step`, the summaries added
+  // for the step or without a step are held back until the batch is
+  // committed. Opening a batch commits the open one of the thread.
+  StepBatch BeginStep(int64_t step) const;
+
+  // Encodes the scalar event by hand from the interned tag, without any
+  // allocation on the way into a FileWriter.
+  int AddScalar(TagHandle tag, float scalar_value,
+                int64_t global_step = -1) const;
+
   int AddScalars(const std::string& main_tag,
                  const std::map<std::string, float>& tag_scalar_dict,
                  int64_t global_step = -1);
@@ -79,6 +240,15 @@ class Recorder {
   int AddImage(const std::string& tag, const std::string& image_data,
                const ImageMetadata& image_metadata, int64_t global_step) const;
 
+  // Take the encoded image over instead of copying it, the bytes go from
+  // the buffer to the event file without being copied into a proto. A blob
+  // viewing a caller's buffer is released once written.
+  int AddImage(const std::string& tag, std::string&& image_data,
+               const ImageMetadata& image_metadata, int64_t global_step) const;
+
+  int AddImage(const std::string& tag, Blob image_data,
+               const ImageMetadata& image_metadata, int64_t global_step) const;
+
   int AddImages(const std::string& tag,
                 const std::vector<std::string>& image_data,
                 const ImageMetadata& image_metadata, int64_t global_step) const;
@@ -86,6 +256,13 @@ class Recorder {
   int AddAudio(const std::string& tag, const std::string& audio_data,
                const AudioMetadata& audio_metadata, int64_t global_step) const;
 
+  // See AddImage() for the overloads taking the encoded bytes over.
+  int AddAudio(const std::string& tag, std::string&& audio_data,
+               const AudioMetadata& audio_metadata, int64_t global_step) const;
+
+  int AddAudio(const std::string& tag, Blob audio_data,
+               const AudioMetadata& audio_metadata, int64_t global_step) const;
+
   int AddText(const std::string& tag, const std::string& text_string,
               int64_t global_step = -1) const;
 
@@ -98,16 +275,198 @@ class Recorder {
   static const WriterMaker Default;
 
  private:
+  friend class StepBatch;
+
+  // a writer and the lock serializing the writes into it, with its recency
+  // and state in the pool of open writers
+  struct Slot {
+    Writer*                   writer{nullptr};
+    std::mutex                lock;
+    std::atomic<uint64_t>     used{0};
+    std::atomic<bool>         suspended{false};
+  };
+
+  struct Batch {
+    std::string               data;
+    size_t                    records{0};
+  };
+
+  // framed records of a thread not handed to the writers yet, and the
+  // events of its open StepBatch
+  struct Stage {
+    std::mutex                            lock;
+    std::unordered_map<Slot*, Batch>      batches;
+    bool                                  batching{false};
+    int64_t                               step{-1};
+    std::map<Slot*, tensorboard::Event>   events;
+  };
+
+  // the state of a sampled tag, updated without locks by the callers
+  struct Sampler {
+    Sampler(const SamplingPolicy& policy, const std::string& tag,
+            bool inherited);
+
+    // whether the next call is kept by the policy
+    bool Keep();
+
+    const SamplingPolicy      policy;
+    std::atomic<uint64_t>     count{0};
+    std::atomic<double>       last{-1.0};
+    std::atomic<uint64_t>     state{0};
+    const bool                inherited;   // follows the default policy
+  };
+
+  // a writer of the event files "<dir>/<name>.out.tfevents.*"
+  Slot* NewSlot(const std::string& dir, const std::string& name = "events");
+
+  // the writer of blob summaries, the main one unless routed apart
+  Slot* BlobSlot() const;
+
+  // the writer of AddScalars for `key` of `main_tag`, under writers_lock_
+  Slot* ScalarsSlot(const std::string& main_tag, const std::string& key);
+
+  // marks the slot used, and makes room for it if it was suspended
+  void Acquire(Slot* slot) const;
+
+  // suspends the least recently used writers beyond the limit except
+  // `keep`, under writers_lock_
+  void Evict(Slot* keep) const;
+
+  // the stage of the calling thread
+  Stage* LocalStage() const;
+
+  int Write(Slot* slot, tensorboard::Summary* summary, int64_t step) const;
+
+  int WriteEvent(Slot* slot, tensorboard::Event&& event) const;
+
+  // writes the image or audio `summary` of ImageBlob() or AudioBlob() with
+  // the payload `blob`
+  int WriteBlob(Slot* slot, tensorboard::Summary* summary, Blob&& blob,
+                int64_t step) const;
+
+  // whether the calling thread has a StepBatch open for `step`
+  Stage* Batching(int64_t step) const;
+
+  // moves the values of `summary` into the event of `slot` of the batch
+  int Collect(Stage* stage, Slot* slot, tensorboard::Summary* summary) const;
+
+  // writes and closes the StepBatch of the calling thread
+  int CommitStep() const;
+
+  // writes an encoded event framed in place, see FrameRecord()
+  int WriteRecord(Slot* slot, char* record, size_t size) const;
+
+  int WriteBatch(Slot* slot, const Batch& batch) const;
+
+  // hands the records staged by all threads to the writers
+  int WriteStaged() const;
+
+  // whether the call for `tag` is kept by its sampling policy
+  bool Sample(const std::string& tag) const;
+
+  // whether a call of `tag` is within the budget of its summary type and
+  // the memory budget, returns 1 if it is, 0 if dropped and -1 if failed.
+  // The thread cpu time the call starts at is returned in `cpu`.
+  int Admit(SummaryType type, const std::string& tag, size_t bytes,
+            double* cpu) const;
+
+  // charges an admitted call with the bytes it wrote, returns `ret`
+  int Charge(SummaryType type, double cpu, int ret) const;
+
+  // Whether the scalar is taken by an aggregation window, `ret` is the
+  // result of writing the window if the scalar closed it.
+  bool Aggregate(const std::string& tag, float value, int64_t step,
+                 int* ret) const;
+
+  // the same with the window cached by the interned tag
+  bool Aggregate(const TagHandle::Interned* tag, float value, int64_t step,
+                 int* ret) const;
+
+  // adds the scalar to `window`, under the lock of the window only
+  bool Aggregate(ScalarAggregator::Window* window, float value,
+                 int64_t step, int* ret) const;
+
+  // the statistics of a closed window as one summary, resets the window
+  tensorboard::Summary* WindowSummary(ScalarAggregator::Window* window,
+                                      int64_t* step) const;
+
+  int WritePendingWindows() const;
+
+  // writes Stats() every stats_interval_ seconds until stopped
+  void LogStats();
+
+  void StopStatsLogging();
+
+  void Journaled(JournalEntry::Call call, const std::string& tag,
+                 int64_t step, uint64_t count, uint64_t bytes,
+                 const ImageMetadata* image = nullptr) const;
+
   int AddProjectConfig(const std::string& tag, const std::string& dir,
                        const std::string& metadata_filename,
                        const std::string& label_img_filename,
                        int64_t global_step) const;
 
+  int LoadProjectConfig();
+
+  int SyncProjectConfig() const;
+
  private:
+  using EmbeddingKey = std::pair<std::string, int64_t>;
+
   std::string                       log_dir_;
   WriterMaker                       make_writer_;
   mutable Writer*                   writer_{nullptr};
-  std::map<std::string, Writer*>    writers_;
+  Slot*                             slot_{nullptr};
+  std::atomic<Slot*>                blob_slot_{nullptr};
+  std::map<std::string, Slot*>      writers_;
+  mutable std::mutex                writers_lock_;
+  // (main tag, key) of AddScalars to its writer, skips building the path
+  // and checking the directory on every call
+  std::unordered_map<std::string,
+                     std::unordered_map<std::string, Slot*>>  scalars_;
+  size_t                            max_open_{0};
+  mutable std::atomic<size_t>       open_{0};
+  mutable std::atomic<uint64_t>     ticks_{0};
+
+  // tells the stages of recorders apart in the caches of the threads
+  const uint64_t                    id_;
+  size_t                            staging_{0};
+  mutable std::atomic<int>          batching_{0};
+  mutable std::vector<std::unique_ptr<Stage>>   stages_;
+  mutable std::mutex                stages_lock_;
+
+  mutable std::unordered_map<std::string,
+                             std::unique_ptr<TagHandle::Interned>>  interned_;
+
+  // guards the state of budgets, projector config and interned tags
+  mutable std::mutex                state_lock_;
+
+  // projector config entries keyed by (tag, step), the config file is
+  // rewritten from this index instead of being appended on every call
+  mutable std::map<EmbeddingKey, std::string>   embeddings_;
+  mutable double                    embeddings_synced_{0.0};
+  mutable bool                      embeddings_dirty_{false};
+
+  // the samplers are looked up under a shared lock, and only inserted or
+  // replaced under an exclusive one
+  std::atomic<bool>                 sampled_{false};
+  mutable std::shared_timed_mutex   samplers_lock_;
+  SamplingPolicy                    sampling_;
+  mutable std::unordered_map<std::string,
+                             std::unique_ptr<Sampler>>  samplers_;
+  mutable ScalarAggregator          aggregator_;
+  mutable SummaryBudget             budget_;
+  mutable MemoryBudget              memory_;
+
+  // encoding done by the recorder for the writers
+  mutable StatsCounters             stats_;
+  std::thread                       stats_logger_;
+  std::mutex                        stats_lock_;
+  std::condition_variable           stats_wakeup_;
+  bool                              stats_stop_{false};
+  double                            stats_interval_{0.0};
+  std::string                       stats_prefix_;
+  std::atomic<Journal*>             journal_{nullptr};
 };
 
 }  // namespace nlptk
@@ -14,14 +14,25 @@
 
 #include "record/recorder.h"
 
+#include <dirent.h>
+#include <unistd.h>
+
+#include <chrono>                 // NOLINT(build/c++11)
+#include <cstring>
 #include <fstream>
 #include <random>
 #include <sstream>
+#include <thread>                 // NOLINT(build/c++11)
 #include <utility>
 
 #include "glog/logging.h"
 #include "gtest/gtest.h"
 #include "record/async_file_writer.h"
+#include "record/event_file.h"
+#include "record/event_reader.h"
+#include "record/file_writer.h"
+#include "record/io_executor.h"
+#include "record/summary.h"
 #include "record/utils.h"
 #include "utils/image.h"
 
@@ -32,7 +43,10 @@ using std::vector;
 
 using nlptk::AsyncFileWriter;
 using nlptk::Image;
+using nlptk::AggregationPolicy;
+using nlptk::BudgetPolicy;
 using nlptk::Recorder;
+using nlptk::SamplingPolicy;
 using nlptk::StringUtil;
 using nlptk::Writer;
 
@@ -199,3 +213,649 @@ TEST(Recorder, AsyncFileWriter) {
     EXPECT_LT(0, recorder.AddScalar("async_scalar", normal(gen) + 0.01 * i, i));
   }
 }
+
+TEST(Recorder, AddEmbeddingTwice) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  string dir = "runs";
+  vector<float> mat = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6};
+  for (int round = 0; round < 2; ++round) {
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+    EXPECT_LT(0, recorder.AddEmbedding(mat, 3, 2, {}, 7, "embedding_dup"));
+    EXPECT_LT(0, recorder.AddEmbedding(mat, 3, 2, {}, 7, "embedding_dup"));
+    EXPECT_LT(0, recorder.AddEmbedding(mat, 3, 2, {}, 8, "embedding_dup"));
+    EXPECT_EQ(0, recorder.Flush());
+  }
+
+  auto config = ReadBinaryFile(dir + "/projector_config.pbtxt");
+  size_t count = 0;
+  for (size_t pos = 0;
+       (pos = config.find("\"embedding_dup:00007\"", pos)) != string::npos;
+       ++pos) {
+    ++count;
+  }
+
+  EXPECT_EQ(1, count);
+  EXPECT_NE(string::npos, config.find("\"embedding_dup:00008\""));
+}
+
+static int CountTag(const string& dir, const string& tag) {
+  int count = 0;
+  for (const auto& path : nlptk::ListEventFiles(dir + "/events")) {
+    nlptk::EventReader reader(path);
+    tensorboard::Event event;
+    while (reader.Next(tag, &event) > 0) {
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+TEST(Recorder, Sampling) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  vector<int> kept;
+  for (int round = 0; round < 2; ++round) {
+    string dir = StringUtil::Format("runs/sampling%d", round);
+    {
+      Recorder recorder(dir);
+      ASSERT_TRUE(recorder.Ready());
+
+      SamplingPolicy every;
+      every.mode = SamplingPolicy::kEveryN;
+      every.every_n = 10;
+      recorder.SetSampling("every", every);
+
+      SamplingPolicy reservoir;
+      reservoir.mode = SamplingPolicy::kReservoir;
+      reservoir.size = 10;
+      reservoir.seed = 42;
+      recorder.SetSampling("", reservoir);
+
+      for (int64_t i = 0; i < 1000; ++i) {
+        recorder.AddScalar("every", 0.1 * i, i);
+        recorder.AddScalar("reservoir", 0.1 * i, i);
+      }
+    }
+
+    EXPECT_EQ(100, CountTag(dir, "every"));
+    kept.push_back(CountTag(dir, "reservoir"));
+    EXPECT_LE(10, kept.back());
+    EXPECT_GT(100, kept.back());
+  }
+
+  // the same seed keeps the same calls
+  EXPECT_EQ(kept[0], kept[1]);
+
+  // the threads share the count of a tag
+  string dir = "runs/sampling_threads";
+  {
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+    SamplingPolicy every;
+    every.mode = SamplingPolicy::kEveryN;
+    every.every_n = 10;
+    recorder.SetSampling("", every);
+
+    vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&recorder] {
+        for (int64_t i = 0; i < 1000; ++i) {
+          recorder.AddScalar("every", 0.1 * i, i);
+        }
+      });
+    }
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  EXPECT_EQ(400, CountTag(dir, "every"));
+}
+
+TEST(Recorder, Aggregation) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  string dir = "runs/aggregation";
+  {
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+
+    AggregationPolicy policy;
+    policy.window_steps = 10;
+    policy.max = true;
+    policy.count = true;
+    recorder.SetAggregation("loss", policy);
+    recorder.SetAggregation("acc", policy);
+
+    // an interned tag keeps its window
+    auto acc = recorder.Intern("acc");
+    for (int64_t i = 0; i < 95; ++i) {
+      recorder.AddScalar("loss", i, i);
+      recorder.AddScalar(acc, i, i);
+    }
+  }
+
+  EXPECT_EQ(10, CountTag(dir, "loss"));
+  EXPECT_EQ(10, CountTag(dir, "acc"));
+
+  auto path = nlptk::ListEventFiles(dir + "/events").back();
+  nlptk::EventReader reader(path);
+  tensorboard::Event event;
+  ASSERT_EQ(1, reader.Next("loss", &event));
+  ASSERT_EQ(3, event.summary().value_size());
+  EXPECT_EQ(9, event.step());
+  EXPECT_EQ(4.5f, event.summary().value(0).simple_value());
+  EXPECT_EQ("loss/max", event.summary().value(1).tag());
+  EXPECT_EQ(9.0f, event.summary().value(1).simple_value());
+  EXPECT_EQ("loss/count", event.summary().value(2).tag());
+  EXPECT_EQ(10.0f, event.summary().value(2).simple_value());
+
+  // the last window is written by the destructor
+  while (reader.Next("loss", &event) > 0) {
+  }
+
+  EXPECT_EQ(94, event.step());
+  EXPECT_EQ(5.0f, event.summary().value(2).simple_value());
+
+  // the calls taken by a window are charged with their cpu time
+  Recorder recorder("runs/aggregation_budget");
+  ASSERT_TRUE(recorder.Ready());
+  AggregationPolicy policy;
+  policy.window_steps = 100000;
+  recorder.SetAggregation("", policy);
+  BudgetPolicy budget;
+  budget.max_cpu_secs = 1e-9;
+  budget.window_secs = 60.0;
+  recorder.SetBudget(nlptk::kScalarSummary, budget);
+  auto acc = recorder.Intern("acc");
+  for (int64_t i = 0; i < 1000; ++i) {
+    EXPECT_LE(0, recorder.AddScalar("loss", i, i));
+    EXPECT_LE(0, recorder.AddScalar(acc, i, i));
+  }
+
+  EXPECT_LT(0, recorder.Dropped("loss"));
+  EXPECT_LT(0, recorder.Dropped("acc"));
+}
+
+TEST(Recorder, Budget) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  string dir = "runs/budget";
+  Recorder recorder(dir);
+  ASSERT_TRUE(recorder.Ready());
+
+  BudgetPolicy policy;
+  policy.min_interval_secs = 60.0;
+  recorder.SetBudget(nlptk::kTextSummary, policy);
+
+  for (int64_t i = 0; i < 10; ++i) {
+    recorder.AddText("note", "text", i);
+    EXPECT_LT(0, recorder.AddScalar("loss", 0.1 * i, i));
+  }
+
+  EXPECT_EQ(0, recorder.Flush());
+  EXPECT_EQ(1, CountTag(dir, "note/text_summary"));
+  EXPECT_EQ(9, recorder.Dropped("note"));
+  EXPECT_EQ(9, recorder.Dropped(nlptk::kTextSummary));
+  EXPECT_EQ(0, recorder.Dropped(nlptk::kScalarSummary));
+
+  // a call of AddScalars is admitted once for the main tag
+  recorder.SetBudget(nlptk::kScalarSummary, policy);
+  EXPECT_LT(0, recorder.AddScalars("group", {{"a", 0.1f}, {"b", 0.2f}}, 0));
+  for (int64_t i = 1; i < 10; ++i) {
+    EXPECT_EQ(0, recorder.AddScalars("group", {{"a", 0.1f}, {"b", 0.2f}}, i));
+  }
+
+  EXPECT_EQ(9, recorder.Dropped("group"));
+  EXPECT_EQ(9, recorder.Dropped(nlptk::kScalarSummary));
+}
+
+TEST(Recorder, Threads) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  const int kThreads = 8;
+  const int kSteps = 2000;
+  for (size_t staging : {0, 4096}) {
+    string dir = StringUtil::Format("runs/threads%zu", staging);
+    {
+      Recorder recorder(dir);
+      ASSERT_TRUE(recorder.Ready());
+      recorder.SetStaging(staging);
+
+      AggregationPolicy policy;
+      policy.window_steps = 10;
+      policy.count = true;
+      recorder.SetAggregation("shared", policy);
+
+      vector<std::thread> threads;
+      for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&recorder, t] {
+          auto tag = StringUtil::Format("thread%d", t);
+          for (int64_t i = 0; i < kSteps; ++i) {
+            recorder.AddScalar(tag, 0.1 * i, i);
+            recorder.AddScalar("shared", t, i);
+            if (i % 100 == 0) {
+              recorder.AddScalars("group", {{"a", 0.1f * t}, {"b", 0.2f * t}},
+                                  i);
+              recorder.AddHistogram("histogram", {0.1 * t, 0.2 * i}, i);
+            }
+          }
+
+          recorder.Flush();
+        });
+      }
+
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    }
+
+    for (int t = 0; t < kThreads; ++t) {
+      EXPECT_EQ(kSteps, CountTag(dir, StringUtil::Format("thread%d", t)));
+    }
+
+    // windows flushed early are partial, but no scalar is lost
+    int64_t shared = 0;
+    auto path = nlptk::ListEventFiles(dir + "/events").back();
+    nlptk::EventReader reader(path);
+    tensorboard::Event event;
+    while (reader.Next("shared", &event) > 0) {
+      shared += event.summary().value(1).simple_value();
+    }
+
+    EXPECT_EQ(kThreads * kSteps, shared);
+    EXPECT_EQ(kThreads * kSteps / 100, CountTag(dir, "histogram"));
+    EXPECT_EQ(kThreads * kSteps / 100, CountTag(dir + "/group_a", "group"));
+  }
+}
+
+static int OpenEventFiles() {
+  int count = 0;
+  auto dir = opendir("/proc/self/fd");
+  if (nullptr == dir) {
+    return -1;
+  }
+
+  char target[4096];
+  while (auto entry = readdir(dir)) {
+    auto path = string("/proc/self/fd/") + entry->d_name;
+    auto n = readlink(path.c_str(), target, sizeof(target) - 1);
+    if (n > 0) {
+      target[n] = '\0';
+      if (strstr(target, ".out.tfevents.") != nullptr) {
+        ++count;
+      }
+    }
+  }
+
+  closedir(dir);
+  return count;
+}
+
+TEST(Recorder, MaxOpenWriters) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  string dir = "runs/max_open";
+  {
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+    recorder.SetMaxOpenWriters(4);
+
+    for (int64_t step = 0; step < 20; ++step) {
+      std::map<string, float> values;
+      for (int key = 0; key < 16; ++key) {
+        values[StringUtil::Format("k%02d", key)] = 0.1 * step;
+      }
+
+      EXPECT_LT(0, recorder.AddScalars("sweep", values, step));
+    }
+
+    // the main writer and at most 4 sub writers
+    EXPECT_GE(5, OpenEventFiles());
+  }
+
+  for (int key = 0; key < 16; ++key) {
+    auto sub = StringUtil::Format("%s/sweep_k%02d", dir.c_str(), key);
+    EXPECT_EQ(1, nlptk::ListEventFiles(sub + "/events").size());
+    EXPECT_EQ(20, CountTag(sub, "sweep"));
+  }
+}
+
+TEST(Recorder, Intern) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  for (auto tag : {string("loss"), string(200, 'a'), string(1000, 'b')}) {
+    auto prefix = nlptk::ScalarEventPrefix(tag);
+    for (int64_t step : {-1L, 0L, 300L, 1L << 40}) {
+      tensorboard::Event event;
+      event.set_wall_time(1.25);
+      if (step >= 0) {
+        event.set_step(step);
+      }
+
+      auto v = event.mutable_summary()->add_value();
+      v->set_tag(tag);
+      v->set_simple_value(0.5f);
+
+      string buf(prefix.size() + nlptk::kScalarEventOverhead, '\0');
+      buf.resize(nlptk::EncodeScalarEvent(prefix, 1.25, step, 0.5f, &buf[0]));
+      EXPECT_EQ(event.SerializeAsString(), buf);
+    }
+  }
+
+  string dir = "runs/intern";
+  {
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+    EXPECT_FALSE(nlptk::TagHandle().Valid());
+    EXPECT_EQ(-1, recorder.AddScalar(nlptk::TagHandle(), 1.0f, 0));
+
+    auto loss = recorder.Intern("loss");
+    auto long_tag = recorder.Intern(string(1000, 'c'));
+    ASSERT_TRUE(loss.Valid());
+    for (int64_t i = 0; i < 100; ++i) {
+      EXPECT_LT(0, recorder.AddScalar(loss, 0.1 * i, i));
+      EXPECT_LT(0, recorder.AddScalar(long_tag, 0.1 * i, i));
+    }
+  }
+
+  EXPECT_EQ(100, CountTag(dir, "loss"));
+  EXPECT_EQ(100, CountTag(dir, string(1000, 'c')));
+}
+
+TEST(Recorder, StepBatch) {
+  string dir = "runs/step_batch";
+  {
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+    auto acc = recorder.Intern("acc");
+    for (int64_t i = 0; i < 10; ++i) {
+      auto batch = recorder.BeginStep(i);
+      EXPECT_LT(0, recorder.AddScalar("loss", 0.1 * i, i));
+      EXPECT_LT(0, recorder.AddScalar(acc, 0.2 * i));
+      EXPECT_LT(0, recorder.AddHistogram("weights", {1.0, 2.0, 3.0}, i));
+      EXPECT_LT(0, recorder.AddText("note", "step", i));
+      // a different step is not held back
+      EXPECT_LT(0, recorder.AddScalar("other", 1.0f, i + 100));
+      if (i % 2) {
+        EXPECT_LT(0, batch.Commit());
+        EXPECT_EQ(0, batch.Commit());
+      }
+    }
+  }
+
+  int events = 0;
+  for (const auto& path : nlptk::ListEventFiles(dir + "/events")) {
+    nlptk::EventReader reader(path);
+    tensorboard::Event event;
+    while (reader.Next(&event) > 0) {
+      if (!event.has_summary()) {
+        continue;
+      }
+
+      if (event.summary().value(0).tag() == "other") {
+        EXPECT_EQ(1, event.summary().value_size());
+        EXPECT_LE(100, event.step());
+        continue;
+      }
+
+      ASSERT_EQ(4, event.summary().value_size());
+      EXPECT_EQ(events, event.step());
+      EXPECT_EQ("loss", event.summary().value(0).tag());
+      EXPECT_EQ("acc", event.summary().value(1).tag());
+      EXPECT_EQ("weights", event.summary().value(2).tag());
+      EXPECT_EQ("note/text_summary", event.summary().value(3).tag());
+      ++events;
+    }
+  }
+
+  EXPECT_EQ(10, events);
+}
+
+TEST(Recorder, Blob) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  for (size_t size : {1, 300, 200000}) {
+    string payload(size, 'x');
+    for (int64_t step : {-1L, 0L, 7L}) {
+      for (bool image : {true, false}) {
+        std::unique_ptr<tensorboard::Summary> summary(
+            image ? nlptk::ImageBlob("blob", 4, 5, 3)
+                  : nlptk::AudioBlob("blob", 16000.0f, 1, size, "audio/wav"));
+        string head, tail;
+        ASSERT_EQ(0, nlptk::EncodeBlobEvent(*summary, 1.5, step, size, &head,
+                                            &tail));
+
+        auto value = summary->mutable_value(0);
+        if (image) {
+          value->mutable_image()->set_encoded_image_string(payload);
+        } else {
+          value->mutable_audio()->set_encoded_audio_string(payload);
+        }
+
+        tensorboard::Event event;
+        event.set_wall_time(1.5);
+        if (step >= 0) {
+          event.set_step(step);
+        }
+
+        event.set_allocated_summary(summary.release());
+        EXPECT_EQ(event.SerializeAsString(), head + payload + tail);
+      }
+    }
+  }
+
+  for (bool async : {false, true}) {
+    string dir = async ? "runs/blob_async" : "runs/blob";
+    string large(1 << 20, 'i');
+    string small(100, 'a');
+    int released = 0;
+    {
+      Recorder recorder(dir, [&](const string& p) -> Writer* {
+        if (async) {
+          return new AsyncFileWriter(p);
+        }
+
+        return new nlptk::FileWriter(p);
+      });
+      ASSERT_TRUE(recorder.Ready());
+      nlptk::Blob view(large.data(), large.size(), [&] { ++released; });
+      EXPECT_LT(0, recorder.AddImage("large", std::move(view),
+                                     {1024, 1024, 1}, 1));
+      EXPECT_LT(0, recorder.AddAudio("small", string(small),
+                                     {1, 100, 8000.0f}, 2));
+      EXPECT_LT(0, recorder.AddScalar("scalar", 1.0f, 3));
+      EXPECT_EQ(-1, recorder.AddImage("empty", nlptk::Blob(), {1, 1, 1}, 4));
+      recorder.Flush();
+      EXPECT_EQ(1, released);
+    }
+
+    EXPECT_EQ(1, released);
+    int values = 0;
+    for (const auto& path : nlptk::ListEventFiles(dir + "/events")) {
+      nlptk::EventReader reader(path);
+      tensorboard::Event event;
+      while (reader.Next(&event) > 0) {
+        for (const auto& value : event.summary().value()) {
+          if (value.tag() == "large") {
+            EXPECT_EQ(1, event.step());
+            EXPECT_EQ(1024, value.image().height());
+            EXPECT_EQ(large, value.image().encoded_image_string());
+          } else if (value.tag() == "small") {
+            EXPECT_EQ(2, event.step());
+            EXPECT_EQ("audio/wav", value.audio().content_type());
+            EXPECT_EQ(small, value.audio().encoded_audio_string());
+          } else {
+            EXPECT_EQ("scalar", value.tag());
+          }
+
+          ++values;
+        }
+      }
+    }
+
+    EXPECT_EQ(3, values);
+  }
+}
+
+TEST(Recorder, MemoryBudget) {
+  // the only thread of the executor is stalled, so records stay queued
+  nlptk::IoExecutor executor(1);
+  std::mutex stall;
+  std::unique_lock<std::mutex> stalled{stall};
+  auto blocker = executor.Register([&] {
+    std::lock_guard<std::mutex> lock{stall};
+    return nlptk::IoExecutor::Clock::time_point::max();
+  });
+  executor.Notify(blocker);
+
+  string dir = "runs/memory_budget";
+  string img(1 << 16, 'i');
+  {
+    Recorder recorder(dir, [&](const string& p) -> Writer* {
+      return new AsyncFileWriter(p, nlptk::WriterOptions(), &executor);
+    });
+    ASSERT_TRUE(recorder.Ready());
+
+    nlptk::MemoryPolicy policy;
+    policy.max_bytes = 4 * img.size();
+    recorder.SetMemoryBudget(policy);
+    int images = 0;
+    for (int64_t i = 0; i < 20; ++i) {
+      images += recorder.AddImage("img", img, {256, 256, 1}, i);
+      EXPECT_LT(0, recorder.AddScalar("loss", 0.1 * i, i));
+    }
+
+    EXPECT_LT(0, images);
+    EXPECT_LT(0, recorder.QueuedBytes());
+    EXPECT_LE(recorder.QueuedBytes(), policy.max_bytes);
+    EXPECT_LT(0, recorder.Dropped("img"));
+    EXPECT_EQ(0, recorder.Dropped("loss"));
+    EXPECT_EQ(recorder.Dropped("img"), recorder.Dropped(nlptk::kImageSummary));
+
+    policy.mode = nlptk::MemoryPolicy::Mode::kFailFast;
+    recorder.SetMemoryBudget(policy);
+    int ret = 0;
+    for (int64_t i = 20; i < 30 && ret >= 0; ++i) {
+      ret = recorder.AddImage("img", img, {256, 256, 1}, i);
+    }
+
+    EXPECT_EQ(-1, ret);
+    EXPECT_LE(recorder.QueuedBytes(), policy.max_bytes);
+
+    stalled.unlock();
+    recorder.Flush();
+    EXPECT_EQ(0, recorder.QueuedBytes());
+    EXPECT_LT(0, recorder.AddImage("img", img, {256, 256, 1}, 30));
+  }
+
+  executor.Unregister(blocker);
+  EXPECT_EQ(20, CountTag(dir, "loss"));
+}
+
+TEST(Recorder, Stats) {
+  string dir = "runs/stats";
+  {
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+    recorder.SetStatsLogging(0.01);
+    for (int64_t i = 0; i < 100; ++i) {
+      EXPECT_LT(0, recorder.AddScalar("loss", 0.1 * i, i));
+    }
+
+    recorder.Flush();
+    auto stats = recorder.Stats();
+    // the reports of the stats count as well
+    EXPECT_LE(100, stats.events);
+    EXPECT_LT(100 * 16, stats.bytes);
+    EXPECT_LT(0, stats.flushes);
+    EXPECT_EQ(0, stats.queue_depth);
+    EXPECT_LT(0.0, stats.serialize_secs);
+    EXPECT_LT(0.0, stats.Latency(0.99));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  EXPECT_EQ(100, CountTag(dir, "loss"));
+  EXPECT_LT(0, CountTag(dir, "tensorboard.cpp/events"));
+  EXPECT_LT(0, CountTag(dir, "tensorboard.cpp/latency_p99"));
+}
+
+TEST(Recorder, MemoryBudgetScalars) {
+  nlptk::IoExecutor executor(1);
+  std::mutex stall;
+  std::unique_lock<std::mutex> stalled{stall};
+  auto blocker = executor.Register([&] {
+    std::lock_guard<std::mutex> lock{stall};
+    return nlptk::IoExecutor::Clock::time_point::max();
+  });
+  executor.Notify(blocker);
+
+  {
+    Recorder recorder("runs/memory_budget_scalars", [&](const string& p) {
+      return new AsyncFileWriter(p, nlptk::WriterOptions(), &executor);
+    });
+    ASSERT_TRUE(recorder.Ready());
+
+    nlptk::MemoryPolicy policy;
+    policy.mode = nlptk::MemoryPolicy::Mode::kFailFast;
+    policy.max_bytes = 4096;
+    recorder.SetMemoryBudget(policy);
+    // the writers of the groups queue the records of AddScalars as well
+    int ret = 0;
+    int64_t step = 0;
+    for (; step < 1000 && ret >= 0; ++step) {
+      ret = recorder.AddScalars("group", {{"a", 0.1f}, {"b", 0.2f}}, step);
+    }
+
+    EXPECT_EQ(-1, ret);
+    EXPECT_LT(step, 1000);
+    EXPECT_LT(0, recorder.Dropped("group"));
+    EXPECT_LE(recorder.QueuedBytes(), policy.max_bytes + 1024);
+
+    stalled.unlock();
+    recorder.Flush();
+    EXPECT_EQ(0, recorder.QueuedBytes());
+  }
+
+  executor.Unregister(blocker);
+}
+
+TEST(Recorder, BlobRouting) {
+  string dir = "runs/blob_routing";
+  {
+    Recorder recorder(dir);
+    ASSERT_TRUE(recorder.Ready());
+    recorder.SetBlobRouting(true);
+    for (int64_t i = 0; i < 10; ++i) {
+      EXPECT_LT(0, recorder.AddScalar("loss", 0.1 * i, i));
+      EXPECT_LT(0, recorder.AddHistogram("weights", {1.0, 2.0}, i));
+      EXPECT_LT(0, recorder.AddImage("image", string(64, 'i'), {8, 8, 1}, i));
+      EXPECT_LT(0, recorder.AddAudio("audio", string(64, 'a'), {1, 64}, i));
+      EXPECT_LT(0, recorder.AddText("note", "short", i));
+    }
+
+    EXPECT_LT(0, recorder.AddText("log", string(1 << 16, 'l'), 0));
+    recorder.SetBlobRouting(false);
+    EXPECT_LT(0, recorder.AddImage("image", string(64, 'i'), {8, 8, 1}, 10));
+  }
+
+  auto count = [&](const string& prefix, const string& tag) {
+    int n = 0;
+    for (const auto& path : nlptk::ListEventFiles(dir + "/" + prefix)) {
+      nlptk::EventReader reader(path);
+      tensorboard::Event event;
+      while (reader.Next(tag, &event) > 0) {
+        ++n;
+      }
+    }
+
+    return n;
+  };
+
+  EXPECT_EQ(10, count("events", "loss"));
+  EXPECT_EQ(10, count("events", "weights"));
+  EXPECT_EQ(10, count("events", "note/text_summary"));
+  EXPECT_EQ(1, count("events", "image"));
+  EXPECT_EQ(0, count("events", "audio"));
+  EXPECT_EQ(10, count("events.blobs", "image"));
+  EXPECT_EQ(10, count("events.blobs", "audio"));
+  EXPECT_EQ(1, count("events.blobs", "log/text_summary"));
+  EXPECT_EQ(0, count("events.blobs", "loss"));
+}
@@ -0,0 +1,363 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/sharded_writer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "glog/logging.h"
+#include "record/event_reader.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+// FNV-1a, stable across platforms and runs, so a resumed writer keeps the
+// tags in their shards
+static uint64_t HashTag(const string& tag) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (auto c : tag) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+ShardedWriter::Shard::Shard(const string& prefix, const WriterOptions& options)
+    : file(prefix, options) {
+}
+
+ShardedWriter::ShardedWriter(const string& prefix, size_t shards,
+                             const WriterOptions& options,
+                             IoExecutor* executor)
+    : executor_(executor != nullptr ? executor : IoExecutor::Default()) {
+  shards = std::max<size_t>(1, shards);
+  ready_ = true;
+  for (size_t i = 0; i < shards; ++i) {
+    auto path = StringUtil::Format("%s.%zu", prefix.c_str(), i);
+    shards_.emplace_back(new Shard(path, options));
+    shards_.back()->file.SetStats(&stats_);
+    if (shards_.back()->file.Open(options.resume) < 0) {
+      LOG(ERROR) << "Failed to open shard " << i << " of '" << prefix << "'";
+      ready_ = false;
+    }
+  }
+
+  if (!ready_) {
+    for (auto& shard : shards_) {
+      if (shard->file.IsOpen()) {
+        shard->file.Close();
+      }
+    }
+
+    return;
+  }
+
+  for (auto& shard : shards_) {
+    auto ptr = shard.get();
+    shard->task = executor_->Register([this, ptr] { return Run(ptr); });
+  }
+}
+
+ShardedWriter::~ShardedWriter() {
+  Close();
+}
+
+std::function<Writer*(const string&)> ShardedWriter::Maker(
+    size_t shards, const WriterOptions& options, IoExecutor* executor) {
+  return [shards, options, executor](const string& prefix) -> Writer* {
+    return new ShardedWriter(prefix, shards, options, executor);
+  };
+}
+
+int ShardedWriter::Write(tensorboard::Event&& event) {
+  if (!ready_) {
+    return -1;
+  }
+
+  const auto& summary = event.summary();
+  auto shard = summary.value_size() > 0 ? ShardOf(summary.value(0).tag()) : 0;
+  int size = event.ByteSizeLong();
+  Item item;
+  item.event = std::move(event);
+  item.charged = kRecordHeaderSize + size + kRecordFooterSize;
+  return Enqueue(shard, std::move(item)) < 0 ? -1 : size;
+}
+
+int ShardedWriter::WriteRecords(const char* data, size_t size,
+                                size_t records) {
+  if (!ready_ || size == 0) {
+    return -1;
+  }
+
+  if (shards_.size() == 1) {
+    Item item;
+    item.records.assign(data, size);
+    item.count = records;
+    item.charged = size;
+    return Enqueue(0, std::move(item)) < 0 ? -1 : size;
+  }
+
+  vector<Item> items(shards_.size());
+  EventMeta meta;
+  size_t pos = 0;
+  while (pos + kRecordHeaderSize + kRecordFooterSize <= size) {
+    uint64_t len = 0;
+    memcpy(&len, data + pos, sizeof(len));
+    auto framed = kRecordHeaderSize + len + kRecordFooterSize;
+    if (pos + framed > size) {
+      break;
+    }
+
+    EventReader::Peek(data + pos + kRecordHeaderSize, len, &meta);
+    auto& item = items[meta.tags.empty() ? 0 : ShardOf(meta.tags[0])];
+    item.records.append(data + pos, framed);
+    ++item.count;
+    pos += framed;
+  }
+
+  for (size_t i = 0; i < items.size(); ++i) {
+    items[i].charged = items[i].records.size();
+    if (items[i].count > 0 && Enqueue(i, std::move(items[i])) < 0) {
+      return -1;
+    }
+  }
+
+  return pos;
+}
+
+void ShardedWriter::SetMemoryBudget(MemoryBudget* budget) {
+  memory_ = budget;
+}
+
+int ShardedWriter::Flush() {
+  return Flush(false);
+}
+
+int ShardedWriter::Suspend() {
+  return Flush(true);
+}
+
+int ShardedWriter::Flush(bool suspend) {
+  if (!ready_) {
+    return -1;
+  }
+
+  vector<uint64_t> targets;
+  for (auto& shard : shards_) {
+    {
+      std::lock_guard<std::mutex> lock{shard->lock};
+      targets.push_back(shard->enqueued);
+      shard->flush_requested = true;
+      shard->suspend_requested = shard->suspend_requested || suspend;
+    }
+
+    executor_->Notify(shard->task);
+  }
+
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    auto& shard = shards_[i];
+    std::unique_lock<std::mutex> lock{shard->lock};
+    shard->done.wait(lock, [&] {
+      return shard->flushed >= targets[i] || shard->finished;
+    });
+  }
+
+  return 0;
+}
+
+int ShardedWriter::Close() {
+  if (!ready_) {
+    return -1;
+  }
+
+  ready_ = false;
+  for (auto& shard : shards_) {
+    {
+      std::lock_guard<std::mutex> lock{shard->lock};
+      shard->stop = true;
+    }
+
+    executor_->Notify(shard->task);
+  }
+
+  for (auto& shard : shards_) {
+    {
+      std::unique_lock<std::mutex> lock{shard->lock};
+      shard->done.wait(lock, [&] { return shard->finished; });
+    }
+
+    executor_->Unregister(shard->task);
+  }
+
+  return 0;
+}
+
+int ShardedWriter::Ready() const {
+  return ready_;
+}
+
+int64_t ShardedWriter::LastStep(const string& tag) const {
+  // the resumed steps are fixed before the tasks are registered
+  return shards_[ShardOf(tag)]->file.LastStep(tag);
+}
+
+uint64_t ShardedWriter::QueueDepth() const {
+  uint64_t depth = 0;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock{shard->lock};
+    for (const auto& item : shard->pending) {
+      depth += std::max<size_t>(item.count, 1);
+    }
+  }
+
+  return depth;
+}
+
+size_t ShardedWriter::Shards() const {
+  return shards_.size();
+}
+
+size_t ShardedWriter::ShardOf(const string& tag) const {
+  return HashTag(tag) % shards_.size();
+}
+
+int ShardedWriter::Enqueue(size_t index, Item&& item) {
+  auto& shard = shards_[index];
+  {
+    std::lock_guard<std::mutex> lock{shard->lock};
+    if (shard->stop) {
+      stats_.Add(StatsCounters::kDropped, std::max<size_t>(item.count, 1));
+      return -1;
+    }
+
+    auto memory = memory_.load();
+    if (nullptr != memory) {
+      memory->Add(item.charged);
+    } else {
+      item.charged = 0;
+    }
+
+    item.enqueued = StatsCounters::Now();
+    shard->pending.push_back(std::move(item));
+    ++shard->enqueued;
+  }
+
+  executor_->Notify(shard->task);
+  return 0;
+}
+
+EventFile::Clock::time_point ShardedWriter::Run(Shard* shard) {
+  auto& file = shard->file;
+  std::unique_lock<std::mutex> lock{shard->lock};
+  if (shard->finished) {
+    return EventFile::Clock::time_point::max();
+  }
+
+  while (true) {
+    vector<Item> items;
+    items.swap(shard->pending);
+    auto target = shard->enqueued;
+    bool stopping = shard->stop;
+    bool flush = stopping || shard->flush_requested;
+    bool suspend = shard->suspend_requested && !stopping;
+    shard->flush_requested = false;
+    shard->suspend_requested = false;
+    lock.unlock();
+
+    Append(shard, &items);
+    file.Commit(flush);
+    if (suspend) {
+      // records enqueued meanwhile reopen the file
+      file.Suspend();
+    }
+
+    lock.lock();
+    if (flush) {
+      shard->flushed = target;
+      shard->done.notify_all();
+    }
+
+    if (!stopping) {
+      // the file is only touched by this task, so its deadline is stable
+      return file.Deadline();
+    }
+
+    if (shard->pending.empty()) {
+      break;
+    }
+  }
+
+  shard->finished = true;
+  shard->done.notify_all();
+  lock.unlock();
+
+  file.Close();
+  return EventFile::Clock::time_point::max();
+}
+
+void ShardedWriter::Append(Shard* shard, vector<Item>* items) {
+  if (items->empty()) {
+    return;
+  }
+
+  auto& buffer = shard->buffer;
+  buffer.clear();
+  size_t count = 0;
+  size_t charged = 0;
+  uint64_t serialize = 0;
+  uint64_t checksum = 0;
+  for (auto& item : *items) {
+    charged += item.charged;
+    if (item.count > 0) {
+      buffer.append(item.records);
+      count += item.count;
+      continue;
+    }
+
+    // moving a message drops its cached size
+    auto start = StatsCounters::Now();
+    size_t size = item.event.ByteSizeLong();
+    auto pos = buffer.size();
+    buffer.resize(pos + kRecordHeaderSize + size + kRecordFooterSize);
+    item.event.SerializeWithCachedSizesToArray(
+        reinterpret_cast<uint8_t*>(&buffer[pos + kRecordHeaderSize]));
+    auto serialized = StatsCounters::Now();
+    FrameRecord(&buffer[pos], size);
+    serialize += serialized - start;
+    checksum += StatsCounters::Now() - serialized;
+    ++count;
+  }
+
+  stats_.Add(StatsCounters::kSerializeNanos, serialize);
+  stats_.Add(StatsCounters::kChecksumNanos, checksum);
+  auto& file = shard->file;
+  if (file.NeedRotate()) {
+    file.Rotate();
+  }
+
+  // the latency of a round is that of its oldest record
+  file.Append(buffer.data(), buffer.size(), count, (*items)[0].enqueued);
+  auto memory = memory_.load();
+  if (charged > 0 && nullptr != memory) {
+    memory->Release(charged);
+  }
+}
+
+}  // namespace nlptk
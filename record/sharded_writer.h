@@ -0,0 +1,131 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_SHARDED_WRITER_H_
+#define RECORD_SHARDED_WRITER_H_
+
+#include <atomic>
+#include <condition_variable>     // NOLINT(build/c++11)
+#include <functional>
+#include <memory>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+
+#include "record/budget.h"
+#include "record/event_file.h"
+#include "record/io_executor.h"
+#include "record/writer.h"
+
+namespace nlptk {
+
+// Fans events out to `shards` event files "<prefix>.<i>" of the same run
+// directory. Each shard is a task of an IoExecutor shared with other
+// writers, which also serializes and frames the events, so the throughput
+// scales with the threads of the executor instead of a single core, and
+// the number of threads does not grow with the number of writers.
+// Events go to the shard of the tag of their first value, so the series
+// of a tag stays ordered within one file and TensorBoard merges the files.
+// Resuming with another number of shards moves tags between files.
+class ShardedWriter : public Writer {
+ public:
+  // `executor` defaults to IoExecutor::Default() and must outlive the writer
+  ShardedWriter(const std::string& path_prefix, size_t shards,
+                const WriterOptions& options = WriterOptions(),
+                IoExecutor* executor = nullptr);
+
+  ~ShardedWriter();
+
+  // A Recorder::WriterMaker of sharded writers.
+  static std::function<Writer*(const std::string&)> Maker(
+      size_t shards, const WriterOptions& options = WriterOptions(),
+      IoExecutor* executor = nullptr);
+
+  int Write(tensorboard::Event&& event) override;
+
+  // the records are split by their tags across the shards
+  int WriteRecords(const char* data, size_t size, size_t records) override;
+
+  void SetMemoryBudget(MemoryBudget* budget) override;
+
+  int Flush() override;
+
+  int Close() override;
+
+  int Ready() const override;
+
+  // flushes and closes the files of all shards, they are reopened by the
+  // next records
+  int Suspend() override;
+
+  int64_t LastStep(const std::string& tag) const override;
+
+  size_t Shards() const;
+
+  // shard of the events of `tag`
+  size_t ShardOf(const std::string& tag) const;
+
+ private:
+  // an event to serialize, or framed records if `count` is not zero
+  struct Item {
+    tensorboard::Event      event;
+    std::string             records;
+    size_t                  count{0};
+    // bytes charged to the memory budget
+    size_t                  charged{0};
+    // StatsCounters::Now() when queued
+    uint64_t                enqueued{0};
+  };
+
+  struct Shard {
+    explicit Shard(const std::string& prefix, const WriterOptions& options);
+
+    EventFile                 file;
+    uint64_t                  task{0};
+    // framed records of a round, only touched by the task
+    std::string               buffer;
+    std::mutex                lock;
+    std::condition_variable   done;
+    std::vector<Item>         pending;
+    uint64_t                  enqueued{0};
+    uint64_t                  flushed{0};
+    bool                      flush_requested{false};
+    bool                      suspend_requested{false};
+    bool                      stop{false};
+    bool                      finished{false};
+  };
+
+  int Flush(bool suspend);
+
+  int Enqueue(size_t shard, Item&& item);
+
+  // a round of writing of `shard` run by the executor, returns the next
+  // deadline of its file
+  EventFile::Clock::time_point Run(Shard* shard);
+
+  // serializes and writes the items, then gives back their memory
+  void Append(Shard* shard, std::vector<Item>* items);
+
+  uint64_t QueueDepth() const override;
+
+ private:
+  std::vector<std::unique_ptr<Shard>>   shards_;
+  IoExecutor*                           executor_{nullptr};
+  std::atomic<MemoryBudget*>            memory_{nullptr};
+  std::atomic<bool>                     ready_{false};
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_SHARDED_WRITER_H_
@@ -0,0 +1,210 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/sharded_writer.h"
+
+#include <map>
+#include <mutex>                  // NOLINT(build/c++11)
+#include <string>
+#include <thread>                 // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "record/event_file.h"
+#include "record/event_reader.h"
+#include "record/io_executor.h"
+#include "record/recorder.h"
+#include "record/utils.h"
+
+namespace nlptk {
+
+using std::string;
+using std::vector;
+
+// shard of every tag and the steps of the tag in order of the files
+static void ReadShards(const string& prefix, size_t shards,
+                       std::map<string, size_t>* owners,
+                       std::map<string, vector<int64_t>>* steps) {
+  for (size_t i = 0; i < shards; ++i) {
+    auto shard = StringUtil::Format("%s.%zu", prefix.c_str(), i);
+    for (const auto& path : ListEventFiles(shard)) {
+      EventReader reader(path);
+      tensorboard::Event event;
+      while (reader.Next(&event) > 0) {
+        for (const auto& value : event.summary().value()) {
+          auto iter = owners->emplace(value.tag(), i).first;
+          EXPECT_EQ(i, iter->second) << value.tag();
+          (*steps)[value.tag()].push_back(event.step());
+        }
+      }
+    }
+  }
+}
+
+TEST(ShardedWriter, Write) {
+  const int kTags = 32;
+  const int kThreads = 4;
+  ASSERT_EQ(0, MakeDirs("runs/sharded"));
+  {
+    ShardedWriter writer("runs/sharded/events", 4);
+    ASSERT_TRUE(writer.Ready());
+    EXPECT_EQ(4, writer.Shards());
+
+    vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t] {
+        for (int64_t step = 0; step < 100; ++step) {
+          for (int i = t; i < kTags; i += kThreads) {
+            tensorboard::Event event;
+            event.set_step(step);
+            auto value = event.mutable_summary()->add_value();
+            value->set_tag(StringUtil::Format("tag%d", i));
+            value->set_simple_value(step);
+            EXPECT_LT(0, writer.Write(std::move(event)));
+          }
+        }
+      });
+    }
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    EXPECT_EQ(0, writer.Flush());
+  }
+
+  std::map<string, size_t> owners;
+  std::map<string, vector<int64_t>> steps;
+  ReadShards("runs/sharded/events", 4, &owners, &steps);
+  ASSERT_EQ(kTags, steps.size());
+  std::map<size_t, int> used;
+  for (const auto& item : steps) {
+    ASSERT_EQ(100, item.second.size());
+    for (int64_t step = 0; step < 100; ++step) {
+      EXPECT_EQ(step, item.second[step]);
+    }
+
+    ++used[owners[item.first]];
+  }
+
+  EXPECT_LT(1, used.size());
+}
+
+TEST(ShardedWriter, MemoryBudget) {
+  ASSERT_EQ(0, MakeDirs("runs/sharded"));
+  IoExecutor executor(1);
+  std::mutex stall;
+  std::unique_lock<std::mutex> stalled{stall};
+  auto blocker = executor.Register([&] {
+    std::lock_guard<std::mutex> lock{stall};
+    return IoExecutor::Clock::time_point::max();
+  });
+  executor.Notify(blocker);
+
+  MemoryBudget memory;
+  MemoryPolicy policy;
+  policy.max_bytes = 1 << 20;
+  memory.SetPolicy(policy);
+  {
+    ShardedWriter writer("runs/sharded/memory", 2, WriterOptions(),
+                         &executor);
+    ASSERT_TRUE(writer.Ready());
+    writer.SetMemoryBudget(&memory);
+    for (int64_t step = 0; step < 100; ++step) {
+      tensorboard::Event event;
+      event.set_step(step);
+      auto value = event.mutable_summary()->add_value();
+      value->set_tag(StringUtil::Format("tag%d", static_cast<int>(step % 8)));
+      value->set_simple_value(step);
+      EXPECT_LT(0, writer.Write(std::move(event)));
+    }
+
+    // the events are charged until the stalled shards have written them
+    EXPECT_LT(100 * (kRecordHeaderSize + kRecordFooterSize), memory.Used());
+    stalled.unlock();
+    EXPECT_EQ(0, writer.Flush());
+    EXPECT_EQ(0, memory.Used());
+  }
+
+  executor.Unregister(blocker);
+}
+
+TEST(ShardedWriter, Suspend) {
+  ASSERT_EQ(0, MakeDirs("runs/sharded"));
+  {
+    ShardedWriter writer("runs/sharded/suspend", 2);
+    ASSERT_TRUE(writer.Ready());
+    for (int64_t step = 0; step < 30; ++step) {
+      tensorboard::Event event;
+      event.set_step(step);
+      auto value = event.mutable_summary()->add_value();
+      value->set_tag(step % 2 ? "loss" : "acc");
+      value->set_simple_value(step);
+      EXPECT_LT(0, writer.Write(std::move(event)));
+      if (step % 10 == 9) {
+        EXPECT_EQ(0, writer.Suspend());
+        EXPECT_TRUE(writer.Ready());
+      }
+    }
+  }
+
+  // the suspended shards reopen their files
+  std::map<string, size_t> owners;
+  std::map<string, vector<int64_t>> steps;
+  ReadShards("runs/sharded/suspend", 2, &owners, &steps);
+  EXPECT_EQ(15, steps["loss"].size());
+  EXPECT_EQ(15, steps["acc"].size());
+}
+
+TEST(ShardedWriter, NotReady) {
+  ShardedWriter missing("runs/sharded/missing/events", 2);
+  EXPECT_FALSE(missing.Ready());
+  tensorboard::Event event;
+  event.mutable_summary()->add_value()->set_tag("loss");
+  EXPECT_EQ(-1, missing.Write(tensorboard::Event(event)));
+
+  ASSERT_EQ(0, MakeDirs("runs/sharded"));
+  ShardedWriter writer("runs/sharded/closed", 2);
+  ASSERT_TRUE(writer.Ready());
+  EXPECT_EQ(0, writer.Close());
+  EXPECT_EQ(-1, writer.Write(std::move(event)));
+}
+
+TEST(ShardedWriter, Recorder) {
+  string dir = "runs/sharded_recorder";
+  {
+    Recorder recorder(dir, ShardedWriter::Maker(3));
+    ASSERT_TRUE(recorder.Ready());
+    // framed records of the staged and the interned paths are split too
+    recorder.SetStaging(4096);
+    auto acc = recorder.Intern("acc");
+    for (int64_t step = 0; step < 200; ++step) {
+      EXPECT_LT(0, recorder.AddScalar("loss", 0.1 * step, step));
+      EXPECT_LT(0, recorder.AddScalar(acc, 0.2 * step, step));
+      EXPECT_LT(0, recorder.AddText("note", "text", step));
+    }
+  }
+
+  std::map<string, size_t> owners;
+  std::map<string, vector<int64_t>> steps;
+  ReadShards(dir + "/events", 3, &owners, &steps);
+  for (const char* tag : {"loss", "acc", "note/text_summary"}) {
+    ASSERT_EQ(200, steps[tag].size()) << tag;
+    for (int64_t step = 0; step < 200; ++step) {
+      EXPECT_EQ(step, steps[tag][step]);
+    }
+  }
+}
+
+}  // namespace nlptk
@@ -0,0 +1,126 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/stats.h"
+
+#include <chrono>                 // NOLINT(build/c++11)
+
+namespace nlptk {
+
+static std::atomic<uint32_t> next_stripe{0};
+
+WriterStats::WriterStats() : latency(kLatencyBuckets, 0) {
+}
+
+WriterStats& WriterStats::operator+=(const WriterStats& other) {
+  events += other.events;
+  bytes += other.bytes;
+  dropped += other.dropped;
+  flushes += other.flushes;
+  serialize_secs += other.serialize_secs;
+  checksum_secs += other.checksum_secs;
+  write_secs += other.write_secs;
+  queue_depth += other.queue_depth;
+  for (int i = 0; i < kLatencyBuckets; ++i) {
+    latency[i] += other.latency[i];
+  }
+
+  return *this;
+}
+
+double WriterStats::Latency(double q) const {
+  uint64_t total = 0;
+  for (auto count : latency) {
+    total += count;
+  }
+
+  if (total == 0) {
+    return 0.0;
+  }
+
+  uint64_t rank = q * total;
+  uint64_t seen = 0;
+  for (int i = 0; i < kLatencyBuckets; ++i) {
+    seen += latency[i];
+    if (seen > rank) {
+      return static_cast<double>(1ULL << i) * 1e-6;
+    }
+  }
+
+  return static_cast<double>(1ULL << (kLatencyBuckets - 1)) * 1e-6;
+}
+
+StatsCounters::StatsCounters() {
+  for (auto& stripe : stripes_) {
+    for (auto& counter : stripe.counters) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+
+    for (auto& bucket : stripe.latency) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+void StatsCounters::Add(Counter counter, uint64_t value) {
+  Local().counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+void StatsCounters::AddLatency(uint64_t nanos, uint64_t records) {
+  // the bucket of the smallest power of two above the microseconds
+  uint64_t micros = nanos / 1000;
+  int bucket = micros == 0 ? 0 : 64 - __builtin_clzll(micros);
+  if (bucket >= WriterStats::kLatencyBuckets) {
+    bucket = WriterStats::kLatencyBuckets - 1;
+  }
+
+  Local().latency[bucket].fetch_add(records, std::memory_order_relaxed);
+}
+
+WriterStats StatsCounters::Snapshot() const {
+  uint64_t sums[kNumCounters] = {0};
+  WriterStats stats;
+  for (const auto& stripe : stripes_) {
+    for (int i = 0; i < kNumCounters; ++i) {
+      sums[i] += stripe.counters[i].load(std::memory_order_relaxed);
+    }
+
+    for (int i = 0; i < WriterStats::kLatencyBuckets; ++i) {
+      stats.latency[i] += stripe.latency[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  stats.events = sums[kEvents];
+  stats.bytes = sums[kBytes];
+  stats.dropped = sums[kDropped];
+  stats.flushes = sums[kFlushes];
+  stats.serialize_secs = sums[kSerializeNanos] * 1e-9;
+  stats.checksum_secs = sums[kChecksumNanos] * 1e-9;
+  stats.write_secs = sums[kWriteNanos] * 1e-9;
+  return stats;
+}
+
+uint64_t StatsCounters::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StatsCounters::Stripe& StatsCounters::Local() {
+  // a thread keeps its stripe in all counters, threads beyond the number
+  // of stripes share them
+  static thread_local uint32_t stripe = next_stripe++ % kStripes;
+  return stripes_[stripe];
+}
+
+}  // namespace nlptk
@@ -0,0 +1,97 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RECORD_STATS_H_
+#define RECORD_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace nlptk {
+
+// A snapshot of what writing events has cost.
+class WriterStats {
+ public:
+  // latency bucket i counts the records of latencies below 2^i us
+  static const int kLatencyBuckets = 32;
+
+  WriterStats();
+
+  WriterStats& operator+=(const WriterStats& other);
+
+  // the latency in seconds which fraction `q` of the records stay below,
+  // the upper bound of its bucket, zero without records
+  double Latency(double q) const;
+
+ public:
+  uint64_t                events{0};
+  uint64_t                bytes{0};
+  uint64_t                dropped{0};
+  uint64_t                flushes{0};
+  double                  serialize_secs{0.0};
+  double                  checksum_secs{0.0};
+  double                  write_secs{0.0};
+  // records queued and not written yet
+  uint64_t                queue_depth{0};
+  // records by their latency from being enqueued until written to the OS,
+  // or synced to the disk under syncing durability policies
+  std::vector<uint64_t>   latency;
+};
+
+// Counters updated by many threads without locks. Every thread adds to its
+// own stripe of relaxed atomics and Snapshot() sums the stripes up, so the
+// counters cost no contention on the write path.
+class StatsCounters {
+ public:
+  enum Counter : int {
+    kEvents = 0,
+    kBytes,
+    kDropped,
+    kFlushes,
+    kSerializeNanos,
+    kChecksumNanos,
+    kWriteNanos,
+    kNumCounters,
+  };
+
+  StatsCounters();
+
+  void Add(Counter counter, uint64_t value);
+
+  void AddLatency(uint64_t nanos, uint64_t records = 1);
+
+  WriterStats Snapshot() const;
+
+  // nanoseconds of the steady clock
+  static uint64_t Now();
+
+ private:
+  static const int kStripes = 16;
+
+  // on cache lines of its own
+  struct alignas(64) Stripe {
+    std::atomic<uint64_t>   counters[kNumCounters];
+    std::atomic<uint64_t>   latency[WriterStats::kLatencyBuckets];
+  };
+
+  Stripe& Local();
+
+ private:
+  Stripe    stripes_[kStripes];
+};
+
+}  // namespace nlptk
+
+#endif  // RECORD_STATS_H_
@@ -0,0 +1,66 @@
+// Copyright (c) 2023 Mininglamp Tech. Inc. (Liang Zhao)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "record/stats.h"
+
+#include <thread>                 // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace nlptk {
+
+TEST(StatsCounters, Threads) {
+  StatsCounters counters;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 1000; ++i) {
+        counters.Add(StatsCounters::kEvents, 1);
+        counters.Add(StatsCounters::kBytes, 10);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  counters.Add(StatsCounters::kWriteNanos, 1500000000);
+  auto stats = counters.Snapshot();
+  EXPECT_EQ(8000, stats.events);
+  EXPECT_EQ(80000, stats.bytes);
+  EXPECT_EQ(0, stats.dropped);
+  EXPECT_DOUBLE_EQ(1.5, stats.write_secs);
+}
+
+TEST(StatsCounters, Latency) {
+  StatsCounters counters;
+  EXPECT_EQ(0.0, counters.Snapshot().Latency(0.5));
+
+  // 90 records below 8us, 10 below 2ms
+  counters.AddLatency(5000, 90);
+  counters.AddLatency(1500000, 10);
+  auto stats = counters.Snapshot();
+  EXPECT_DOUBLE_EQ(8e-6, stats.Latency(0.5));
+  EXPECT_DOUBLE_EQ(2048e-6, stats.Latency(0.99));
+
+  WriterStats sum;
+  sum += stats;
+  sum += stats;
+  EXPECT_EQ(2 * stats.latency[3], sum.latency[3]);
+  EXPECT_DOUBLE_EQ(8e-6, sum.Latency(0.5));
+}
+
+}  // namespace nlptk
@@ -16,8 +16,12 @@
 
 #include <algorithm>
 #include <climits>
+#include <cstring>
 
 #include "glog/logging.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
 #include "record/utils.h"
 #include "utils/image.h"
 
@@ -30,6 +34,10 @@ using tensorboard::Summary;
 using tensorboard::SummaryMetadata;
 using tensorboard::TensorProto;
 
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+
 vector<double> GenerateDefaultBins() {
   vector<double> pos_buckets, neg_buckets;
 
@@ -85,6 +93,44 @@ Summary* Scalar(const string& name, float value) {
   return summary;
 }
 
+string ScalarEventPrefix(const string& name) {
+  auto tag = CleanTag(name);
+  auto tag_size = static_cast<uint32_t>(tag.size());
+  // Value: tag (field 1) and simple_value (field 2, fixed32)
+  uint32_t value_size = 1 + CodedOutputStream::VarintSize32(tag_size) +
+                        tag_size + 1 + 4;
+  // Summary: value (field 1)
+  uint32_t summary_size = 1 + CodedOutputStream::VarintSize32(value_size) +
+                          value_size;
+
+  string prefix(1 + CodedOutputStream::VarintSize32(summary_size) +
+                summary_size - 4, '\0');
+  auto cur = reinterpret_cast<uint8_t*>(&prefix[0]);
+  cur = WireFormatLite::WriteTagToArray(
+      5, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, cur);
+  cur = CodedOutputStream::WriteVarint32ToArray(summary_size, cur);
+  cur = WireFormatLite::WriteTagToArray(
+      1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, cur);
+  cur = CodedOutputStream::WriteVarint32ToArray(value_size, cur);
+  cur = WireFormatLite::WriteStringToArray(1, tag, cur);
+  WireFormatLite::WriteTagToArray(2, WireFormatLite::WIRETYPE_FIXED32, cur);
+  return prefix;
+}
+
+size_t EncodeScalarEvent(const string& prefix, double wall_time, int64_t step,
+                         float value, char* buf) {
+  auto cur = reinterpret_cast<uint8_t*>(buf);
+  cur = WireFormatLite::WriteDoubleToArray(1, wall_time, cur);
+  // proto3 leaves out a zero step as well
+  if (step > 0) {
+    cur = WireFormatLite::WriteInt64ToArray(2, step, cur);
+  }
+
+  memcpy(cur, prefix.data(), prefix.size());
+  cur = WireFormatLite::WriteFloatNoTagToArray(value, cur + prefix.size());
+  return cur - reinterpret_cast<uint8_t*>(buf);
+}
+
 Summary* Histogram(const string& name, const vector<double>& values,
                    const string& bins) {
   const auto& bucket_limit = DefaultBins;
@@ -160,11 +206,6 @@ Summary* HistogramRaw(const std::string& name, double min, double max,
 
 Summary* Image(const string& name, const string& encoded_image, int32_t height,
                int32_t width, int32_t colorspace) {
-  if (0 >= colorspace || 6 < colorspace || height <= 0 || width <= 0) {
-    LOG(ERROR) << "Invalid image colorspace: " << colorspace;
-    return nullptr;
-  }
-
   if (encoded_image.empty()) {
   // if (encoded_image.size() != height * width * colorspace) {
     LOG(ERROR) << "Incompleted image data, got " << encoded_image.size()
@@ -172,11 +213,27 @@ Summary* Image(const string& name, const string& encoded_image, int32_t height,
     return nullptr;
   }
 
+  auto summary = ImageBlob(name, height, width, colorspace);
+  if (nullptr == summary) {
+    return nullptr;
+  }
+
+  summary->mutable_value(0)->mutable_image()->set_encoded_image_string(
+      encoded_image);
+  return summary;
+}
+
+Summary* ImageBlob(const string& name, int32_t height, int32_t width,
+                   int32_t colorspace) {
+  if (0 >= colorspace || 6 < colorspace || height <= 0 || width <= 0) {
+    LOG(ERROR) << "Invalid image colorspace: " << colorspace;
+    return nullptr;
+  }
+
   auto img = new Summary::Image();
   img->set_height(height);
   img->set_width(width);
   img->set_colorspace(colorspace);
-  img->set_encoded_image_string(encoded_image);
 
   auto tag = CleanTag(name);
   auto summary = new Summary();
@@ -264,11 +321,20 @@ Summary* Audio(const string& name, const string& encoded_audio,
     return nullptr;
   }
 
+  auto summary = AudioBlob(name, sample_rate, num_channels, length_frames,
+                           content_type);
+  summary->mutable_value(0)->mutable_audio()->set_encoded_audio_string(
+      encoded_audio);
+  return summary;
+}
+
+Summary* AudioBlob(const string& name, float sample_rate,
+                   int64_t num_channels, int64_t length_frames,
+                   const string& content_type) {
   auto audio = new Summary::Audio();
   audio->set_sample_rate(sample_rate);
   audio->set_num_channels(num_channels);
   audio->set_length_frames(length_frames);
-  audio->set_encoded_audio_string(encoded_audio);
   audio->set_content_type(content_type);
 
   auto tag = CleanTag(name);
@@ -280,6 +346,87 @@ Summary* Audio(const string& name, const string& encoded_audio,
   return summary;
 }
 
+int EncodeBlobEvent(const Summary& summary, double wall_time, int64_t step,
+                    size_t payload_size, string* head, string* tail) {
+  if (summary.value_size() != 1 || payload_size == 0 ||
+      payload_size > INT_MAX) {
+    return -1;
+  }
+
+  // the fields of the image or audio in front of and behind the payload,
+  // which is field 4 of both
+  const auto& value = summary.value(0);
+  uint32_t field = 0;
+  string front, back;
+  if (value.has_image() && value.image().encoded_image_string().empty()) {
+    field = 4;
+    front = value.image().SerializeAsString();
+  } else if (value.has_audio() &&
+             value.audio().encoded_audio_string().empty()) {
+    field = 6;
+    Summary::Audio audio(value.audio());
+    audio.clear_content_type();
+    front = audio.SerializeAsString();
+    audio.Clear();
+    audio.set_content_type(value.audio().content_type());
+    back = audio.SerializeAsString();
+  } else {
+    return -1;
+  }
+
+  // the fields of the value in front of and behind the image or audio
+  Summary::Value fields(value);
+  fields.clear_image();
+  fields.clear_audio();
+  fields.clear_metadata();
+  auto value_front = fields.SerializeAsString();
+  fields.Clear();
+  if (value.has_metadata()) {
+    *fields.mutable_metadata() = value.metadata();
+  }
+
+  auto value_back = fields.SerializeAsString();
+
+  auto payload = static_cast<uint32_t>(payload_size);
+  uint32_t blob_size = front.size() + 1 +
+                       CodedOutputStream::VarintSize32(payload) + payload +
+                       back.size();
+  uint32_t value_size = value_front.size() + 1 +
+                        CodedOutputStream::VarintSize32(blob_size) +
+                        blob_size + value_back.size();
+  uint32_t summary_size = 1 + CodedOutputStream::VarintSize32(value_size) +
+                          value_size;
+
+  head->clear();
+  {
+    StringOutputStream stream(head);
+    CodedOutputStream out(&stream);
+    WireFormatLite::WriteDouble(1, wall_time, &out);
+    // proto3 leaves out a zero step as well
+    if (step > 0) {
+      WireFormatLite::WriteInt64(2, step, &out);
+    }
+
+    WireFormatLite::WriteTag(5, WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                             &out);
+    out.WriteVarint32(summary_size);
+    WireFormatLite::WriteTag(1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                             &out);
+    out.WriteVarint32(value_size);
+    out.WriteString(value_front);
+    WireFormatLite::WriteTag(field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                             &out);
+    out.WriteVarint32(blob_size);
+    out.WriteString(front);
+    WireFormatLite::WriteTag(4, WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                             &out);
+    out.WriteVarint32(payload);
+  }
+
+  *tail = back + value_back;
+  return 0;
+}
+
 Summary* Text(const string& name, const string& text) {
   auto smd = new SummaryMetadata();
   auto plugin_data = smd->add_plugin_data();
@@ -24,6 +24,20 @@ namespace nlptk {
 
 tensorboard::Summary* Scalar(const std::string& name, float value);
 
+// Upper bound of the bytes of an encoded scalar Event besides its prefix,
+// i.e., the wall_time, the step and the value.
+static const size_t kScalarEventOverhead = 9 + 11 + 4;
+
+// The encoded Event.summary of a scalar summary of `name` up to the float
+// of its simple_value, see EncodeScalarEvent().
+std::string ScalarEventPrefix(const std::string& name);
+
+// Encodes the same bytes as serializing the Event of a scalar summary into
+// `buf`, which holds at least `prefix.size() + kScalarEventOverhead` bytes.
+// Returns the encoded size.
+size_t EncodeScalarEvent(const std::string& prefix, double wall_time,
+                         int64_t step, float value, char* buf);
+
 tensorboard::Summary* Histogram(const std::string& name,
                                 const std::vector<double>& values,
                                 const std::string& bins = "tensorflow");
@@ -38,6 +52,10 @@ tensorboard::Summary* Image(const std::string& name,
                             const std::string& encoded_image, int32_t height,
                             int32_t width, int32_t colorspace);
 
+// An image summary without its encoded bytes, see EncodeBlobEvent().
+tensorboard::Summary* ImageBlob(const std::string& name, int32_t height,
+                                int32_t width, int32_t colorspace);
+
 tensorboard::Summary* Images(const std::string& name,
                              const std::vector<std::string>& encoded_images,
                              int32_t height, int32_t width, int32_t colorspace,
@@ -48,6 +66,19 @@ tensorboard::Summary* Audio(const std::string& name,
                             int64_t num_channels, int64_t length_frames,
                             const std::string& content_type);
 
+// An audio summary without its encoded bytes, see EncodeBlobEvent().
+tensorboard::Summary* AudioBlob(const std::string& name, float sample_rate,
+                                int64_t num_channels, int64_t length_frames,
+                                const std::string& content_type);
+
+// Encodes the Event of the image or audio `summary` of ImageBlob() or
+// AudioBlob() around its payload of `payload_size` bytes, so that `head`,
+// the payload and `tail` serialize the same as the Event holding the
+// payload. The payload itself is never copied.
+int EncodeBlobEvent(const tensorboard::Summary& summary, double wall_time,
+                    int64_t step, size_t payload_size, std::string* head,
+                    std::string* tail);
+
 tensorboard::Summary* Text(const std::string& name, const std::string& text);
 
 template <class T>
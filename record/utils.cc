@@ -15,12 +15,17 @@
 #include "record/utils.h"
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cassert>
 #include <chrono>           // NOLINT(build/c++11)
 #include <cstdarg>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <vector>
 
 #include "glog/logging.h"
@@ -130,6 +135,15 @@ double Timestamp() {
   return tp.time_since_epoch().count() / 1000000.0;
 }
 
+double ThreadCpuTime() {
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0) {
+    return 0.0;
+  }
+
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
 int MakeDirs(const string& dir, bool parents) {
   if (IsExisted(dir)) {
     if (IsDirectory(dir)) {
@@ -206,4 +220,67 @@ string JoinPath(const string& path, const string& sub_path) {
   }
 }
 
+int ReadFile(const string& path, string* content) {
+  assert(content);
+
+  std::ifstream fin(path, std::ios::binary);
+  if (!fin.is_open() || fin.fail()) {
+    return -1;
+  }
+
+  std::ostringstream ss;
+  ss << fin.rdbuf();
+  fin.close();
+  *content = ss.str();
+  return content->size();
+}
+
+int WriteFileAtomically(const string& path, const string& content) {
+  auto tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    LOG(ERROR) << "Failed to create file '" << tmp_path << "', due to: "
+               << strerror(errno);
+    return -1;
+  }
+
+  const char* cur = content.data();
+  size_t left = content.size();
+  while (left > 0) {
+    auto n = write(fd, cur, left);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      LOG(ERROR) << "Failed to write file '" << tmp_path << "', due to: "
+                 << strerror(errno);
+      close(fd);
+      unlink(tmp_path.c_str());
+      return -1;
+    }
+
+    cur += n;
+    left -= n;
+  }
+
+  auto synced = fsync(fd);
+  if (close(fd) != 0 || synced != 0) {
+    LOG(ERROR) << "Failed to sync file '" << tmp_path << "', due to: "
+               << strerror(errno);
+    unlink(tmp_path.c_str());
+    return -1;
+  }
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to rename '" << tmp_path << "' to '" << path
+               << "', due to: " << strerror(errno);
+    unlink(tmp_path.c_str());
+    return -1;
+  }
+
+  return content.size();
+}
+
 }  // namespace nlptk
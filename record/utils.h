@@ -35,6 +35,9 @@ class StringUtil {
 
 double Timestamp();
 
+// cpu time consumed by the calling thread in seconds
+double ThreadCpuTime();
+
 int MakeDirs(const std::string& dir, bool parents = true);
 
 bool IsExisted(const std::string& path);
@@ -47,6 +50,12 @@ std::string AbsolutePath(const std::string& path);
 
 std::string JoinPath(const std::string& path, const std::string& sub_path);
 
+int ReadFile(const std::string& path, std::string* content);
+
+// Writes `content` to a temporary sibling file and renames it onto `path`,
+// so readers never observe a partially written file.
+int WriteFileAtomically(const std::string& path, const std::string& content);
+
 }  // namespace nlptk
 
 #endif  // RECORD_UTILS_H_
@@ -14,13 +14,138 @@
 
 #include "record/writer.h"
 
+#include <cstring>
+#include <utility>
+
+#include "glog/logging.h"
+#include "record/event_file.h"
+
 namespace nlptk {
 
+Blob::Blob() {
+}
+
+Blob::Blob(std::string&& data)
+    : owned_(new std::string(std::move(data))) {
+  data_ = owned_->data();
+  size_ = owned_->size();
+}
+
+Blob::Blob(const char* data, size_t size, std::function<void()> release)
+    : data_(data), size_(size), release_(std::move(release)) {
+}
+
+Blob::Blob(Blob&& other)
+    : owned_(std::move(other.owned_)), data_(other.data_),
+      size_(other.size_), release_(std::move(other.release_)) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.release_ = nullptr;
+}
+
+Blob& Blob::operator=(Blob&& other) {
+  if (this != &other) {
+    Reset();
+    owned_ = std::move(other.owned_);
+    data_ = other.data_;
+    size_ = other.size_;
+    release_ = std::move(other.release_);
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.release_ = nullptr;
+  }
+
+  return *this;
+}
+
+Blob::~Blob() {
+  Reset();
+}
+
+const char* Blob::data() const {
+  return data_;
+}
+
+size_t Blob::size() const {
+  return size_;
+}
+
+void Blob::Reset() {
+  if (release_) {
+    release_();
+    release_ = nullptr;
+  }
+
+  owned_.reset();
+  data_ = nullptr;
+  size_ = 0;
+}
+
 Writer::Writer() {
 }
 
+int Writer::WriteRecords(const char* data, size_t size, size_t records) {
+  size_t pos = 0;
+  while (pos + kRecordHeaderSize + kRecordFooterSize <= size) {
+    uint64_t len = 0;
+    memcpy(&len, data + pos, sizeof(len));
+    if (pos + kRecordHeaderSize + len + kRecordFooterSize > size) {
+      break;
+    }
+
+    tensorboard::Event event;
+    if (!event.ParseFromArray(data + pos + kRecordHeaderSize, len)) {
+      LOG(ERROR) << "Failed to parse framed record at " << pos;
+      return -1;
+    }
+
+    if (Write(std::move(event)) < 0) {
+      return -1;
+    }
+
+    pos += kRecordHeaderSize + len + kRecordFooterSize;
+  }
+
+  return pos;
+}
+
+int Writer::WriteBlob(const std::string& head, Blob&& blob,
+                      const std::string& tail) {
+  size_t size = head.size() + blob.size() + tail.size();
+  std::string record(kRecordHeaderSize + size + kRecordFooterSize, '\0');
+  auto data = &record[kRecordHeaderSize];
+  memcpy(data, head.data(), head.size());
+  memcpy(data + head.size(), blob.data(), blob.size());
+  memcpy(data + head.size() + blob.size(), tail.data(), tail.size());
+  blob.Reset();
+
+  FrameRecord(&record[0], size);
+  return WriteRecords(record.data(), record.size(), 1) < 0 ? -1 : size;
+}
+
+void Writer::SetMemoryBudget(MemoryBudget* budget) {
+}
+
 int Writer::Ready() const {
   return false;
 }
 
+int Writer::Suspend() {
+  return -1;
+}
+
+int64_t Writer::LastStep(const std::string& tag) const {
+  return -1;
+}
+
+WriterStats Writer::Stats() const {
+  auto stats = stats_.Snapshot();
+  stats.queue_depth = QueueDepth();
+  return stats;
+}
+
+uint64_t Writer::QueueDepth() const {
+  return 0;
+}
+
 }  // namespace nlptk
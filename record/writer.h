@@ -15,10 +15,96 @@
 #ifndef RECORD_WRITER_H_
 #define RECORD_WRITER_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
 #include "proto/event.pb.h"
+#include "record/stats.h"
 
 namespace nlptk {
 
+class MemoryBudget;
+
+// Limits of a single event file, zero disables a limit. Once any limit is
+// reached the writer continues in a new event file.
+class RotationPolicy {
+ public:
+  uint64_t    max_bytes{0};
+  uint64_t    max_records{0};
+  uint64_t    max_secs{0};
+  // cap of the total bytes of the event files and their indexes in the
+  // directory of the writer and its subdirectories, e.g., a Recorder's run
+  // with its AddScalars sub-runs, those of other writers included. The
+  // oldest files are removed after a rotation, except the newest one of
+  // every writer (directory, name and host) which may still be written,
+  // and with max_secs, the files modified within max_secs. Zero means
+  // unlimited.
+  uint64_t    retention_bytes{0};
+};
+
+// How long written records may stay in memory before they reach the OS or
+// the disk, i.e., the window of records lost when the process or the host
+// crashes. Latency bounds of synchronous writers are checked on writes.
+class DurabilityPolicy {
+ public:
+  enum class Mode : uint8_t {
+    kNone,          // flush when the buffer is full, on Flush() or Close()
+    kBuffered,      // flush at most max_latency_ms after a record is written
+    kGroupCommit,   // fdatasync every group_records records or group_millis
+    kSync,          // fdatasync every written batch
+  };
+
+  Mode        mode{Mode::kBuffered};
+  uint64_t    max_latency_ms{0};
+  uint64_t    group_records{0};
+  uint64_t    group_millis{0};
+};
+
+class WriterOptions {
+ public:
+  RotationPolicy    rotation;
+  DurabilityPolicy  durability;
+  bool              resume{false};
+  // maintain a sidecar tag/step index next to every event file
+  bool              index{false};
+};
+
+// The payload of a blob summary, e.g., an encoded image, handed to a writer
+// without copying it. A blob either owns a moved-in string or views a
+// buffer of the caller, whose `release` is called once the bytes have been
+// written and are no longer needed.
+class Blob {
+ public:
+  Blob();
+
+  explicit Blob(std::string&& data);
+
+  Blob(const char* data, size_t size,
+       std::function<void()> release = nullptr);
+
+  Blob(Blob&& other);
+
+  Blob& operator=(Blob&& other);
+
+  ~Blob();
+
+  const char* data() const;
+
+  size_t size() const;
+
+  // gives the bytes back to their owner
+  void Reset();
+
+ private:
+  std::unique_ptr<std::string>  owned_;
+  const char*                   data_{nullptr};
+  size_t                        size_{0};
+  std::function<void()>         release_;
+};
+
 class Writer {
  public:
   Writer();
@@ -27,11 +113,44 @@ class Writer {
 
   virtual int Write(tensorboard::Event&& event) = 0;
 
+  // Writes a batch of `records` records framed by AppendRecord(), returns
+  // the bytes written. The default parses them back and writes them one
+  // by one.
+  virtual int WriteRecords(const char* data, size_t size, size_t records);
+
+  // Writes a record of the serialized event `head`, the bytes of `blob`
+  // and `tail`, returns the bytes written. Writers which support it write
+  // the blob from its buffer instead of copying it, the default frames a
+  // copy and calls WriteRecords().
+  virtual int WriteBlob(const std::string& head, Blob&& blob,
+                        const std::string& tail);
+
+  // Writers which queue records in memory charge them to `budget` until
+  // they are written. The default queues nothing.
+  virtual void SetMemoryBudget(MemoryBudget* budget);
+
   virtual int Flush() = 0;
 
   virtual int Close() = 0;
 
   virtual int Ready() const;
+
+  // Releases the file descriptors of an idle writer, the next write reopens
+  // its event file for appending. Returns -1 if not supported.
+  virtual int Suspend();
+
+  // Last step logged for `tag` before the writer resumed an existing event
+  // file, -1 if unknown.
+  virtual int64_t LastStep(const std::string& tag) const;
+
+  // What writing has cost so far, see StatsCounters.
+  virtual WriterStats Stats() const;
+
+ protected:
+  // records queued and not written yet, none for synchronous writers
+  virtual uint64_t QueueDepth() const;
+
+  mutable StatsCounters   stats_;
 };
 
 }  // namespace nlptk